@@ -21,11 +21,16 @@
 #include "render.h"
 #include "color.h"
 #include "instance.h"
+#include "cpu.h"
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <string.h>
 
+#ifdef RR_CPU_X86
+#include <immintrin.h>
+#endif
+
 void RrColorAllocateGC(RrColor *in)
 {
     XGCValues gcv;
@@ -122,6 +127,460 @@ void RrColorFree(RrColor *c)
     }
 }
 
+/*! The per-pixel loops for converting between our pixel format and the
+  visual's, picked by RrDepthInit() to match what the cpu can do.  Each one
+  converts a row of n pixels, and every variant produces exactly the same
+  pixels. */
+typedef struct _RrDepthKernels {
+    /*! To 32bpp pixels with the visual's channel offsets */
+    void (*reduce32)(const RrInstance *inst, const RrPixel32 *in,
+                     RrPixel32 *out, gint n);
+    /*! To 24bpp pixels packed into 3 bytes each */
+    void (*reduce24)(const RrInstance *inst, const RrPixel32 *in,
+                     guchar *out, gint n);
+    /*! To 16bpp pixels using the visual's offsets and shifts */
+    void (*reduce16)(const RrInstance *inst, const RrPixel32 *in,
+                     RrPixel16 *out, gint n);
+    /*! From 32bpp pixels with the visual's channel offsets */
+    void (*increase32)(const RrInstance *inst, const RrPixel32 *in,
+                       RrPixel32 *out, gint n);
+    /*! From 16bpp pixels using the visual's masks, offsets and shifts */
+    void (*increase16)(const RrInstance *inst, const RrPixel16 *in,
+                       RrPixel32 *out, gint n);
+} RrDepthKernels;
+
+static void reduce32_scalar(const RrInstance *inst, const RrPixel32 *in,
+                            RrPixel32 *out, gint n)
+{
+    const gint ro = RrRedOffset(inst);
+    const gint go = RrGreenOffset(inst);
+    const gint bo = RrBlueOffset(inst);
+    gint x, r, g, b;
+
+    for (x = 0; x < n; x++) {
+        r = (in[x] >> RrDefaultRedOffset) & 0xFF;
+        g = (in[x] >> RrDefaultGreenOffset) & 0xFF;
+        b = (in[x] >> RrDefaultBlueOffset) & 0xFF;
+        out[x] = (r << ro) + (g << go) + (b << bo);
+    }
+}
+
+static void reduce24_scalar(const RrInstance *inst, const RrPixel32 *in,
+                            guchar *out, gint n)
+{
+    /* reverse the ordering, shifting left 16bit should be the first byte
+       out of three, etc */
+    const guint roff = (16 - RrRedOffset(inst)) / 8;
+    const guint goff = (16 - RrGreenOffset(inst)) / 8;
+    const guint boff = (16 - RrBlueOffset(inst)) / 8;
+    gint x, outx;
+
+    for (x = 0, outx = 0; x < n; x++, outx += 3) {
+        out[outx+roff] = (in[x] >> RrDefaultRedOffset) & 0xFF;
+        out[outx+goff] = (in[x] >> RrDefaultGreenOffset) & 0xFF;
+        out[outx+boff] = (in[x] >> RrDefaultBlueOffset) & 0xFF;
+    }
+}
+
+static void reduce16_scalar(const RrInstance *inst, const RrPixel32 *in,
+                            RrPixel16 *out, gint n)
+{
+    const gint ro = RrRedOffset(inst);
+    const gint go = RrGreenOffset(inst);
+    const gint bo = RrBlueOffset(inst);
+    const gint rs = RrRedShift(inst);
+    const gint gs = RrGreenShift(inst);
+    const gint bs = RrBlueShift(inst);
+    gint x, r, g, b;
+
+    for (x = 0; x < n; x++) {
+        r = ((in[x] >> RrDefaultRedOffset) & 0xFF) >> rs;
+        g = ((in[x] >> RrDefaultGreenOffset) & 0xFF) >> gs;
+        b = ((in[x] >> RrDefaultBlueOffset) & 0xFF) >> bs;
+        out[x] = (r << ro) + (g << go) + (b << bo);
+    }
+}
+
+static void increase32_scalar(const RrInstance *inst, const RrPixel32 *in,
+                              RrPixel32 *out, gint n)
+{
+    const gint ro = RrRedOffset(inst);
+    const gint go = RrGreenOffset(inst);
+    const gint bo = RrBlueOffset(inst);
+    gint x, r, g, b;
+
+    for (x = 0; x < n; x++) {
+        r = (in[x] >> ro) & 0xff;
+        g = (in[x] >> go) & 0xff;
+        b = (in[x] >> bo) & 0xff;
+        out[x] = (r << RrDefaultRedOffset)
+            + (g << RrDefaultGreenOffset)
+            + (b << RrDefaultBlueOffset)
+            + (0xff << RrDefaultAlphaOffset);
+    }
+}
+
+static void increase16_scalar(const RrInstance *inst, const RrPixel16 *in,
+                              RrPixel32 *out, gint n)
+{
+    const gint rm = RrRedMask(inst);
+    const gint gm = RrGreenMask(inst);
+    const gint bm = RrBlueMask(inst);
+    const gint ro = RrRedOffset(inst);
+    const gint go = RrGreenOffset(inst);
+    const gint bo = RrBlueOffset(inst);
+    const gint rs = RrRedShift(inst);
+    const gint gs = RrGreenShift(inst);
+    const gint bs = RrBlueShift(inst);
+    gint x, r, g, b;
+
+    for (x = 0; x < n; x++) {
+        r = (in[x] & rm) >> ro << rs;
+        g = (in[x] & gm) >> go << gs;
+        b = (in[x] & bm) >> bo << bs;
+        out[x] = (r << RrDefaultRedOffset)
+            + (g << RrDefaultGreenOffset)
+            + (b << RrDefaultBlueOffset)
+            + (0xff << RrDefaultAlphaOffset);
+    }
+}
+
+static const RrDepthKernels kernels_scalar = {
+    reduce32_scalar,
+    reduce24_scalar,
+    reduce16_scalar,
+    increase32_scalar,
+    increase16_scalar
+};
+
+#ifdef RR_CPU_X86
+
+/* Shift counts for the _mm_sll/_mm_srl family, which take them in a vector
+   register so that they don't need to be known at compile time */
+#define SHIFT(s) _mm_cvtsi32_si128(s)
+
+/* Split 32bpp pixels into their 8 bit channels */
+#define CHANNELS_SSE2(p, r, g, b)                                       \
+    r = _mm_and_si128(_mm_srli_epi32(p, RrDefaultRedOffset), ff);       \
+    g = _mm_and_si128(_mm_srli_epi32(p, RrDefaultGreenOffset), ff);     \
+    b = _mm_and_si128(_mm_srli_epi32(p, RrDefaultBlueOffset), ff)
+
+/* Put 8 bit channels back together into 32bpp pixels with full alpha */
+#define PIXELS_SSE2(r, g, b)                                            \
+    _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(r, RrDefaultRedOffset),  \
+                                _mm_slli_epi32(g, RrDefaultGreenOffset)), \
+                  _mm_add_epi32(_mm_slli_epi32(b, RrDefaultBlueOffset), \
+                                alpha))
+
+RR_TARGET_SSE2
+static void reduce32_sse2(const RrInstance *inst, const RrPixel32 *in,
+                          RrPixel32 *out, gint n)
+{
+    const __m128i ff = _mm_set1_epi32(0xFF);
+    const __m128i ro = SHIFT(RrRedOffset(inst));
+    const __m128i go = SHIFT(RrGreenOffset(inst));
+    const __m128i bo = SHIFT(RrBlueOffset(inst));
+    __m128i p, r, g, b;
+    gint x;
+
+    for (x = 0; x + 4 <= n; x += 4) {
+        p = _mm_loadu_si128((const __m128i*)(in + x));
+        CHANNELS_SSE2(p, r, g, b);
+        p = _mm_add_epi32(_mm_add_epi32(_mm_sll_epi32(r, ro),
+                                        _mm_sll_epi32(g, go)),
+                          _mm_sll_epi32(b, bo));
+        _mm_storeu_si128((__m128i*)(out + x), p);
+    }
+    reduce32_scalar(inst, in + x, out + x, n - x);
+}
+
+/*! Converts 4 pixels to 16bpp, leaving them in the low half of each 32 bit
+  lane, sign extended so that _mm_packs_epi32 keeps all their bits */
+RR_TARGET_SSE2
+static inline __m128i reduce16_4_sse2(const RrPixel32 *in, __m128i ff,
+                                      __m128i ro, __m128i go, __m128i bo,
+                                      __m128i rs, __m128i gs, __m128i bs)
+{
+    __m128i p, r, g, b;
+
+    p = _mm_loadu_si128((const __m128i*)in);
+    CHANNELS_SSE2(p, r, g, b);
+    p = _mm_add_epi32(_mm_add_epi32(_mm_sll_epi32(_mm_srl_epi32(r, rs), ro),
+                                    _mm_sll_epi32(_mm_srl_epi32(g, gs), go)),
+                      _mm_sll_epi32(_mm_srl_epi32(b, bs), bo));
+    return _mm_srai_epi32(_mm_slli_epi32(p, 16), 16);
+}
+
+RR_TARGET_SSE2
+static void reduce16_sse2(const RrInstance *inst, const RrPixel32 *in,
+                          RrPixel16 *out, gint n)
+{
+    const __m128i ff = _mm_set1_epi32(0xFF);
+    const __m128i ro = SHIFT(RrRedOffset(inst));
+    const __m128i go = SHIFT(RrGreenOffset(inst));
+    const __m128i bo = SHIFT(RrBlueOffset(inst));
+    const __m128i rs = SHIFT(RrRedShift(inst));
+    const __m128i gs = SHIFT(RrGreenShift(inst));
+    const __m128i bs = SHIFT(RrBlueShift(inst));
+    __m128i lo, hi;
+    gint x;
+
+    for (x = 0; x + 8 <= n; x += 8) {
+        lo = reduce16_4_sse2(in + x, ff, ro, go, bo, rs, gs, bs);
+        hi = reduce16_4_sse2(in + x + 4, ff, ro, go, bo, rs, gs, bs);
+        _mm_storeu_si128((__m128i*)(out + x), _mm_packs_epi32(lo, hi));
+    }
+    reduce16_scalar(inst, in + x, out + x, n - x);
+}
+
+RR_TARGET_SSE2
+static void increase32_sse2(const RrInstance *inst, const RrPixel32 *in,
+                            RrPixel32 *out, gint n)
+{
+    const __m128i ff = _mm_set1_epi32(0xFF);
+    const __m128i alpha = _mm_set1_epi32(0xFF << RrDefaultAlphaOffset);
+    const __m128i ro = SHIFT(RrRedOffset(inst));
+    const __m128i go = SHIFT(RrGreenOffset(inst));
+    const __m128i bo = SHIFT(RrBlueOffset(inst));
+    __m128i p, r, g, b;
+    gint x;
+
+    for (x = 0; x + 4 <= n; x += 4) {
+        p = _mm_loadu_si128((const __m128i*)(in + x));
+        r = _mm_and_si128(_mm_srl_epi32(p, ro), ff);
+        g = _mm_and_si128(_mm_srl_epi32(p, go), ff);
+        b = _mm_and_si128(_mm_srl_epi32(p, bo), ff);
+        _mm_storeu_si128((__m128i*)(out + x), PIXELS_SSE2(r, g, b));
+    }
+    increase32_scalar(inst, in + x, out + x, n - x);
+}
+
+RR_TARGET_SSE2
+static void increase16_sse2(const RrInstance *inst, const RrPixel16 *in,
+                            RrPixel32 *out, gint n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32(0xFF << RrDefaultAlphaOffset);
+    const __m128i rm = _mm_set1_epi32(RrRedMask(inst));
+    const __m128i gm = _mm_set1_epi32(RrGreenMask(inst));
+    const __m128i bm = _mm_set1_epi32(RrBlueMask(inst));
+    const __m128i ro = SHIFT(RrRedOffset(inst));
+    const __m128i go = SHIFT(RrGreenOffset(inst));
+    const __m128i bo = SHIFT(RrBlueOffset(inst));
+    const __m128i rs = SHIFT(RrRedShift(inst));
+    const __m128i gs = SHIFT(RrGreenShift(inst));
+    const __m128i bs = SHIFT(RrBlueShift(inst));
+    __m128i v, p, r, g, b;
+    gint x, i;
+
+    for (x = 0; x + 8 <= n; x += 8) {
+        v = _mm_loadu_si128((const __m128i*)(in + x));
+        for (i = 0; i < 2; ++i) {
+            p = i ? _mm_unpackhi_epi16(v, zero) : _mm_unpacklo_epi16(v, zero);
+            r = _mm_sll_epi32(_mm_srl_epi32(_mm_and_si128(p, rm), ro), rs);
+            g = _mm_sll_epi32(_mm_srl_epi32(_mm_and_si128(p, gm), go), gs);
+            b = _mm_sll_epi32(_mm_srl_epi32(_mm_and_si128(p, bm), bo), bs);
+            _mm_storeu_si128((__m128i*)(out + x + i * 4),
+                             PIXELS_SSE2(r, g, b));
+        }
+    }
+    increase16_scalar(inst, in + x, out + x, n - x);
+}
+
+/* Split 32bpp pixels into their 8 bit channels */
+#define CHANNELS_AVX2(p, r, g, b)                                           \
+    r = _mm256_and_si256(_mm256_srli_epi32(p, RrDefaultRedOffset), ff);     \
+    g = _mm256_and_si256(_mm256_srli_epi32(p, RrDefaultGreenOffset), ff);   \
+    b = _mm256_and_si256(_mm256_srli_epi32(p, RrDefaultBlueOffset), ff)
+
+/* Put 8 bit channels back together into 32bpp pixels with full alpha */
+#define PIXELS_AVX2(r, g, b)                                                \
+    _mm256_add_epi32(                                                       \
+        _mm256_add_epi32(_mm256_slli_epi32(r, RrDefaultRedOffset),          \
+                         _mm256_slli_epi32(g, RrDefaultGreenOffset)),       \
+        _mm256_add_epi32(_mm256_slli_epi32(b, RrDefaultBlueOffset), alpha))
+
+RR_TARGET_AVX2
+static void reduce32_avx2(const RrInstance *inst, const RrPixel32 *in,
+                          RrPixel32 *out, gint n)
+{
+    const __m256i ff = _mm256_set1_epi32(0xFF);
+    const __m128i ro = SHIFT(RrRedOffset(inst));
+    const __m128i go = SHIFT(RrGreenOffset(inst));
+    const __m128i bo = SHIFT(RrBlueOffset(inst));
+    __m256i p, r, g, b;
+    gint x;
+
+    for (x = 0; x + 8 <= n; x += 8) {
+        p = _mm256_loadu_si256((const __m256i*)(in + x));
+        CHANNELS_AVX2(p, r, g, b);
+        p = _mm256_add_epi32(_mm256_add_epi32(_mm256_sll_epi32(r, ro),
+                                              _mm256_sll_epi32(g, go)),
+                             _mm256_sll_epi32(b, bo));
+        _mm256_storeu_si256((__m256i*)(out + x), p);
+    }
+    reduce32_scalar(inst, in + x, out + x, n - x);
+}
+
+RR_TARGET_AVX2
+static void reduce24_avx2(const RrInstance *inst, const RrPixel32 *in,
+                          guchar *out, gint n)
+{
+    const gint roff = (16 - RrRedOffset(inst)) / 8;
+    const gint goff = (16 - RrGreenOffset(inst)) / 8;
+    const gint boff = (16 - RrBlueOffset(inst)) / 8;
+    const __m256i ff = _mm256_set1_epi32(0xFF);
+    const __m128i ro = SHIFT(roff * 8);
+    const __m128i go = SHIFT(goff * 8);
+    const __m128i bo = SHIFT(boff * 8);
+    /* drops the 4th byte of each pixel, packing 4 pixels into the low 12
+       bytes of each 128 bit lane */
+    const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10,
+                                          12, 13, 14, -1, -1, -1, -1,
+                                          0, 1, 2, 4, 5, 6, 8, 9, 10,
+                                          12, 13, 14, -1, -1, -1, -1);
+    __m256i p, r, g, b;
+    gint x;
+
+    /* each lane is stored as 16 bytes but only moves ahead 12, so stop
+       early enough that the extra bytes are still inside the row */
+    for (x = 0; x + 10 <= n; x += 8) {
+        p = _mm256_loadu_si256((const __m256i*)(in + x));
+        CHANNELS_AVX2(p, r, g, b);
+        /* put each channel at the byte it goes in */
+        p = _mm256_or_si256(_mm256_or_si256(_mm256_sll_epi32(r, ro),
+                                            _mm256_sll_epi32(g, go)),
+                            _mm256_sll_epi32(b, bo));
+        p = _mm256_shuffle_epi8(p, pack);
+        _mm_storeu_si128((__m128i*)(out + x * 3),
+                         _mm256_castsi256_si128(p));
+        _mm_storeu_si128((__m128i*)(out + x * 3 + 12),
+                         _mm256_extracti128_si256(p, 1));
+    }
+    reduce24_scalar(inst, in + x, out + x * 3, n - x);
+}
+
+RR_TARGET_AVX2
+static void reduce16_avx2(const RrInstance *inst, const RrPixel32 *in,
+                          RrPixel16 *out, gint n)
+{
+    const __m256i ff = _mm256_set1_epi32(0xFF);
+    const __m128i ro = SHIFT(RrRedOffset(inst));
+    const __m128i go = SHIFT(RrGreenOffset(inst));
+    const __m128i bo = SHIFT(RrBlueOffset(inst));
+    const __m128i rs = SHIFT(RrRedShift(inst));
+    const __m128i gs = SHIFT(RrGreenShift(inst));
+    const __m128i bs = SHIFT(RrBlueShift(inst));
+    __m256i p[2], r, g, b;
+    gint x, i;
+
+    for (x = 0; x + 16 <= n; x += 16) {
+        for (i = 0; i < 2; ++i) {
+            p[i] = _mm256_loadu_si256((const __m256i*)(in + x + i * 8));
+            CHANNELS_AVX2(p[i], r, g, b);
+            p[i] = _mm256_add_epi32(
+                _mm256_add_epi32(
+                    _mm256_sll_epi32(_mm256_srl_epi32(r, rs), ro),
+                    _mm256_sll_epi32(_mm256_srl_epi32(g, gs), go)),
+                _mm256_sll_epi32(_mm256_srl_epi32(b, bs), bo));
+            /* sign extend so that packing keeps all 16 bits */
+            p[i] = _mm256_srai_epi32(_mm256_slli_epi32(p[i], 16), 16);
+        }
+        /* packing works within each 128 bit lane, so put the halves back in
+           order afterward */
+        p[0] = _mm256_permute4x64_epi64(_mm256_packs_epi32(p[0], p[1]),
+                                        _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(out + x), p[0]);
+    }
+    reduce16_scalar(inst, in + x, out + x, n - x);
+}
+
+RR_TARGET_AVX2
+static void increase32_avx2(const RrInstance *inst, const RrPixel32 *in,
+                            RrPixel32 *out, gint n)
+{
+    const __m256i ff = _mm256_set1_epi32(0xFF);
+    const __m256i alpha = _mm256_set1_epi32(0xFF << RrDefaultAlphaOffset);
+    const __m128i ro = SHIFT(RrRedOffset(inst));
+    const __m128i go = SHIFT(RrGreenOffset(inst));
+    const __m128i bo = SHIFT(RrBlueOffset(inst));
+    __m256i p, r, g, b;
+    gint x;
+
+    for (x = 0; x + 8 <= n; x += 8) {
+        p = _mm256_loadu_si256((const __m256i*)(in + x));
+        r = _mm256_and_si256(_mm256_srl_epi32(p, ro), ff);
+        g = _mm256_and_si256(_mm256_srl_epi32(p, go), ff);
+        b = _mm256_and_si256(_mm256_srl_epi32(p, bo), ff);
+        _mm256_storeu_si256((__m256i*)(out + x), PIXELS_AVX2(r, g, b));
+    }
+    increase32_scalar(inst, in + x, out + x, n - x);
+}
+
+RR_TARGET_AVX2
+static void increase16_avx2(const RrInstance *inst, const RrPixel16 *in,
+                            RrPixel32 *out, gint n)
+{
+    const __m256i alpha = _mm256_set1_epi32(0xFF << RrDefaultAlphaOffset);
+    const __m256i rm = _mm256_set1_epi32(RrRedMask(inst));
+    const __m256i gm = _mm256_set1_epi32(RrGreenMask(inst));
+    const __m256i bm = _mm256_set1_epi32(RrBlueMask(inst));
+    const __m128i ro = SHIFT(RrRedOffset(inst));
+    const __m128i go = SHIFT(RrGreenOffset(inst));
+    const __m128i bo = SHIFT(RrBlueOffset(inst));
+    const __m128i rs = SHIFT(RrRedShift(inst));
+    const __m128i gs = SHIFT(RrGreenShift(inst));
+    const __m128i bs = SHIFT(RrBlueShift(inst));
+    __m256i p, r, g, b;
+    gint x;
+
+    for (x = 0; x + 8 <= n; x += 8) {
+        p = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(in + x)));
+        r = _mm256_sll_epi32(_mm256_srl_epi32(_mm256_and_si256(p, rm), ro),
+                             rs);
+        g = _mm256_sll_epi32(_mm256_srl_epi32(_mm256_and_si256(p, gm), go),
+                             gs);
+        b = _mm256_sll_epi32(_mm256_srl_epi32(_mm256_and_si256(p, bm), bo),
+                             bs);
+        _mm256_storeu_si256((__m256i*)(out + x), PIXELS_AVX2(r, g, b));
+    }
+    increase16_scalar(inst, in + x, out + x, n - x);
+}
+
+static const RrDepthKernels kernels_sse2 = {
+    reduce32_sse2,
+    reduce24_scalar, /* packing 3 byte pixels needs a byte shuffle */
+    reduce16_sse2,
+    increase32_sse2,
+    increase16_sse2
+};
+
+static const RrDepthKernels kernels_avx2 = {
+    reduce32_avx2,
+    reduce24_avx2,
+    reduce16_avx2,
+    increase32_avx2,
+    increase16_avx2
+};
+
+#endif /* RR_CPU_X86 */
+
+static const RrDepthKernels *kern = &kernels_scalar;
+
+void RrDepthInit(void)
+{
+#ifdef RR_CPU_X86
+    RrCpuFeatures cpu = RrCpuFeaturesGet();
+
+    if (cpu & RR_CPU_AVX2)
+        kern = &kernels_avx2;
+    else if (cpu & RR_CPU_SSE2)
+        kern = &kernels_sse2;
+    else
+#endif
+        kern = &kernels_scalar;
+}
+
 void RrReduceDepth(const RrInstance *inst, RrPixel32 *data, XImage *im)
 {
     gint r, g, b;
@@ -141,50 +600,22 @@ void RrReduceDepth(const RrInstance *inst, RrPixel32 *data, XImage *im)
             (bo != RrDefaultBlueOffset) ||
             (go != RrDefaultGreenOffset)) {
             for (y = 0; y < im->height; y++) {
-                for (x = 0; x < im->width; x++) {
-                    r = (data[x] >> RrDefaultRedOffset) & 0xFF;
-                    g = (data[x] >> RrDefaultGreenOffset) & 0xFF;
-                    b = (data[x] >> RrDefaultBlueOffset) & 0xFF;
-                    p32[x] = (r << ro) + (g << go) + (b << bo);
-                }
+                kern->reduce32(inst, data, p32, im->width);
                 data += im->width;
                 p32 += im->width;
             }
         } else im->data = (gchar*) data;
         break;
     case 24:
-    {
-        /* reverse the ordering, shifting left 16bit should be the first byte
-           out of three, etc */
-        const guint roff = (16 - ro) / 8;
-        const guint goff = (16 - go) / 8;
-        const guint boff = (16 - bo) / 8;
-        gint outx;
         for (y = 0; y < im->height; y++) {
-            for (x = 0, outx = 0; x < im->width; x++, outx += 3) {
-                r = (data[x] >> RrDefaultRedOffset) & 0xFF;
-                g = (data[x] >> RrDefaultGreenOffset) & 0xFF;
-                b = (data[x] >> RrDefaultBlueOffset) & 0xFF;
-                p8[outx+roff] = r;
-                p8[outx+goff] = g;
-                p8[outx+boff] = b;
-            }
+            kern->reduce24(inst, data, p8, im->width);
             data += im->width;
             p8 += im->bytes_per_line;
         }
         break;
-    }
     case 16:
         for (y = 0; y < im->height; y++) {
-            for (x = 0; x < im->width; x++) {
-                r = (data[x] >> RrDefaultRedOffset) & 0xFF;
-                r = r >> rs;
-                g = (data[x] >> RrDefaultGreenOffset) & 0xFF;
-                g = g >> gs;
-                b = (data[x] >> RrDefaultBlueOffset) & 0xFF;
-                b = b >> bs;
-                p16[x] = (r << ro) + (g << go) + (b << bo);
-            }
+            kern->reduce16(inst, data, p16, im->width);
             data += im->width;
             p16 += im->bytes_per_line/2;
         }
@@ -271,7 +702,6 @@ static void swap_byte_order(XImage *im)
 
 void RrIncreaseDepth(const RrInstance *inst, RrPixel32 *data, XImage *im)
 {
-    gint r, g, b;
     gint x,y;
     RrPixel32 *p32 = (RrPixel32 *) im->data;
     RrPixel16 *p16 = (RrPixel16 *) im->data;
@@ -283,36 +713,14 @@ void RrIncreaseDepth(const RrInstance *inst, RrPixel32 *data, XImage *im)
     switch (im->bits_per_pixel) {
     case 32:
         for (y = 0; y < im->height; y++) {
-            for (x = 0; x < im->width; x++) {
-                r = (p32[x] >> RrRedOffset(inst)) & 0xff;
-                g = (p32[x] >> RrGreenOffset(inst)) & 0xff;
-                b = (p32[x] >> RrBlueOffset(inst)) & 0xff;
-                data[x] = (r << RrDefaultRedOffset)
-                    + (g << RrDefaultGreenOffset)
-                    + (b << RrDefaultBlueOffset)
-                    + (0xff << RrDefaultAlphaOffset);
-            }
+            kern->increase32(inst, p32, data, im->width);
             data += im->width;
             p32 += im->bytes_per_line/4;
         }
         break;
     case 16:
         for (y = 0; y < im->height; y++) {
-            for (x = 0; x < im->width; x++) {
-                r = (p16[x] & RrRedMask(inst)) >>
-                    RrRedOffset(inst) <<
-                    RrRedShift(inst);
-                g = (p16[x] & RrGreenMask(inst)) >>
-                    RrGreenOffset(inst) <<
-                    RrGreenShift(inst);
-                b = (p16[x] & RrBlueMask(inst)) >>
-                    RrBlueOffset(inst) <<
-                    RrBlueShift(inst);
-                data[x] = (r << RrDefaultRedOffset)
-                    + (g << RrDefaultGreenOffset)
-                    + (b << RrDefaultBlueOffset)
-                    + (0xff << RrDefaultAlphaOffset);
-            }
+            kern->increase16(inst, p16, data, im->width);
             data += im->width;
             p16 += im->bytes_per_line/2;
         }
@@ -48,4 +48,7 @@ XColor *RrPickColor(const RrInstance *inst, gint r, gint g, gint b);
 void RrReduceDepth(const RrInstance *inst, RrPixel32 *data, XImage *im);
 void RrIncreaseDepth(const RrInstance *inst, RrPixel32 *data, XImage *im);
 
+/*! Picks the fastest depth conversion kernels that the cpu supports */
+void RrDepthInit(void);
+
 #endif /* __color_h */
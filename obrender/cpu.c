@@ -0,0 +1,38 @@
+/* -*- indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*-
+
+   cpu.c for the Openbox window manager
+   Copyright (c) 2026        Openbox developers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   See the COPYING file for a copy of the GNU General Public License.
+*/
+
+#include "cpu.h"
+
+RrCpuFeatures RrCpuFeaturesGet(void)
+{
+    static gboolean probed = FALSE;
+    static RrCpuFeatures features = 0;
+
+    if (!probed) {
+#ifdef RR_CPU_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2"))
+            features |= RR_CPU_SSE2;
+        /* this also checks that the OS saves the ymm registers */
+        if (__builtin_cpu_supports("avx2"))
+            features |= RR_CPU_AVX2;
+#endif
+        probed = TRUE;
+    }
+    return features;
+}
@@ -0,0 +1,45 @@
+/* -*- indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*-
+
+   cpu.h for the Openbox window manager
+   Copyright (c) 2026        Openbox developers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   See the COPYING file for a copy of the GNU General Public License.
+*/
+
+#ifndef __render_cpu_h
+#define __render_cpu_h
+
+#include <glib.h>
+
+/* The vector kernels are built with per-function target attributes, so the
+   library itself still only requires the baseline instruction set.  Which
+   kernels get used is decided at runtime from RrCpuFeaturesGet(). */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || \
+     (defined(__GNUC__) && \
+      (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define RR_CPU_X86 1
+#define RR_TARGET_SSE2 __attribute__((target("sse2")))
+#define RR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+typedef enum {
+    RR_CPU_SSE2 = 1 << 0,
+    RR_CPU_AVX2 = 1 << 1
+} RrCpuFeatures;
+
+/*! Returns the vector instruction sets usable by this process.  The CPU is
+  only probed the first time this is called. */
+RrCpuFeatures RrCpuFeaturesGet(void);
+
+#endif /* __render_cpu_h */
@@ -31,6 +31,87 @@
 #include <stdlib.h>
 #include <locale.h>
 
+/*! The number of measured strings that each font remembers */
+#define MEASURED_MAX 256
+
+/*! The size of a string measured with a font */
+typedef struct _RrFontMeasured {
+    gchar *str;
+    gboolean flow;
+    gint maxwidth; /*!< Only used when flow is TRUE, and 0 otherwise */
+    gint width, height; /*!< The size of the text's area in pixels */
+    GList link; /*!< The string's place in the cache's lru list */
+} RrFontMeasured;
+
+struct _RrFontMeasureCache {
+    /*! The RrFontMeasured structs, which are their own keys */
+    GHashTable *table;
+    /*! The RrFontMeasured structs, most recently used at the head */
+    GQueue lru;
+    gulong hits;
+    gulong misses;
+};
+
+static guint measured_hash(const RrFontMeasured *m)
+{
+    return g_str_hash(m->str) ^ (m->flow ? (guint)m->maxwidth + 1 : 0);
+}
+
+static gboolean measured_equal(const RrFontMeasured *m1,
+                               const RrFontMeasured *m2)
+{
+    return m1->flow == m2->flow && m1->maxwidth == m2->maxwidth &&
+        !strcmp(m1->str, m2->str);
+}
+
+static void measured_free(RrFontMeasured *m)
+{
+    g_free(m->str);
+    g_slice_free(RrFontMeasured, m);
+}
+
+/*! The number of drawn strings that each font keeps in alpha masks */
+#define MASKS_MAX 64
+
+/*! A line of text drawn with a font into an alpha mask */
+typedef struct _RrFontMask {
+    gchar *str;
+    /*! The width the text was ellipsized to fit in, or -1 if it fit
+      without being ellipsized */
+    gint width;
+    PangoEllipsizeMode ellipsize;
+    gint text_width; /*!< The width of the text once ellipsized */
+    /*! The area of the mask, relative to the start of the text's baseline */
+    RrRect area;
+    Picture picture; /*!< The mask, or None if the text has no ink */
+    GList link; /*!< The mask's place in the cache's lru list */
+} RrFontMask;
+
+struct _RrFontMaskCache {
+    /*! The RrFontMask structs, which are their own keys */
+    GHashTable *table;
+    /*! The RrFontMask structs, most recently used at the head */
+    GQueue lru;
+};
+
+static guint mask_hash(const RrFontMask *m)
+{
+    return g_str_hash(m->str) ^ ((guint)m->width << 2) ^ m->ellipsize;
+}
+
+static gboolean mask_equal(const RrFontMask *m1, const RrFontMask *m2)
+{
+    return m1->width == m2->width && m1->ellipsize == m2->ellipsize &&
+        !strcmp(m1->str, m2->str);
+}
+
+static void mask_free(const RrFont *f, RrFontMask *m)
+{
+    if (m->picture) XRenderFreePicture(RrDisplay(f->inst), m->picture);
+    g_free(m->str);
+    g_slice_free(RrFontMask, m);
+}
+
 static void measure_font(const RrInstance *inst, RrFont *f)
 {
     PangoFontMetrics *metrics;
@@ -60,6 +141,30 @@ static void measure_font(const RrInstance *inst, RrFont *f)
 
 }
 
+/*! Returns TRUE if text drawn with the font can be kept in alpha masks.  That
+  takes the render extension, and glyphs without subpixel antialiasing, which
+  needs all of the color channels. */
+static gboolean font_can_mask(const RrInstance *inst, RrFont *f)
+{
+    PangoFont *font;
+    XftFont *xft;
+    gint rgba;
+    gboolean can = FALSE;
+
+    if (!RrPictFormat(inst))
+        return FALSE;
+
+    if ((font = pango_context_load_font(inst->pango, f->font_desc))) {
+        xft = pango_xft_font_get_font(font);
+        can = xft != NULL &&
+            (FcPatternGetInteger(xft->pattern, FC_RGBA, 0, &rgba) !=
+             FcResultMatch ||
+             rgba == FC_RGBA_NONE || rgba == FC_RGBA_UNKNOWN);
+        g_object_unref(font);
+    }
+    return can;
+}
+
 RrFont *RrFontOpen(const RrInstance *inst, const gchar *name, gint size,
                    RrFontWeight weight, RrFontSlant slant)
 {
@@ -110,9 +215,28 @@ RrFont *RrFontOpen(const RrInstance *inst, const gchar *name, gint size,
     pango_layout_set_font_description(out->layout, out->font_desc);
     pango_layout_set_wrap(out->layout, PANGO_WRAP_WORD_CHAR);
 
+    /* nothing has been measured with this font yet.  when the font is
+       reloaded, a new RrFont gets a new cache too */
+    out->measured = g_slice_new(RrFontMeasureCache);
+    out->measured->table =
+        g_hash_table_new_full((GHashFunc)measured_hash,
+                              (GEqualFunc)measured_equal,
+                              NULL, (GDestroyNotify)measured_free);
+    g_queue_init(&out->measured->lru);
+    out->measured->hits = out->measured->misses = 0;
+
     /* get the ascent and descent */
     measure_font(inst, out);
 
+    if (font_can_mask(inst, out)) {
+        out->masks = g_slice_new(RrFontMaskCache);
+        out->masks->table = g_hash_table_new((GHashFunc)mask_hash,
+                                             (GEqualFunc)mask_equal);
+        g_queue_init(&out->masks->lru);
+    }
+    else
+        out->masks = NULL;
+
     return out;
 }
 
@@ -131,6 +255,16 @@ void RrFontClose(RrFont *f)
 {
     if (f) {
         if (--f->ref < 1) {
+            g_hash_table_destroy(f->measured->table);
+            g_slice_free(RrFontMeasureCache, f->measured);
+            if (f->masks) {
+                GList *it;
+
+                while ((it = g_queue_pop_head_link(&f->masks->lru)))
+                    mask_free(f, it->data);
+                g_hash_table_destroy(f->masks->table);
+                g_slice_free(RrFontMaskCache, f->masks);
+            }
             g_object_unref(f->layout);
             pango_font_description_free(f->font_desc);
             g_slice_free(RrFont, f);
@@ -138,9 +272,9 @@ void RrFontClose(RrFont *f)
     }
 }
 
-static void font_measure_full(const RrFont *f, const gchar *str,
-                              gint *x, gint *y, gint shadow_x, gint shadow_y,
-                              gboolean flow, gint maxwidth)
+/*! Measures the size of the text's area with pango */
+static void font_measure_text(const RrFont *f, const gchar *str,
+                              gint *w, gint *h, gboolean flow, gint maxwidth)
 {
     PangoRectangle rect;
 
@@ -169,8 +303,46 @@ static void font_measure_full(const RrFont *f, const gchar *str,
     rect.width = (rect.width + PANGO_SCALE - 1) / PANGO_SCALE;
     rect.height = (rect.height + PANGO_SCALE - 1) / PANGO_SCALE;
 #endif
-    *x = rect.width + ABS(shadow_x) + 4 /* we put a 2 px edge on each side */;
-    *y = rect.height + ABS(shadow_y);
+    *w = rect.width;
+    *h = rect.height;
+}
+
+static void font_measure_full(const RrFont *f, const gchar *str,
+                              gint *x, gint *y, gint shadow_x, gint shadow_y,
+                              gboolean flow, gint maxwidth)
+{
+    RrFontMeasureCache *c = f->measured;
+    RrFontMeasured key, *m;
+
+    /* the shadow is added afterward, so it isn't part of the key */
+    key.str = (gchar*)(str ? str : "");
+    key.flow = flow;
+    key.maxwidth = flow ? maxwidth : 0;
+
+    if ((m = g_hash_table_lookup(c->table, &key))) {
+        ++c->hits;
+        g_queue_unlink(&c->lru, &m->link);
+    }
+    else {
+        ++c->misses;
+        if (c->lru.length >= MEASURED_MAX)
+            /* forget the string that was used the longest time ago */
+            g_hash_table_remove(c->table,
+                                g_queue_pop_tail_link(&c->lru)->data);
+
+        m = g_slice_new(RrFontMeasured);
+        m->str = g_strdup(key.str);
+        m->flow = key.flow;
+        m->maxwidth = key.maxwidth;
+        font_measure_text(f, str, &m->width, &m->height, flow, maxwidth);
+        m->link.data = m;
+        m->link.prev = m->link.next = NULL;
+        g_hash_table_insert(c->table, m, m);
+    }
+    g_queue_push_head_link(&c->lru, &m->link);
+
+    *x = m->width + ABS(shadow_x) + 4 /* we put a 2 px edge on each side */;
+    *y = m->height + ABS(shadow_y);
 }
 
 RrSize *RrFontMeasureString(const RrFont *f, const gchar *str,
@@ -192,6 +364,12 @@ gint RrFontHeight(const RrFont *f, gint shadow_y)
     return (f->ascent + f->descent) / PANGO_SCALE + ABS(shadow_y);
 }
 
+void RrFontMeasureStats(const RrFont *f, gulong *hits, gulong *misses)
+{
+    if (hits) *hits = f->measured->hits;
+    if (misses) *misses = f->measured->misses;
+}
+
 static inline int font_calculate_baseline(RrFont *f, gint height)
 {
 /* For my own reference:
@@ -215,6 +393,187 @@ static inline int font_calculate_baseline(RrFont *f, gint height)
         / PANGO_SCALE; /* back to pixels */
 }
 
+/*! Returns where text that is mw pixels wide starts, when it is justified
+  in the w pixels that start at x.
+  pango_layout_set_alignment doesn't work with pango_xft_render_layout_line,
+  so the text is moved over by hand. */
+static gint font_justify(RrJustify justify, gint x, gint w, gint mw)
+{
+    switch (justify) {
+    case RR_JUSTIFY_LEFT:
+        break;
+    case RR_JUSTIFY_RIGHT:
+        x += (w - mw);
+        break;
+    case RR_JUSTIFY_CENTER:
+        x += (w - mw) / 2;
+        break;
+    case RR_JUSTIFY_NUM_TYPES:
+        g_assert_not_reached();
+    }
+    return x;
+}
+
+static void font_shadow_color(const RrTextureText *t, XftColor *c)
+{
+    /* From nvidia's readme (chapter 23):
+
+       When rendering to a 32-bit window, keep in mind that the X RENDER
+       extension, used by most composite managers, expects "premultiplied
+       alpha" colors. This means that if your color has components (r,g,b)
+       and alpha value a, then you must render (a*r, a*g, a*b, a) into the
+       target window.
+    */
+    c->color.red = (t->shadow_color->r | t->shadow_color->r << 8) *
+        t->shadow_alpha / 255;
+    c->color.green = (t->shadow_color->g | t->shadow_color->g << 8) *
+        t->shadow_alpha / 255;
+    c->color.blue = (t->shadow_color->b | t->shadow_color->b << 8) *
+        t->shadow_alpha / 255;
+    c->color.alpha = 0xffff * t->shadow_alpha / 255;
+    c->pixel = t->shadow_color->pixel;
+}
+
+static void font_text_color(const RrTextureText *t, XftColor *c)
+{
+    c->color.red = t->color->r | t->color->r << 8;
+    c->color.green = t->color->g | t->color->g << 8;
+    c->color.blue = t->color->b | t->color->b << 8;
+    c->color.alpha = 0xff | 0xff << 8; /* fully opaque text */
+    c->pixel = t->color->pixel;
+}
+
+static PangoLayoutLine* font_first_line(RrFont *f)
+{
+#if PANGO_VERSION_MAJOR > 1 || \
+    (PANGO_VERSION_MAJOR == 1 && PANGO_VERSION_MINOR >= 16)
+    return pango_layout_get_line_readonly(f->layout, 0);
+#else
+    return pango_layout_get_line(f->layout, 0);
+#endif
+}
+
+/*! Draws the mask's line of text into it, with full strength */
+static void font_mask_draw(RrFont *f, RrFontMask *m)
+{
+    Display *dpy = RrDisplay(f->inst);
+    PangoLayoutLine *line;
+    PangoRectangle ink, logical;
+    Pixmap pixmap;
+    XftDraw *draw;
+    XftColor c;
+
+    pango_layout_set_text(f->layout, m->str, -1);
+    pango_layout_set_width(f->layout,
+                           m->width < 0 ? -1 : m->width * PANGO_SCALE);
+    pango_layout_set_ellipsize(f->layout, m->ellipsize);
+    pango_layout_set_single_paragraph_mode(f->layout, TRUE);
+
+    pango_layout_get_pixel_extents(f->layout, NULL, &logical);
+    m->text_width = logical.width;
+
+    line = font_first_line(f);
+    pango_layout_line_get_pixel_extents(line, &ink, NULL);
+    if (ink.width <= 0 || ink.height <= 0) {
+        RECT_SET(m->area, 0, 0, 0, 0);
+        m->picture = None;
+        return;
+    }
+    /* leave a pixel around the ink in case the antialiasing strays out */
+    RECT_SET(m->area, ink.x - 1, ink.y - 1, ink.width + 2, ink.height + 2);
+
+    pixmap = XCreatePixmap(dpy, RrRootWindow(f->inst),
+                           m->area.width, m->area.height, 8);
+    m->picture = XRenderCreatePicture(
+        dpy, pixmap, XRenderFindStandardFormat(dpy, PictStandardA8),
+        0, NULL);
+
+    draw = XftDrawCreateAlpha(dpy, pixmap, 8);
+    c.color.red = c.color.green = c.color.blue = c.color.alpha = 0;
+    c.pixel = 0;
+    XftDrawRect(draw, &c, 0, 0, m->area.width, m->area.height);
+    c.color.red = c.color.green = c.color.blue = c.color.alpha = 0xffff;
+    pango_xft_render_layout_line(draw, &c, line,
+                                 -m->area.x * PANGO_SCALE,
+                                 -m->area.y * PANGO_SCALE);
+    XftDrawDestroy(draw);
+    /* the picture holds on to the pixmap */
+    XFreePixmap(dpy, pixmap);
+}
+
+/*! Returns the alpha mask for a line of text, ellipsized to fit in width
+  pixels, drawing it first if the font doesn't have it already */
+static RrFontMask* font_mask(RrFont *f, const gchar *str, gint width,
+                             PangoEllipsizeMode ell)
+{
+    RrFontMaskCache *c = f->masks;
+    RrFontMask key, *m;
+    gint tw, th;
+
+    /* text that is too long for the width has a mask ellipsized to fit it,
+       and such a mask is only made for text that doesn't fit, so finding
+       one answers whether the text fits too */
+    key.str = (gchar*)str;
+    key.width = width;
+    key.ellipsize = ell;
+    m = g_hash_table_lookup(c->table, &key);
+    if (!m) {
+        /* text that fits looks the same no matter how much room it has, so
+           it shares one mask for any width.  that mask knows how wide the
+           text is, so the text is only measured here when there isn't one.
+           this doesn't go through the font's measure cache, so drawing
+           doesn't count in its stats or push out the sizes measured for
+           layout */
+        key.width = -1;
+        key.ellipsize = PANGO_ELLIPSIZE_NONE;
+        m = g_hash_table_lookup(c->table, &key);
+        if (m)
+            tw = m->text_width;
+        else
+            font_measure_text(f, str, &tw, &th, FALSE, 0);
+        if (tw > width) {
+            /* the ellipsized mask was looked for already */
+            key.width = width;
+            key.ellipsize = ell;
+            m = NULL;
+        }
+    }
+
+    if (m)
+        g_queue_unlink(&c->lru, &m->link);
+    else {
+        if (c->lru.length >= MASKS_MAX) {
+            /* forget the mask that was used the longest time ago */
+            RrFontMask *old = g_queue_pop_tail_link(&c->lru)->data;
+
+            g_hash_table_remove(c->table, old);
+            mask_free(f, old);
+        }
+
+        m = g_slice_new(RrFontMask);
+        m->str = g_strdup(str);
+        m->width = key.width;
+        m->ellipsize = key.ellipsize;
+        font_mask_draw(f, m);
+        m->link.data = m;
+        m->link.prev = m->link.next = NULL;
+        g_hash_table_insert(c->table, m, m);
+    }
+    g_queue_push_head_link(&c->lru, &m->link);
+    return m;
+}
+
+/*! Paints the color through the mask, with the start of the text's baseline
+  at x, y */
+static void font_mask_paint(XftDraw *d, const XftColor *c,
+                            const RrFontMask *m, gint x, gint y)
+{
+    XRenderComposite(XftDrawDisplay(d), PictOpOver,
+                     XftDrawSrcPicture(d, c), m->picture, XftDrawPicture(d),
+                     0, 0, 0, 0, x + m->area.x, y + m->area.y,
+                     m->area.width, m->area.height);
+}
+
 void RrFontDraw(XftDraw *d, RrTextureText *t, RrRect *area)
 {
     gint x,y,w;
@@ -263,6 +622,25 @@ void RrFontDraw(XftDraw *d, RrTextureText *t, RrRect *area)
         }
     }
 
+    /* a single line of text without a shortcut, like a window's title, is
+       painted through a mask that is only drawn again when the text or its
+       room changes, and not when just its colors do */
+    if (!t->flow && !t->shortcut && t->font->masks) {
+        const RrFontMask *m = font_mask(t->font, t->string, w, ell);
+
+        x = font_justify(t->justify, x, w, m->text_width);
+        if (m->picture) {
+            if (t->shadow_offset_x || t->shadow_offset_y) {
+                font_shadow_color(t, &c);
+                font_mask_paint(d, &c, m, x + t->shadow_offset_x,
+                                y + t->shadow_offset_y);
+            }
+            font_text_color(t, &c);
+            font_mask_paint(d, &c, m, x, y);
+        }
+        return;
+    }
+
     pango_layout_set_text(t->font->layout, t->string, -1);
     pango_layout_set_width(t->font->layout, w * PANGO_SCALE);
     pango_layout_set_ellipsize(t->font->layout, ell);
@@ -273,49 +651,15 @@ void RrFontDraw(XftDraw *d, RrTextureText *t, RrRect *area)
     pango_layout_get_pixel_extents(t->font->layout, NULL, &rect);
     mw = rect.width;
 
-    /* pango_layout_set_alignment doesn't work with
-       pango_xft_render_layout_line */
-    switch (t->justify) {
-    case RR_JUSTIFY_LEFT:
-        break;
-    case RR_JUSTIFY_RIGHT:
-        x += (w - mw);
-        break;
-    case RR_JUSTIFY_CENTER:
-        x += (w - mw) / 2;
-        break;
-    case RR_JUSTIFY_NUM_TYPES:
-        g_assert_not_reached();
-    }
+    x = font_justify(t->justify, x, w, mw);
 
     if (t->shadow_offset_x || t->shadow_offset_y) {
-        /* From nvidia's readme (chapter 23):
-
-           When rendering to a 32-bit window, keep in mind that the X RENDER
-           extension, used by most composite managers, expects "premultiplied
-           alpha" colors. This means that if your color has components (r,g,b)
-           and alpha value a, then you must render (a*r, a*g, a*b, a) into the
-           target window.
-        */
-        c.color.red = (t->shadow_color->r | t->shadow_color->r << 8) *
-            t->shadow_alpha / 255;
-        c.color.green = (t->shadow_color->g | t->shadow_color->g << 8) *
-            t->shadow_alpha / 255;
-        c.color.blue = (t->shadow_color->b | t->shadow_color->b << 8) *
-            t->shadow_alpha / 255;
-        c.color.alpha = 0xffff * t->shadow_alpha / 255;
-        c.pixel = t->shadow_color->pixel;
+        font_shadow_color(t, &c);
 
         /* see below... */
         if (!t->flow) {
             pango_xft_render_layout_line
-                (d, &c,
-#if PANGO_VERSION_MAJOR > 1 || \
-    (PANGO_VERSION_MAJOR == 1 && PANGO_VERSION_MINOR >= 16)
-                 pango_layout_get_line_readonly(t->font->layout, 0),
-#else
-                 pango_layout_get_line(t->font->layout, 0),
-#endif
+                (d, &c, font_first_line(t->font),
                  (x + t->shadow_offset_x) * PANGO_SCALE,
                  (y + t->shadow_offset_y) * PANGO_SCALE);
         }
@@ -326,11 +670,7 @@ void RrFontDraw(XftDraw *d, RrTextureText *t, RrRect *area)
         }
     }
 
-    c.color.red = t->color->r | t->color->r << 8;
-    c.color.green = t->color->g | t->color->g << 8;
-    c.color.blue = t->color->b | t->color->b << 8;
-    c.color.alpha = 0xff | 0xff << 8; /* fully opaque text */
-    c.pixel = t->color->pixel;
+    font_text_color(t, &c);
 
     if (t->shortcut) {
         const gchar *s = t->string + t->shortcut_pos;
@@ -351,16 +691,9 @@ void RrFontDraw(XftDraw *d, RrTextureText *t, RrRect *area)
     /* layout_line() uses y to specify the baseline
        The line doesn't need to be freed, it's a part of the layout */
     if (!t->flow) {
-        pango_xft_render_layout_line
-            (d, &c,
-#if PANGO_VERSION_MAJOR > 1 || \
-    (PANGO_VERSION_MAJOR == 1 && PANGO_VERSION_MINOR >= 16)
-             pango_layout_get_line_readonly(t->font->layout, 0),
-#else
-             pango_layout_get_line(t->font->layout, 0),
-#endif
-             x * PANGO_SCALE,
-             y * PANGO_SCALE);
+        pango_xft_render_layout_line(d, &c, font_first_line(t->font),
+                                     x * PANGO_SCALE,
+                                     y * PANGO_SCALE);
     }
     else {
         pango_xft_render_layout(d, &c, t->font->layout,
@@ -23,6 +23,9 @@
 #include "geom.h"
 #include <pango/pango.h>
 
+typedef struct _RrFontMeasureCache RrFontMeasureCache;
+typedef struct _RrFontMaskCache RrFontMaskCache;
+
 struct _RrFont {
     const RrInstance *inst;
     gint ref;
@@ -31,6 +34,11 @@ struct _RrFont {
     PangoAttribute *shortcut_underline; /*< For underlining the shortcut key */
     gint ascent; /*!< The font's ascent in pango-units */
     gint descent; /*!< The font's descent in pango-units */
+    /*! The sizes of the strings measured most recently with the font */
+    RrFontMeasureCache *measured;
+    /*! Strings drawn recently with the font, kept as alpha masks.  This is
+      NULL when the font's text can't be drawn that way */
+    RrFontMaskCache *masks;
 };
 
 void RrFontDraw(XftDraw *d, RrTextureText *t, RrRect *position);
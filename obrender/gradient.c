@@ -21,8 +21,36 @@
 #include "render.h"
 #include "gradient.h"
 #include "color.h"
+#include "cpu.h"
+#include "instance.h"
 #include <glib.h>
 #include <string.h>
+#include <X11/extensions/Xrender.h>
+
+#ifdef RR_CPU_X86
+#include <immintrin.h>
+#endif
+
+/*! The per-pixel loops of the gradients, picked by RrGradientInit() to match
+  what the cpu can do.  Every variant produces exactly the same pixels. */
+typedef struct _RrGradientKernels {
+    /*! Set n pixels starting at p to the color c */
+    void (*fill)(RrPixel32 *p, RrPixel32 c, gint n);
+    /*! Draw nrows horizontal gradients, each len pixels long, going from
+      left[i] to right[i].  Row i starts at data + i * stride, and its
+      color stepping starts with the error terms errors[i * 3 + 0..2]. */
+    void (*ramps)(RrPixel32 *data, gint stride,
+                  const RrColor *left, const RrColor *right,
+                  const gint *errors, gint nrows, gint len);
+    /*! Copy n pixels from src into dest in reverse order */
+    void (*reverse)(RrPixel32 *dest, const RrPixel32 *src, gint n);
+} RrGradientKernels;
+
+/* The number of rows set up at once for the diagonal gradients */
+#define RAMP_BATCH 64
+
+static const RrGradientKernels kernels_scalar;
+static const RrGradientKernels *kern = &kernels_scalar;
 
 static void highlight(RrSurface *s, RrPixel32 *x, RrPixel32 *y,
                       gboolean raised);
@@ -87,9 +115,8 @@ void RrRender(RrAppearance *a, gint w, gint h)
             + (g << RrDefaultGreenOffset)
             + (b << RrDefaultBlueOffset);
         p = data;
-        for (i = 0; i < h; i += 2, p += w)
-            for (x = 0; x < w; ++x, ++p)
-                *p = current;
+        for (i = 0; i < h; i += 2, p += w + w)
+            kern->fill(p, current, w);
     }
 
     if (a->surface.relief == RR_RELIEF_FLAT && a->surface.border) {
@@ -197,74 +224,6 @@ static void create_bevel_colors(RrAppearance *l)
     l->surface.bevel_dark = RrColorNew(l->inst, r, g, b);
 }
 
-/*! Repeat the first pixel over the entire block of memory
-  @param start The block of memory. start[0] will be copied
-         to the rest of the block.
-  @param w The width of the block of memory (including the already-set first
-           element
-*/
-static inline void repeat_pixel(RrPixel32 *start, gint w)
-{
-    register gint x;
-    RrPixel32 *dest;
-
-    dest = start + 1;
-
-    /* for really small things, just copy ourselves */
-    if (w < 8) {
-        for (x = w-1; x > 0; --x)
-            *(dest++) = *start;
-    }
-
-    /* for >= 8, then use O(log n) memcpy's... */
-    else {
-        gchar *cdest;
-        gint lenbytes;
-
-        /* copy the first 3 * 32 bits (3 words) ourselves - then we have
-           3 + the original 1 = 4 words to make copies of at a time
-
-           this is faster than doing memcpy for 1 or 2 words at a time
-        */
-        for (x = 3; x > 0; --x)
-            *(dest++) = *start;
-
-        /* cdest is a pointer to the pixel data that is typed char* so that
-           adding 1 to its position moves it only one byte
-
-           lenbytes is the amount of bytes that we will be copying each
-           iteration.  this doubles each time through the loop.
-
-           x is the number of bytes left to copy into.  lenbytes will alwaysa
-           be bounded by x
-
-           this loop will run O(log n) times (n is the number of bytes we
-           need to copy into), since the size of the copy is doubled each
-           iteration.  it seems that gcc does some nice optimizations to make
-           this memcpy very fast on hardware with support for vector operations
-           such as mmx or see.  here is an idea of the kind of speed up we are
-           getting by doing this (splitvertical3 switches from doing
-           "*(data++) = color" n times to doing this memcpy thing log n times:
-
-           %   cumulative   self              self     total           
-           time   seconds   seconds    calls  ms/call  ms/call  name    
-           49.44      0.88     0.88     1063     0.83     0.83  splitvertical1
-           47.19      1.72     0.84     1063     0.79     0.79  splitvertical2
-            2.81      1.77     0.05     1063     0.05     0.05  splitvertical3
-        */
-        cdest = (gchar*)dest;
-        lenbytes = 4 * sizeof(RrPixel32);
-        for (x = (w - 4) * sizeof(RrPixel32); x > 0;) {
-            memcpy(cdest, start, lenbytes);
-            x -= lenbytes;
-            cdest += lenbytes;
-            lenbytes <<= 1;
-            if (lenbytes > x)
-                lenbytes = x;
-        }
-    }
-}
-
 static void gradient_parentrelative(RrAppearance *a, gint w, gint h)
 {
     RrPixel32 *source, *dest;
@@ -319,7 +278,6 @@ static void gradient_parentrelative(RrAppearance *a, gint w, gint h)
 
 static void gradient_solid(RrAppearance *l, gint w, gint h)
 {
-    register gint i;
     RrPixel32 pix;
     RrPixel32 *data = l->surface.pixel_data;
     RrSurface *sp = &l->surface;
@@ -329,8 +287,7 @@ static void gradient_solid(RrAppearance *l, gint w, gint h)
         + (sp->primary->g << RrDefaultGreenOffset)
         + (sp->primary->b << RrDefaultBlueOffset);
 
-    for (i = 0; i < w * h; i++)
-        *data++ = pix;
+    kern->fill(data, pix, w * h);
 
     if (sp->interlaced)
         return;
@@ -413,6 +370,128 @@ static void gradient_solid(RrAppearance *l, gint w, gint h)
     }
 }
 
+/* Server side fills are only used while each rectangle covers at least this
+   many pixels on average, as otherwise putting the pixels is less to send */
+#define FILL_MIN_PIXELS 16
+
+/*! Fills a rectangle for each run of same colored pixels in a line of len
+  pixels, which starts at p with pixels step apart.  The line is at x, y in
+  the pixmap, going right if across is TRUE and down otherwise, and each
+  rectangle is thick pixels wide the other way.  If pict is None, nothing is
+  drawn.
+  @return The number of rectangles */
+static gint fill_line(const RrInstance *inst, Picture pict,
+                      const RrPixel32 *p, gint step, gint len,
+                      gint x, gint y, gboolean across, gint thick)
+{
+    gint i, start, runs = 0;
+
+    for (start = 0, i = 1; i <= len; ++i) {
+        if (i < len && p[i * step] == p[start * step])
+            continue;
+
+        if (pict != None) {
+            RrPixel32 pix = p[start * step];
+            XRenderColor c;
+
+            c.red = ((pix >> RrDefaultRedOffset) & 0xFF) * 0x101;
+            c.green = ((pix >> RrDefaultGreenOffset) & 0xFF) * 0x101;
+            c.blue = ((pix >> RrDefaultBlueOffset) & 0xFF) * 0x101;
+            c.alpha = 0xFFFF;
+            if (across)
+                XRenderFillRectangle(RrDisplay(inst), PictOpSrc, pict, &c,
+                                     x + start, y, i - start, thick);
+            else
+                XRenderFillRectangle(RrDisplay(inst), PictOpSrc, pict, &c,
+                                     x, y + start, thick, i - start);
+        }
+        ++runs;
+        start = i;
+    }
+    return runs;
+}
+
+/*! Fills the pixmap from pixel data where every row is a single color if rows
+  is TRUE, or where every column is otherwise, except within edge pixels of
+  the sides, where the bevel or border is.
+  @return The number of rectangles */
+static gint fill_lines(RrAppearance *a, Picture pict, gint w, gint h,
+                       gint edge, gboolean rows)
+{
+    const RrPixel32 *data = a->surface.pixel_data;
+    gint i, runs;
+
+    if (rows) {
+        /* all the columns between the edges are the same, so one of them is
+           drawn as wide as all of them */
+        runs = fill_line(a->inst, pict, data + edge, w, h,
+                         edge, 0, FALSE, w - edge * 2);
+        for (i = 0; i < edge; ++i) {
+            runs += fill_line(a->inst, pict, data + i, w, h,
+                              i, 0, FALSE, 1);
+            runs += fill_line(a->inst, pict, data + w - 1 - i, w, h,
+                              w - 1 - i, 0, FALSE, 1);
+        }
+    } else {
+        runs = fill_line(a->inst, pict, data + edge * w, 1, w,
+                         0, edge, TRUE, h - edge * 2);
+        for (i = 0; i < edge; ++i) {
+            runs += fill_line(a->inst, pict, data + i * w, 1, w,
+                              0, i, TRUE, 1);
+            runs += fill_line(a->inst, pict, data + (h - 1 - i) * w, 1, w,
+                              0, h - 1 - i, TRUE, 1);
+        }
+    }
+    return runs;
+}
+
+gboolean RrGradientFillPixmap(RrAppearance *a, gint w, gint h)
+{
+    RrSurface *sp = &a->surface;
+    XRenderPictFormat *format;
+    Picture pict;
+    gboolean rows;
+    gint i, edge;
+
+    if (!(format = RrPictFormat(a->inst)) || sp->interlaced)
+        return FALSE;
+
+    switch (sp->grad) {
+    case RR_SURFACE_SPLIT_VERTICAL:
+    case RR_SURFACE_VERTICAL:
+        rows = TRUE;
+        break;
+    case RR_SURFACE_HORIZONTAL:
+    case RR_SURFACE_MIRROR_HORIZONTAL:
+        rows = FALSE;
+        break;
+    default:
+        return FALSE;
+    }
+
+    /* these get drawn into the pixel data later, on top of the gradient */
+    for (i = 0; i < a->textures; ++i)
+        if (a->texture[i].type == RR_TEXTURE_RGBA ||
+            a->texture[i].type == RR_TEXTURE_IMAGE)
+            return FALSE;
+
+    if (sp->relief != RR_RELIEF_FLAT)
+        edge = sp->bevel == RR_BEVEL_1 ? 1 : 2;
+    else
+        edge = sp->border ? 1 : 0;
+    if (w <= edge * 2 || h <= edge * 2)
+        return FALSE;
+
+    if (fill_lines(a, None, w, h, edge, rows) * FILL_MIN_PIXELS > w * h)
+        return FALSE;
+
+    pict = XRenderCreatePicture(RrDisplay(a->inst), a->pixmap, format,
+                                0, NULL);
+    fill_lines(a, pict, w, h, edge, rows);
+    XRenderFreePicture(RrDisplay(a->inst), pict);
+    return TRUE;
+}
+
 /* * * * * * * * * * * * * * GRADIENT MAGIC WOOT * * * * * * * * * * * * * * */
 
 #define VARS(x)                                                \
@@ -491,6 +570,502 @@ static void gradient_solid(RrAppearance *l, gint w, gint h)
     }                                                     \
 }
 
+/* * * * * * * * * * * * * * * * KERNELS * * * * * * * * * * * * * * * * * */
+
+static void fill_scalar(RrPixel32 *start, RrPixel32 c, gint w)
+{
+    register gint x;
+    RrPixel32 *dest;
+
+    if (w <= 0) return;
+
+    *start = c;
+    dest = start + 1;
+
+    /* for really small things, just copy ourselves */
+    if (w < 8) {
+        for (x = w-1; x > 0; --x)
+            *(dest++) = *start;
+    }
+
+    /* for >= 8, then use O(log n) memcpy's... */
+    else {
+        gchar *cdest;
+        gint lenbytes;
+
+        /* copy the first 3 * 32 bits (3 words) ourselves - then we have
+           3 + the original 1 = 4 words to make copies of at a time
+
+           this is faster than doing memcpy for 1 or 2 words at a time
+        */
+        for (x = 3; x > 0; --x)
+            *(dest++) = *start;
+
+        /* cdest is a pointer to the pixel data that is typed char* so that
+           adding 1 to its position moves it only one byte
+
+           lenbytes is the amount of bytes that we will be copying each
+           iteration.  this doubles each time through the loop.
+
+           x is the number of bytes left to copy into.  lenbytes will alwaysa
+           be bounded by x
+
+           this loop will run O(log n) times (n is the number of bytes we
+           need to copy into), since the size of the copy is doubled each
+           iteration.  it seems that gcc does some nice optimizations to make
+           this memcpy very fast on hardware with support for vector operations
+           such as mmx or see.  here is an idea of the kind of speed up we are
+           getting by doing this (splitvertical3 switches from doing
+           "*(data++) = color" n times to doing this memcpy thing log n times:
+
+           %   cumulative   self              self     total           
+           time   seconds   seconds    calls  ms/call  ms/call  name    
+           49.44      0.88     0.88     1063     0.83     0.83  splitvertical1
+           47.19      1.72     0.84     1063     0.79     0.79  splitvertical2
+            2.81      1.77     0.05     1063     0.05     0.05  splitvertical3
+        */
+        cdest = (gchar*)dest;
+        lenbytes = 4 * sizeof(RrPixel32);
+        for (x = (w - 4) * sizeof(RrPixel32); x > 0;) {
+            memcpy(cdest, start, lenbytes);
+            x -= lenbytes;
+            cdest += lenbytes;
+            lenbytes <<= 1;
+            if (lenbytes > x)
+                lenbytes = x;
+        }
+    }
+}
+
+
+/* Channel i of a color, in the same order as the VARS() arrays */
+#define CHANNEL(c, i) ((i) == 0 ? (c)->r : ((i) == 1 ? (c)->g : (c)->b))
+
+static inline gint floor_div(gint64 n, gint64 d)
+{
+    return (gint)(n >= 0 ? n / d : -((-n + d - 1) / d));
+}
+
+/*! Returns the error term that NEXT() leaves behind after being called steps
+  times, starting from error, without stepping through it.  It counts the
+  color increments made along the way, and the error is what remains. */
+static gint ramp_carry(gint error, gint cdelta, gint len, gint steps)
+{
+    gint64 n;
+
+    if (!cdelta || steps <= 0)
+        return error;
+
+    if (cdelta <= len) {
+        /* at most one increment per step, and none until the error first
+           reaches len/2 */
+        n = floor_div(2 * (error + (gint64)steps * cdelta) + len, 2 * len);
+        n = CLAMP(n, 0, steps);
+        return (gint)(error + (gint64)steps * cdelta - n * len);
+    } else {
+        /* at least one increment per step */
+        n = -floor_div(2 * (error - (gint64)steps * cdelta) + cdelta,
+                       2 * len);
+        n = MAX(n, steps);
+        return (gint)(error + n * len - (gint64)steps * cdelta);
+    }
+}
+
+/*! SETUP() doesn't reset the error terms that VARS() declares, so each row of
+  a diagonal gradient starts out with the error that the row above it ended
+  with.  This fills in errors for n rows (3 per row) and leaves carry with
+  the error for the row after them. */
+static void ramp_errors(const RrColor *left, const RrColor *right,
+                        gint n, gint len, gint carry[3], gint *errors)
+{
+    register gint y, i;
+
+    for (y = 0; y < n; ++y)
+        for (i = 0; i < 3; ++i) {
+            *(errors++) = carry[i];
+            carry[i] = ramp_carry(carry[i],
+                                  ABS(CHANNEL(&right[y], i) -
+                                      CHANNEL(&left[y], i)),
+                                  len, len - 1);
+        }
+}
+
+static void ramps_scalar(RrPixel32 *data, gint stride,
+                         const RrColor *left, const RrColor *right,
+                         const gint *errors, gint nrows, gint len)
+{
+    register gint x, y;
+    RrPixel32 *p;
+
+    VARS(x);
+
+    for (y = 0; y < nrows; ++y, data += stride, errors += 3) {
+        SETUP(x, (&left[y]), (&right[y]), len);
+        errorx[0] = errors[0];
+        errorx[1] = errors[1];
+        errorx[2] = errors[2];
+
+        p = data;
+        for (x = len - 1; x > 0; --x) {  /* 0 -> len-1 */
+            *(p++) = COLOR(x);
+
+            NEXT(x);
+        }
+        *p = COLOR(x);
+    }
+}
+
+static void reverse_scalar(RrPixel32 *dest, const RrPixel32 *src, gint n)
+{
+    register gint x;
+
+    src += n - 1;
+    for (x = n; x > 0; --x)
+        *(dest++) = *(src--);
+}
+
+static const RrGradientKernels kernels_scalar = {
+    fill_scalar,
+    ramps_scalar,
+    reverse_scalar
+};
+
+#ifdef RR_CPU_X86
+
+/* The color stepping in NEXT() can't be vectorized along a row, since every
+   step depends on the error left over from the one before it.  But all the
+   rows of a diagonal gradient are the same length, so the ramps kernels step
+   several rows at once, with one row in each lane, and transpose the results
+   into place four pixels at a time. */
+
+/* Fill in the per-lane SETUP() state for channel i of lanes rows, in
+   plain arrays that the kernels load into vector registers */
+#define LANE_SETUP(lanes, i, len)                                      \
+    for (k = 0; k < lanes; ++k) {                                      \
+        gint from = CHANNEL(&left[k], i);                              \
+        gint delta = CHANNEL(&right[k], i) - from;                     \
+                                                                       \
+        color[i][k] = from;                                            \
+        error[i][k] = errors[k * 3 + i];                               \
+        inc[i][k] = delta < 0 ? -1 : 1;                                \
+        cdelta[i][k] = delta < 0 ? -delta : delta;                     \
+        /* lanes with no slope are in neither mask, so never change */ \
+        small[i][k] = cdelta[i][k] && cdelta[i][k] <= len ? -1 : 0;    \
+        big[i][k] = cdelta[i][k] > len ? -1 : 0;                       \
+    }
+
+RR_TARGET_SSE2
+static void fill_sse2(RrPixel32 *p, RrPixel32 c, gint n)
+{
+    const __m128i v = _mm_set1_epi32((gint)c);
+
+    for (; n >= 16; n -= 16, p += 16) {
+        _mm_storeu_si128((__m128i*)p, v);
+        _mm_storeu_si128((__m128i*)(p + 4), v);
+        _mm_storeu_si128((__m128i*)(p + 8), v);
+        _mm_storeu_si128((__m128i*)(p + 12), v);
+    }
+    for (; n >= 4; n -= 4, p += 4)
+        _mm_storeu_si128((__m128i*)p, v);
+    for (; n > 0; --n)
+        *(p++) = c;
+}
+
+RR_TARGET_SSE2
+static void reverse_sse2(RrPixel32 *dest, const RrPixel32 *src, gint n)
+{
+    __m128i v;
+
+    src += n;
+    for (; n >= 4; n -= 4, dest += 4) {
+        src -= 4;
+        v = _mm_loadu_si128((const __m128i*)src);
+        v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+        _mm_storeu_si128((__m128i*)dest, v);
+    }
+    for (; n > 0; --n)
+        *(dest++) = *(--src);
+}
+
+/*! The vector version of NEXT(), for one channel of four rows */
+RR_TARGET_SSE2
+static inline void ramp_next_sse2(__m128i *color, __m128i *error,
+                                  __m128i cdelta, __m128i inc,
+                                  __m128i small, __m128i big, __m128i len)
+{
+    __m128i hit, active;
+
+    /* Y (color) is dependant on X */
+    *error = _mm_add_epi32(*error, _mm_and_si128(cdelta, small));
+    hit = _mm_andnot_si128(_mm_cmpgt_epi32(len, _mm_slli_epi32(*error, 1)),
+                           small);
+    *color = _mm_add_epi32(*color, _mm_and_si128(inc, hit));
+    *error = _mm_sub_epi32(*error, _mm_and_si128(len, hit));
+
+    /* X is dependant on Y (color) */
+    active = big;
+    while (_mm_movemask_epi8(active)) {
+        *color = _mm_add_epi32(*color, _mm_and_si128(inc, active));
+        *error = _mm_add_epi32(*error, _mm_and_si128(len, active));
+        hit = _mm_andnot_si128(_mm_cmpgt_epi32(cdelta,
+                                               _mm_slli_epi32(*error, 1)),
+                               active);
+        *error = _mm_sub_epi32(*error, _mm_and_si128(cdelta, hit));
+        active = _mm_andnot_si128(hit, active);
+    }
+}
+
+/*! Transpose four pixels from each of four rows into place */
+RR_TARGET_SSE2
+static inline void ramp_store_sse2(RrPixel32 *data, gint stride,
+                                   __m128i p0, __m128i p1,
+                                   __m128i p2, __m128i p3)
+{
+    __m128i t0, t1, t2, t3;
+
+    t0 = _mm_unpacklo_epi32(p0, p1);
+    t1 = _mm_unpacklo_epi32(p2, p3);
+    t2 = _mm_unpackhi_epi32(p0, p1);
+    t3 = _mm_unpackhi_epi32(p2, p3);
+    _mm_storeu_si128((__m128i*)data, _mm_unpacklo_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*)(data + stride), _mm_unpackhi_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*)(data + stride * 2),
+                     _mm_unpacklo_epi64(t2, t3));
+    _mm_storeu_si128((__m128i*)(data + stride * 3),
+                     _mm_unpackhi_epi64(t2, t3));
+}
+
+#define RAMP_PIXEL_SSE2(c)                                           \
+    _mm_or_si128(_mm_or_si128(_mm_slli_epi32(c[0], RrDefaultRedOffset), \
+                              _mm_slli_epi32(c[1], RrDefaultGreenOffset)), \
+                 _mm_slli_epi32(c[2], RrDefaultBlueOffset))
+
+#define RAMP_NEXT_SSE2()                                       \
+    for (i = 0; i < 3; ++i)                                    \
+        ramp_next_sse2(&c[i], &e[i], d[i], n[i], s[i], b[i], lv)
+
+RR_TARGET_SSE2
+static void ramps_sse2(RrPixel32 *data, gint stride,
+                       const RrColor *left, const RrColor *right,
+                       const gint *errors, gint nrows, gint len)
+{
+    gint32 color[3][4], error[3][4], cdelta[3][4], inc[3][4];
+    gint32 small[3][4], big[3][4];
+    RrPixel32 tail[4];
+    __m128i c[3], e[3], d[3], n[3], s[3], b[3], lv, p0, p1, p2, p3;
+    gint i, k, x;
+
+    lv = _mm_set1_epi32(len);
+    for (; nrows >= 4;
+         nrows -= 4, left += 4, right += 4, errors += 12, data += stride * 4)
+    {
+        for (i = 0; i < 3; ++i) {
+            LANE_SETUP(4, i, len);
+            c[i] = _mm_loadu_si128((const __m128i*)color[i]);
+            e[i] = _mm_loadu_si128((const __m128i*)error[i]);
+            d[i] = _mm_loadu_si128((const __m128i*)cdelta[i]);
+            n[i] = _mm_loadu_si128((const __m128i*)inc[i]);
+            s[i] = _mm_loadu_si128((const __m128i*)small[i]);
+            b[i] = _mm_loadu_si128((const __m128i*)big[i]);
+        }
+
+        for (x = 0; x + 4 <= len; x += 4) {
+            p0 = RAMP_PIXEL_SSE2(c);
+            RAMP_NEXT_SSE2();
+            p1 = RAMP_PIXEL_SSE2(c);
+            RAMP_NEXT_SSE2();
+            p2 = RAMP_PIXEL_SSE2(c);
+            RAMP_NEXT_SSE2();
+            p3 = RAMP_PIXEL_SSE2(c);
+            RAMP_NEXT_SSE2();
+            ramp_store_sse2(data + x, stride, p0, p1, p2, p3);
+        }
+        for (; x < len; ++x) {
+            _mm_storeu_si128((__m128i*)tail, RAMP_PIXEL_SSE2(c));
+            for (k = 0; k < 4; ++k)
+                data[k * stride + x] = tail[k];
+            RAMP_NEXT_SSE2();
+        }
+    }
+
+    if (nrows)
+        ramps_scalar(data, stride, left, right, errors, nrows, len);
+}
+
+RR_TARGET_AVX2
+static void fill_avx2(RrPixel32 *p, RrPixel32 c, gint n)
+{
+    const __m256i v = _mm256_set1_epi32((gint)c);
+
+    for (; n >= 32; n -= 32, p += 32) {
+        _mm256_storeu_si256((__m256i*)p, v);
+        _mm256_storeu_si256((__m256i*)(p + 8), v);
+        _mm256_storeu_si256((__m256i*)(p + 16), v);
+        _mm256_storeu_si256((__m256i*)(p + 24), v);
+    }
+    for (; n >= 8; n -= 8, p += 8)
+        _mm256_storeu_si256((__m256i*)p, v);
+    for (; n > 0; --n)
+        *(p++) = c;
+}
+
+RR_TARGET_AVX2
+static void reverse_avx2(RrPixel32 *dest, const RrPixel32 *src, gint n)
+{
+    const __m256i rev = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    __m256i v;
+
+    src += n;
+    for (; n >= 8; n -= 8, dest += 8) {
+        src -= 8;
+        v = _mm256_loadu_si256((const __m256i*)src);
+        _mm256_storeu_si256((__m256i*)dest,
+                            _mm256_permutevar8x32_epi32(v, rev));
+    }
+    for (; n > 0; --n)
+        *(dest++) = *(--src);
+}
+
+/*! The vector version of NEXT(), for one channel of eight rows */
+RR_TARGET_AVX2
+static inline void ramp_next_avx2(__m256i *color, __m256i *error,
+                                  __m256i cdelta, __m256i inc,
+                                  __m256i small, __m256i big, __m256i len)
+{
+    __m256i hit, active;
+
+    /* Y (color) is dependant on X */
+    *error = _mm256_add_epi32(*error, _mm256_and_si256(cdelta, small));
+    hit = _mm256_andnot_si256(_mm256_cmpgt_epi32(len,
+                                                 _mm256_slli_epi32(*error, 1)),
+                              small);
+    *color = _mm256_add_epi32(*color, _mm256_and_si256(inc, hit));
+    *error = _mm256_sub_epi32(*error, _mm256_and_si256(len, hit));
+
+    /* X is dependant on Y (color) */
+    active = big;
+    while (_mm256_movemask_epi8(active)) {
+        *color = _mm256_add_epi32(*color, _mm256_and_si256(inc, active));
+        *error = _mm256_add_epi32(*error, _mm256_and_si256(len, active));
+        hit = _mm256_andnot_si256(
+            _mm256_cmpgt_epi32(cdelta, _mm256_slli_epi32(*error, 1)),
+            active);
+        *error = _mm256_sub_epi32(*error, _mm256_and_si256(cdelta, hit));
+        active = _mm256_andnot_si256(hit, active);
+    }
+}
+
+/*! Transpose four pixels from each of eight rows into place */
+RR_TARGET_AVX2
+static inline void ramp_store_avx2(RrPixel32 *data, gint stride,
+                                   __m256i p0, __m256i p1,
+                                   __m256i p2, __m256i p3)
+{
+    __m128i t0, t1, t2, t3;
+    gint half;
+
+    for (half = 0; half < 2; ++half, data += stride * 4) {
+        if (half == 0) {
+            t0 = _mm256_castsi256_si128(p0);
+            t1 = _mm256_castsi256_si128(p1);
+            t2 = _mm256_castsi256_si128(p2);
+            t3 = _mm256_castsi256_si128(p3);
+        } else {
+            t0 = _mm256_extracti128_si256(p0, 1);
+            t1 = _mm256_extracti128_si256(p1, 1);
+            t2 = _mm256_extracti128_si256(p2, 1);
+            t3 = _mm256_extracti128_si256(p3, 1);
+        }
+        ramp_store_sse2(data, stride, t0, t1, t2, t3);
+    }
+}
+
+#define RAMP_PIXEL_AVX2(c)                                              \
+    _mm256_or_si256(                                                    \
+        _mm256_or_si256(_mm256_slli_epi32(c[0], RrDefaultRedOffset),    \
+                        _mm256_slli_epi32(c[1], RrDefaultGreenOffset)), \
+        _mm256_slli_epi32(c[2], RrDefaultBlueOffset))
+
+#define RAMP_NEXT_AVX2()                                       \
+    for (i = 0; i < 3; ++i)                                    \
+        ramp_next_avx2(&c[i], &e[i], d[i], n[i], s[i], b[i], lv)
+
+RR_TARGET_AVX2
+static void ramps_avx2(RrPixel32 *data, gint stride,
+                       const RrColor *left, const RrColor *right,
+                       const gint *errors, gint nrows, gint len)
+{
+    gint32 color[3][8], error[3][8], cdelta[3][8], inc[3][8];
+    gint32 small[3][8], big[3][8];
+    RrPixel32 tail[8];
+    __m256i c[3], e[3], d[3], n[3], s[3], b[3], lv, p0, p1, p2, p3;
+    gint i, k, x;
+
+    lv = _mm256_set1_epi32(len);
+    for (; nrows >= 8;
+         nrows -= 8, left += 8, right += 8, errors += 24, data += stride * 8)
+    {
+        for (i = 0; i < 3; ++i) {
+            LANE_SETUP(8, i, len);
+            c[i] = _mm256_loadu_si256((const __m256i*)color[i]);
+            e[i] = _mm256_loadu_si256((const __m256i*)error[i]);
+            d[i] = _mm256_loadu_si256((const __m256i*)cdelta[i]);
+            n[i] = _mm256_loadu_si256((const __m256i*)inc[i]);
+            s[i] = _mm256_loadu_si256((const __m256i*)small[i]);
+            b[i] = _mm256_loadu_si256((const __m256i*)big[i]);
+        }
+
+        for (x = 0; x + 4 <= len; x += 4) {
+            p0 = RAMP_PIXEL_AVX2(c);
+            RAMP_NEXT_AVX2();
+            p1 = RAMP_PIXEL_AVX2(c);
+            RAMP_NEXT_AVX2();
+            p2 = RAMP_PIXEL_AVX2(c);
+            RAMP_NEXT_AVX2();
+            p3 = RAMP_PIXEL_AVX2(c);
+            RAMP_NEXT_AVX2();
+            ramp_store_avx2(data + x, stride, p0, p1, p2, p3);
+        }
+        for (; x < len; ++x) {
+            _mm256_storeu_si256((__m256i*)tail, RAMP_PIXEL_AVX2(c));
+            for (k = 0; k < 8; ++k)
+                data[k * stride + x] = tail[k];
+            RAMP_NEXT_AVX2();
+        }
+    }
+
+    if (nrows)
+        ramps_sse2(data, stride, left, right, errors, nrows, len);
+}
+
+static const RrGradientKernels kernels_sse2 = {
+    fill_sse2,
+    ramps_sse2,
+    reverse_sse2
+};
+
+static const RrGradientKernels kernels_avx2 = {
+    fill_avx2,
+    ramps_avx2,
+    reverse_avx2
+};
+
+#endif /* RR_CPU_X86 */
+
+void RrGradientInit(void)
+{
+#ifdef RR_CPU_X86
+    RrCpuFeatures cpu = RrCpuFeaturesGet();
+
+    if (cpu & RR_CPU_AVX2)
+        kern = &kernels_avx2;
+    else if (cpu & RR_CPU_SSE2)
+        kern = &kernels_sse2;
+    else
+#endif
+        kern = &kernels_scalar;
+}
+
 static void gradient_splitvertical(RrAppearance *a, gint w, gint h)
 {
     register gint y1, y2, y3;
@@ -555,7 +1130,7 @@ static void gradient_splitvertical(RrAppearance *a, gint w, gint h)
     /* copy the first pixels into the whole rows */
     data = sf->pixel_data;
     for (y1 = h; y1 > 0; --y1) {
-        repeat_pixel(data, w);
+        kern->fill(data, *data, w);
         data += w;
     }
 }
@@ -660,21 +1235,21 @@ static void gradient_vertical(RrSurface *sf, gint w, gint h)
     /* copy the first pixels into the whole rows */
     data = sf->pixel_data;
     for (y = h; y > 0; --y) {
-        repeat_pixel(data, w);
+        kern->fill(data, *data, w);
         data += w;
     }
 }
 
 static void gradient_diagonal(RrSurface *sf, gint w, gint h)
 {
-    register gint x, y;
+    register gint y, i, n;
     RrPixel32 *data = sf->pixel_data;
-    RrColor left, right;
+    RrColor left[RAMP_BATCH], right[RAMP_BATCH];
+    gint errors[RAMP_BATCH * 3], carry[3] = { 0, 0, 0 };
     RrColor extracorner;
 
     VARS(lefty);
     VARS(righty);
-    VARS(x);
 
     extracorner.r = (sf->primary->r + sf->secondary->r) / 2;
     extracorner.g = (sf->primary->g + sf->secondary->g) / 2;
@@ -683,45 +1258,33 @@ static void gradient_diagonal(RrSurface *sf, gint w, gint h)
     SETUP(lefty, sf->primary, (&extracorner), h);
     SETUP(righty, (&extracorner), sf->secondary, h);
 
-    for (y = h - 1; y > 0; --y) {  /* 0 -> h-1 */
-        COLOR_RR(lefty, (&left));
-        COLOR_RR(righty, (&right));
-
-        SETUP(x, (&left), (&right), w);
+    for (y = h; y > 0; y -= n) {  /* 0 -> h-1 */
+        n = MIN(y, RAMP_BATCH);
 
-        for (x = w - 1; x > 0; --x) {  /* 0 -> w-1 */
-            *(data++) = COLOR(x);
+        /* find the ends of each row first, then draw the rows together */
+        for (i = 0; i < n; ++i) {
+            COLOR_RR(lefty, (&left[i]));
+            COLOR_RR(righty, (&right[i]));
 
-            NEXT(x);
+            NEXT(lefty);
+            NEXT(righty);
         }
-        *(data++) = COLOR(x);
-
-        NEXT(lefty);
-        NEXT(righty);
-    }
-    COLOR_RR(lefty, (&left));
-    COLOR_RR(righty, (&right));
-
-    SETUP(x, (&left), (&right), w);
-
-    for (x = w - 1; x > 0; --x) {  /* 0 -> w-1 */
-        *(data++) = COLOR(x);
-
-        NEXT(x);
+        ramp_errors(left, right, n, w, carry, errors);
+        kern->ramps(data, w, left, right, errors, n, w);
+        data += n * w;
     }
-    *data = COLOR(x);
 }
 
 static void gradient_crossdiagonal(RrSurface *sf, gint w, gint h)
 {
-    register gint x, y;
+    register gint y, i, n;
     RrPixel32 *data = sf->pixel_data;
-    RrColor left, right;
+    RrColor left[RAMP_BATCH], right[RAMP_BATCH];
+    gint errors[RAMP_BATCH * 3], carry[3] = { 0, 0, 0 };
     RrColor extracorner;
 
     VARS(lefty);
     VARS(righty);
-    VARS(x);
 
     extracorner.r = (sf->primary->r + sf->secondary->r) / 2;
     extracorner.g = (sf->primary->g + sf->secondary->g) / 2;
@@ -730,46 +1293,34 @@ static void gradient_crossdiagonal(RrSurface *sf, gint w, gint h)
     SETUP(lefty, (&extracorner), sf->secondary, h);
     SETUP(righty, sf->primary, (&extracorner), h);
 
-    for (y = h - 1; y > 0; --y) {  /* 0 -> h-1 */
-        COLOR_RR(lefty, (&left));
-        COLOR_RR(righty, (&right));
+    for (y = h; y > 0; y -= n) {  /* 0 -> h-1 */
+        n = MIN(y, RAMP_BATCH);
 
-        SETUP(x, (&left), (&right), w);
+        /* find the ends of each row first, then draw the rows together */
+        for (i = 0; i < n; ++i) {
+            COLOR_RR(lefty, (&left[i]));
+            COLOR_RR(righty, (&right[i]));
 
-        for (x = w - 1; x > 0; --x) {  /* 0 -> w-1 */
-            *(data++) = COLOR(x);
-
-            NEXT(x);
+            NEXT(lefty);
+            NEXT(righty);
         }
-        *(data++) = COLOR(x);
-
-        NEXT(lefty);
-        NEXT(righty);
+        ramp_errors(left, right, n, w, carry, errors);
+        kern->ramps(data, w, left, right, errors, n, w);
+        data += n * w;
     }
-    COLOR_RR(lefty, (&left));
-    COLOR_RR(righty, (&right));
-
-    SETUP(x, (&left), (&right), w);
-
-    for (x = w - 1; x > 0; --x) {  /* 0 -> w-1 */
-        *(data++) = COLOR(x);
-
-        NEXT(x);
-    }
-    *data = COLOR(x);
 }
 
 static void gradient_pyramid(RrSurface *sf, gint w, gint h)
 {
-    RrPixel32 *ldata, *rdata;
+    RrPixel32 *ldata;
     RrPixel32 *cp;
-    RrColor left, right;
+    RrColor left[RAMP_BATCH], right[RAMP_BATCH];
+    gint errors[RAMP_BATCH * 3], carry[3] = { 0, 0, 0 };
     RrColor extracorner;
-    register gint x, y, halfw, halfh, midx, midy;
+    register gint y, i, n, halfw, halfh, midx, midy;
 
     VARS(lefty);
     VARS(righty);
-    VARS(x);
 
     extracorner.r = (sf->primary->r + sf->secondary->r) / 2;
     extracorner.g = (sf->primary->g + sf->secondary->g) / 2;
@@ -786,32 +1337,26 @@ static void gradient_pyramid(RrSurface *sf, gint w, gint h)
     /* draw the top half
 
        it is faster to draw both top quarters together than to draw one and
-       then copy it over to the other side.
+       then copy it over to the other side.  the left quarter (and the middle
+       column) are drawn as ramps, then mirrored into the right quarter.
     */
 
     ldata = sf->pixel_data;
-    rdata = ldata + w - 1;
-    for (y = halfh + midy; y > 0; --y) {  /* 0 -> (h+1)/2 */
-        RrPixel32 c;
-
-        COLOR_RR(lefty, (&left));
-        COLOR_RR(righty, (&right));
+    for (y = halfh + midy; y > 0; y -= n) {  /* 0 -> (h+1)/2 */
+        n = MIN(y, RAMP_BATCH);
 
-        SETUP(x, (&left), (&right), halfw + midx);
+        for (i = 0; i < n; ++i) {
+            COLOR_RR(lefty, (&left[i]));
+            COLOR_RR(righty, (&right[i]));
 
-        for (x = halfw + midx - 1; x > 0; --x) {  /* 0 -> (w+1)/2 */
-            c = COLOR(x);
-            *(ldata++) = *(rdata--) = c;
-
-            NEXT(x);
+            NEXT(lefty);
+            NEXT(righty);
         }
-        c = COLOR(x);
-        *ldata = *rdata = c;
-        ldata += halfw + 1;
-        rdata += halfw - 1 + midx + w;
+        ramp_errors(left, right, n, halfw + midx, carry, errors);
+        kern->ramps(ldata, w, left, right, errors, n, halfw + midx);
 
-        NEXT(lefty);
-        NEXT(righty);
+        for (i = 0; i < n; ++i, ldata += w)
+            kern->reverse(ldata + halfw + midx, ldata, halfw);
     }
 
     /* copy the top half into the bottom half, mirroring it, so we can only
@@ -24,4 +24,13 @@
 
 void RrRender(RrAppearance *a, gint w, gint h);
 
+/*! Picks the fastest gradient kernels that the cpu supports */
+void RrGradientInit(void);
+
+/*! Draws the appearance's rendered pixel data onto its pixmap with server
+  side fills, for gradients whose rows or columns are each a single color.
+  @return FALSE if the appearance can't be drawn this way, and its pixel data
+    has to be put onto the pixmap instead */
+gboolean RrGradientFillPixmap(RrAppearance *a, gint w, gint h);
+
 #endif /* __gradient_h */
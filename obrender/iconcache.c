@@ -0,0 +1,268 @@
+/* -*- indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*-
+
+   iconcache.c for the Openbox window manager
+   Copyright (c) 2026        Openbox developers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   See the COPYING file for a copy of the GNU General Public License.
+*/
+
+#include "iconcache.h"
+#include "obt/paths.h"
+
+#ifdef HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#  include <sys/stat.h>
+#endif
+#ifdef HAVE_SYS_TYPES_H
+#  include <sys/types.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#  include <string.h>
+#endif
+#ifdef HAVE_STDIO_H
+#  include <stdio.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+
+#define ICON_CACHE_MAGIC   0x6349624f /* "ObIc" */
+#define ICON_CACHE_VERSION 2
+
+/* The start of each cache file.  It is followed by the image file's path,
+   padded out to a multiple of 4 bytes, and then the pixels.  The files are
+   only read on the machine that wrote them, so they are in native byte
+   order. */
+typedef struct _RrIconCacheHeader {
+    guint32 magic;
+    guint32 version;
+    /* the image file that the pixels were decoded from */
+    gint64 mtime;
+    gint64 mtime_nsec;
+    gint64 size;
+    guint32 path_len;
+    guint32 width;
+    guint32 height;
+    guint32 pad;
+} RrIconCacheHeader;
+
+#define PATH_SPACE(len) (((len) + 3) & ~3)
+
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+#  define MTIME_NSEC(st) ((gint64)(st)->st_mtim.tv_nsec)
+#else
+#  define MTIME_NSEC(st) ((gint64)0)
+#endif
+
+/*! Returns TRUE if the cache file was saved from the image file as it is
+  now */
+static gboolean header_matches(const RrIconCacheHeader *head,
+                               const struct stat *st)
+{
+    return (head->magic == ICON_CACHE_MAGIC &&
+            head->version == ICON_CACHE_VERSION &&
+            head->mtime == (gint64)st->st_mtime &&
+            head->mtime_nsec == MTIME_NSEC(st) &&
+            head->size == (gint64)st->st_size);
+}
+
+/*! Removes the cache files whose image file is gone or has changed since,
+  as they will never be used again */
+static void prune(const gchar *dir)
+{
+    GDir *d;
+    const gchar *name;
+
+    if (!(d = g_dir_open(dir, 0, NULL)))
+        return;
+
+    while ((name = g_dir_read_name(d))) {
+        RrIconCacheHeader head;
+        struct stat st;
+        gchar *file, *path;
+        gboolean keep = FALSE;
+        gint fd;
+
+        file = g_build_filename(dir, name, NULL);
+        if ((fd = open(file, O_RDONLY)) >= 0) {
+            if (read(fd, &head, sizeof(head)) == sizeof(head) &&
+                head.magic == ICON_CACHE_MAGIC &&
+                head.path_len > 0 && head.path_len < 4096)
+            {
+                path = g_malloc(head.path_len + 1);
+                if (read(fd, path, head.path_len) == (gssize)head.path_len) {
+                    path[head.path_len] = '\0';
+                    keep = stat(path, &st) == 0 && header_matches(&head, &st);
+                }
+                g_free(path);
+            }
+            close(fd);
+            if (!keep)
+                unlink(file);
+        }
+        g_free(file);
+    }
+    g_dir_close(d);
+}
+
+static gpointer make_dir(gpointer data)
+{
+    ObtPaths *p;
+    gchar *dir;
+
+    p = obt_paths_new();
+    dir = g_build_filename(obt_paths_cache_home(p), "openbox", "icons", NULL);
+    obt_paths_unref(p);
+
+    if (!obt_paths_mkdir_path(dir, 0700)) {
+        g_free(dir);
+        dir = NULL;
+    }
+    else
+        prune(dir);
+    return dir;
+}
+
+/*! Returns the name of an image file's cache file, or NULL if there is no
+  cache directory */
+static gchar* cache_file(const gchar *path)
+{
+    static GOnce dir_once = G_ONCE_INIT;
+    const gchar *dir;
+    gchar *sum, *file;
+
+    if (!(dir = g_once(&dir_once, make_dir, NULL)))
+        return NULL;
+
+    sum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, path, -1);
+    file = g_build_filename(dir, sum, NULL);
+    g_free(sum);
+    return file;
+}
+
+RrPixel32* RrIconCacheLoad(const gchar *path, gint *w, gint *h)
+{
+    const RrIconCacheHeader *head;
+    struct stat st, cst;
+    RrPixel32 *data = NULL;
+    gchar *file;
+    gsize path_len, len;
+    gpointer map;
+    gint fd;
+
+    if (stat(path, &st) < 0 || !(file = cache_file(path)))
+        return NULL;
+
+    fd = open(file, O_RDONLY);
+    g_free(file);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &cst) < 0 || cst.st_size < (off_t)sizeof(*head)) {
+        close(fd);
+        return NULL;
+    }
+
+    len = cst.st_size;
+    map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    head = map;
+    path_len = strlen(path);
+    if (header_matches(head, &st) &&
+        head->path_len == path_len &&
+        head->width > 0 && head->height > 0 &&
+        head->width <= G_MAXUINT16 && head->height <= G_MAXUINT16 &&
+        len == sizeof(*head) + PATH_SPACE(path_len) +
+               (gsize)head->width * head->height * sizeof(RrPixel32) &&
+        !memcmp(head + 1, path, path_len))
+    {
+        *w = head->width;
+        *h = head->height;
+        data = g_memdup((const guchar*)(head + 1) + PATH_SPACE(path_len),
+                        *w * *h * sizeof(RrPixel32));
+    }
+
+    munmap(map, len);
+    return data;
+}
+
+void RrIconCacheSave(const gchar *path, const RrPixel32 *data, gint w, gint h)
+{
+    RrIconCacheHeader head;
+    struct stat st;
+    gchar *file, *tmp;
+    gsize path_len;
+    gboolean ok;
+    gint fd;
+
+    if (stat(path, &st) < 0 || !(file = cache_file(path)))
+        return;
+
+    /* write the whole file under another name and then move it into place,
+       so that nobody ever maps half of it */
+    tmp = g_strconcat(file, ".XXXXXX", NULL);
+    if ((fd = g_mkstemp(tmp)) < 0) {
+        g_free(tmp);
+        g_free(file);
+        return;
+    }
+
+    path_len = strlen(path);
+    memset(&head, 0, sizeof(head));
+    head.magic = ICON_CACHE_MAGIC;
+    head.version = ICON_CACHE_VERSION;
+    head.mtime = st.st_mtime;
+    head.mtime_nsec = MTIME_NSEC(&st);
+    head.size = st.st_size;
+    head.path_len = path_len;
+    head.width = w;
+    head.height = h;
+
+    ok = (write(fd, &head, sizeof(head)) == sizeof(head) &&
+          write(fd, path, path_len) == (gssize)path_len &&
+          /* pad the path with zeros from the header */
+          write(fd, &head.pad, PATH_SPACE(path_len) - path_len) ==
+          (gssize)(PATH_SPACE(path_len) - path_len) &&
+          write(fd, data, w * h * sizeof(RrPixel32)) ==
+          (gssize)(w * h * sizeof(RrPixel32)));
+    ok = (close(fd) == 0) && ok;
+
+    if (!ok || rename(tmp, file) < 0)
+        unlink(tmp);
+
+    g_free(tmp);
+    g_free(file);
+}
+
+#else
+
+RrPixel32* RrIconCacheLoad(const gchar *path, gint *w, gint *h)
+{
+    return NULL;
+}
+
+void RrIconCacheSave(const gchar *path, const RrPixel32 *data, gint w, gint h)
+{
+}
+
+#endif
@@ -0,0 +1,43 @@
+/* -*- indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*-
+
+   iconcache.h for the Openbox window manager
+   Copyright (c) 2026        Openbox developers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   See the COPYING file for a copy of the GNU General Public License.
+*/
+
+#ifndef __render_iconcache_h
+#define __render_iconcache_h
+
+#include "render.h"
+
+#include <glib.h>
+
+/* A cache on disk of the pixels decoded from image files, so that they don't
+   need to be decoded again the next time openbox starts.  Each file's pixels
+   are kept in their own file under the user's cache directory, and are only
+   used while the image file's modification time and size stay the same.
+   The first time the cache is used in a process, it removes the files for
+   images that are gone or have changed.
+
+   These may be called from any thread. */
+
+/*! Finds the pixels of an image file in the cache.
+  @return A newly allocated copy of the pixels, or NULL if the file is not in
+    the cache or has changed since it was saved */
+RrPixel32* RrIconCacheLoad(const gchar *path, gint *w, gint *h);
+
+/*! Saves the pixels decoded from an image file in the cache. */
+void RrIconCacheSave(const gchar *path, const RrPixel32 *data, gint w, gint h);
+
+#endif
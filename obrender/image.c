@@ -21,6 +21,8 @@
 #include "image.h"
 #include "color.h"
 #include "imagecache.h"
+#include "cpu.h"
+#include "iconcache.h"
 #ifdef USE_IMLIB2
 #include <Imlib2.h>
 #endif
@@ -30,11 +32,27 @@
 #endif
 
 #include <glib.h>
+#include <string.h>
+
+#ifdef RR_CPU_X86
+#include <immintrin.h>
+#endif
 
-#define FRACTION        12
-#define FLOOR(i)        ((i) & (~0UL << FRACTION))
 #define AVERAGE(a, b)   (((((a) ^ (b)) & 0xfefefefeL) >> 1) + ((a) & (b)))
 
+static RrImagePic* ResamplePic(RrPixel32 *src,
+                               gulong srcW, gulong srcH,
+                               gulong dstW, gulong dstH);
+static RrPixel32* Premultiply(const RrPixel32 *data, gint n);
+static guint64 HashPixels(const RrPixel32 *data, gint n);
+
+/*! Held while decoding an image file */
+static GMutex load_lock;
+/*! The thread that decodes image files for RrImageNewFromNameAsync() */
+static GThreadPool *load_pool = NULL;
+/*! The RrImageLoads which have not been finished in the main loop yet */
+static GSList *loads = NULL;
+
 /************************************************************************
  RrImagePic functions.
 
@@ -50,11 +68,13 @@
   This does _not_ make a copy of the data. So the value of data must be
   owned by the caller of this function, and not freed afterward.
   This function does not allocate an RrImagePic, and can be used for setting
-  up a temporary RrImagePic on the stack.  Such an object would then also
+  up a temporary RrImagePicPriv on the stack.  Such an object would then also
   not be freed with RrImagePicFree.
 */
-static void RrImagePicInit(RrImagePic *pic, gint w, gint h, RrPixel32 *data)
+static void RrImagePicInit(RrImagePicPriv *priv, gint w, gint h,
+                           RrPixel32 *data)
 {
+    RrImagePic *pic = &priv->pic;
     gint i;
 
     pic->width = w;
@@ -63,18 +83,20 @@ static void RrImagePicInit(RrImagePic *pic, gint w, gint h, RrPixel32 *data)
     pic->sum = 0;
     for (i = w*h; i > 0; --i)
         pic->sum += *(data++);
+    priv->hash = HashPixels(pic->data, w*h);
+    priv->lru = NULL;
 }
 
-/*! Create a new RrImagePic from some picture data.
-  This makes a duplicate of the data.
+/*! Create a new RrImagePic from some premultiplied picture data.
+  The RrImagePic takes ownership of the data.
 */
 static RrImagePic* RrImagePicNew(gint w, gint h, RrPixel32 *data)
 {
-    RrImagePic *pic;
+    RrImagePicPriv *priv;
 
-    pic = g_slice_new(RrImagePic);
-    RrImagePicInit(pic, w, h, g_memdup(data, w*h*sizeof(RrPixel32)));
-    return pic;
+    priv = g_slice_new(RrImagePicPriv);
+    RrImagePicInit(priv, w, h, data);
+    return &priv->pic;
 }
 
 
@@ -85,7 +107,7 @@ static void RrImagePicFree(RrImagePic *pic)
 {
     if (pic) {
         g_free(pic->data);
-        g_slice_free(RrImagePic, pic);
+        g_slice_free(RrImagePicPriv, RR_IMAGE_PIC_PRIV(pic));
     }
 }
 
@@ -107,6 +129,75 @@ static void RrImagePicFree(RrImagePic *pic)
 **************************************************************************/
 
 
+/*! Remove a picture that is leaving the RrImageSet from the set's cache, so
+  the cache no longer finds it or counts its memory.
+*/
+static void RrImageSetForgetPicture(RrImageSet *self, RrImagePic *pic)
+{
+    RrImageCache *cache = self->cache;
+    RrImagePicPriv *priv = RR_IMAGE_PIC_PRIV(pic);
+
+    g_hash_table_remove(cache->pic_table, pic);
+    cache->bytes -= RR_IMAGE_PIC_BYTES(pic);
+    if (priv->lru) {
+        g_queue_delete_link(&cache->resized_lru, priv->lru);
+        cache->resized_bytes -= RR_IMAGE_PIC_BYTES(pic);
+        priv->lru = NULL;
+    }
+}
+
+/*! Free the mipmaps of an RrImageSet.  This is done when the original they
+  were made from is no longer the largest one in the set.
+*/
+static void RrImageSetClearMipmaps(RrImageSet *self)
+{
+    gint i;
+
+    /* the first one is the original, which the set still owns */
+    for (i = 1; i < self->n_mipmap; ++i) {
+        self->cache->bytes -= RR_IMAGE_PIC_BYTES(self->mipmap[i]);
+        RrImagePicFree(self->mipmap[i]);
+    }
+    g_free(self->mipmap);
+    self->mipmap = NULL;
+    self->n_mipmap = 0;
+}
+
+/*! Find the smallest mipmap of an original picture in the RrImageSet that is
+  at least as large as the given size, making any mipmaps that are missing
+  along the way.  If the original is not at least twice the size, then the
+  original itself is returned.
+*/
+static RrImagePic* RrImageSetMipmap(RrImageSet *self, RrImagePic *original,
+                                    gint w, gint h)
+{
+    RrImagePic *pic;
+    gint i;
+
+    if (self->n_mipmap && self->mipmap[0] != original)
+        RrImageSetClearMipmaps(self);
+    if (!self->n_mipmap) {
+        self->mipmap = g_new(RrImagePic*, 1);
+        self->mipmap[0] = original;
+        self->n_mipmap = 1;
+    }
+
+    for (i = 0; ; ++i) {
+        pic = self->mipmap[i];
+        if (pic->width / 2 < w || pic->height / 2 < h)
+            return pic;
+
+        if (i + 1 == self->n_mipmap) {
+            ++self->n_mipmap;
+            self->mipmap = g_renew(RrImagePic*, self->mipmap, self->n_mipmap);
+            self->mipmap[i + 1] = ResamplePic(pic->data,
+                                              pic->width, pic->height,
+                                              pic->width / 2, pic->height / 2);
+            self->cache->bytes += RR_IMAGE_PIC_BYTES(self->mipmap[i + 1]);
+        }
+    }
+}
+
 /*! Free an RrImageSet and the stuff inside it.
   This should only occur when there are no more RrImages pointing to the set.
 */
@@ -129,15 +220,16 @@ static void RrImageSetFree(RrImageSet *self)
            be keys in the cache to RrImageSet objects, so remove them from
            the cache's pic_table as well. */
         for (i = 0; i < self->n_original; ++i) {
-            g_hash_table_remove(self->cache->pic_table, self->original[i]);
+            RrImageSetForgetPicture(self, self->original[i]);
             RrImagePicFree(self->original[i]);
         }
         g_free(self->original);
         for (i = 0; i < self->n_resized; ++i) {
-            g_hash_table_remove(self->cache->pic_table, self->resized[i]);
+            RrImageSetForgetPicture(self, self->resized[i]);
             RrImagePicFree(self->resized[i]);
         }
         g_free(self->resized);
+        RrImageSetClearMipmaps(self);
 
         g_slice_free(RrImageSet, self);
     }
@@ -168,8 +260,12 @@ static void RrImageSetRemovePictureAt(RrImageSet *self, gint i,
 
     g_assert(i >= 0 && i < *len);
 
+    /* the mipmaps can't outlive the picture they were made from */
+    if (self->n_mipmap && self->mipmap[0] == (*list)[i])
+        RrImageSetClearMipmaps(self);
+
     /* remove the picture data as a key in the cache */
-    g_hash_table_remove(self->cache->pic_table, (*list)[i]);
+    RrImageSetForgetPicture(self, (*list)[i]);
 
     /* free the picture being removed */
     RrImagePicFree((*list)[i]);
@@ -182,6 +278,27 @@ static void RrImageSetRemovePictureAt(RrImageSet *self, gint i,
     *list = g_renew(RrImagePic*, *list, *len);
 }
 
+/*! Delete the least recently used resized pictures in the whole cache, from
+  whichever RrImageSets they are in, until there is space for another bytes
+  more of them.
+*/
+static void RrImageCacheMakeRoom(RrImageCache *cache, gsize bytes)
+{
+    RrImagePic *pic;
+    RrImageSet *set;
+    gint i;
+
+    while (cache->resized_bytes + bytes > cache->max_resized_bytes) {
+        pic = g_queue_peek_tail(&cache->resized_lru);
+        g_assert(pic != NULL);
+
+        set = g_hash_table_lookup(cache->pic_table, pic);
+        for (i = 0; set->resized[i] != pic; ++i);
+        RrImageSetRemovePictureAt(set, i, FALSE);
+        ++cache->evictions;
+    }
+}
+
 /*! Add an RrImagePic to an RrImageSet.
   The RrImagePic should _not_ exist in the image cache already.
   Pictures are added to the front of the list, to maintain the ordering of
@@ -226,6 +343,13 @@ static void RrImageSetAddPicture(RrImageSet *self, RrImagePic *pic,
     /* add the picture as a key to point to this image in the cache */
     g_hash_table_insert(self->cache->pic_table, (*list)[0], self);
 
+    self->cache->bytes += RR_IMAGE_PIC_BYTES(pic);
+    if (!original) {
+        g_queue_push_head(&self->cache->resized_lru, pic);
+        RR_IMAGE_PIC_PRIV(pic)->lru = self->cache->resized_lru.head;
+        self->cache->resized_bytes += RR_IMAGE_PIC_BYTES(pic);
+    }
+
 /*
 #ifdef DEBUG
     g_debug("Adding %s picture to the cache:\n    "
@@ -295,14 +419,14 @@ RrImageSet* RrImageSetMergeSets(RrImageSet *b, RrImageSet *a)
     */
     tmp = a_i;
     for (; a_i < a->n_resized; ++a_i) {
-        g_hash_table_remove(a->cache->pic_table, a->resized[a_i]);
+        RrImageSetForgetPicture(a, a->resized[a_i]);
         RrImagePicFree(a->resized[a_i]);
     }
     a->n_resized = tmp;
 
     tmp = b_i;
     for (; b_i < b->n_resized; ++b_i) {
-        g_hash_table_remove(a->cache->pic_table, b->resized[b_i]);
+        RrImageSetForgetPicture(a, b->resized[b_i]);
         RrImagePicFree(b->resized[b_i]);
     }
     b->n_resized = tmp;
@@ -414,27 +538,46 @@ void RrImageSetDestroyFunc(RrImage *self, RrImageDestroyFunc func,
 
 void RrImageAddFromData(RrImage *self, RrPixel32 *data, gint w, gint h)
 {
-    RrImagePic pic, *ppic;
+    RrImagePicPriv pic;
+    RrImagePic *ppic;
     RrImageSet *set;
 
     g_return_if_fail(self != NULL);
     g_return_if_fail(data != NULL);
     g_return_if_fail(w > 0 && h > 0);
 
+    data = Premultiply(data, w * h);
     RrImagePicInit(&pic, w, h, data);
-    set = g_hash_table_lookup(self->set->cache->pic_table, &pic);
-    if (set)
+    set = g_hash_table_lookup(self->set->cache->pic_table, &pic.pic);
+    if (set) {
         self->set = RrImageSetMergeSets(self->set, set);
+        g_free(data);
+    }
     else {
         ppic = RrImagePicNew(w, h, data);
         RrImageSetAddPicture(self->set, ppic, TRUE);
     }
 }
 
+/*! Create a new RrImage, with a new RrImageSet that has no pictures in it
+  yet. */
+static RrImage* RrImageNew(RrImageCache *cache)
+{
+    RrImage *self;
+
+    self = g_slice_new0(RrImage);
+    self->ref = 1;
+    self->set = g_slice_new0(RrImageSet);
+    self->set->cache = cache;
+    self->set->images = g_slist_append(self->set->images, self);
+    return self;
+}
+
 RrImage* RrImageNewFromData(RrImageCache *cache, RrPixel32 *data,
                             gint w, gint h)
 {
-    RrImagePic pic, *ppic;
+    RrImagePicPriv pic;
+    RrImagePic *ppic;
     RrImage *self;
     RrImageSet *set;
 
@@ -443,10 +586,13 @@ RrImage* RrImageNewFromData(RrImageCache *cache, RrPixel32 *data,
     g_return_val_if_fail(w > 0 && h > 0, NULL);
 
     /* finds a picture in the cache, if it is already in there, and use the
-       RrImageSet the picture lives in. */
+       RrImageSet the picture lives in.  pictures are kept premultiplied, so
+       look for it that way. */
+    data = Premultiply(data, w * h);
     RrImagePicInit(&pic, w, h, data);
-    set = g_hash_table_lookup(cache->pic_table, &pic);
+    set = g_hash_table_lookup(cache->pic_table, &pic.pic);
     if (set) {
+        g_free(data);
         self = set->images->data; /* just grab any RrImage from the list */
         RrImageRef(self);
         return self;
@@ -456,11 +602,7 @@ RrImage* RrImageNewFromData(RrImageCache *cache, RrPixel32 *data,
        a new RrImageSet, and a new RrImage that points to it, and place the
        new image inside the new RrImageSet */
 
-    self = g_slice_new0(RrImage);
-    self->ref = 1;
-    self->set = g_slice_new0(RrImageSet);
-    self->set->cache = cache;
-    self->set->images = g_slist_append(self->set->images, self);
+    self = RrImageNew(cache);
 
     ppic = RrImagePicNew(w, h, data);
     RrImageSetAddPicture(self->set, ppic, TRUE);
@@ -611,13 +753,13 @@ RsvgLoader* LoadWithRsvg(gchar *path,
 }
 #endif  /* USE_LIBRSVG */
 
-RrImage* RrImageNewFromName(RrImageCache *cache, const gchar *name)
+/*! Decodes an image file.  This may be called from any thread.
+  @return Returns the image's pixels, which the caller must free, or NULL if
+    the file could not be loaded.
+*/
+static RrPixel32* LoadFile(gchar *path, gint *w, gint *h)
 {
-    RrImage *self;
-    RrImageSet *set;
-    gint w, h;
-    RrPixel32 *data;
-    gchar *path;
+    RrPixel32 *data, *copy;
     gboolean loaded;
 
 #if defined(USE_IMLIB2)
@@ -627,42 +769,68 @@ RrImage* RrImageNewFromName(RrImageCache *cache, const gchar *name)
     RsvgLoader *rsvg_loader = NULL;
 #endif
 
-    g_return_val_if_fail(cache != NULL, NULL);
-    g_return_val_if_fail(name != NULL, NULL);
-
-    set = g_hash_table_lookup(cache->name_table, name);
-    if (set) {
-        self = set->images->data;
-        RrImageRef(self);
-        return self;
-    }
+    /* use the pixels decoded the last time, if the file hasn't changed */
+    if ((copy = RrIconCacheLoad(path, w, h)))
+        return copy;
 
-    /* XXX find the path via freedesktop icon spec (use obt) ! */
-    path = g_strdup(name);
+    /* imlib2 keeps its state in globals, so only decode one file at a time */
+    g_mutex_lock(&load_lock);
 
     loaded = FALSE;
 #if defined(USE_LIBRSVG)
     if (!loaded) {
-        rsvg_loader = LoadWithRsvg(path, &data, &w, &h);
+        rsvg_loader = LoadWithRsvg(path, &data, w, h);
         loaded = !!rsvg_loader;
     }
 #endif
 #if defined(USE_IMLIB2)
     if (!loaded) {
-        imlib_loader = LoadWithImlib(path, &data, &w, &h);
+        imlib_loader = LoadWithImlib(path, &data, w, h);
         loaded = !!imlib_loader;
     }
 #endif
 
-    if (!loaded) {
-        g_message("Cannot load image \"%s\" from file \"%s\"", name, path);
-        g_free(path);
+    copy = loaded ? g_memdup(data, *w * *h * sizeof(RrPixel32)) : NULL;
+
 #if defined(USE_LIBRSVG)
-        DestroyRsvgLoader(rsvg_loader);
+    DestroyRsvgLoader(rsvg_loader);
 #endif
 #if defined(USE_IMLIB2)
-        DestroyImlibLoader(imlib_loader);
+    DestroyImlibLoader(imlib_loader);
 #endif
+
+    g_mutex_unlock(&load_lock);
+
+    if (copy)
+        RrIconCacheSave(path, copy, *w, *h);
+
+    return copy;
+}
+
+RrImage* RrImageNewFromName(RrImageCache *cache, const gchar *name)
+{
+    RrImage *self;
+    RrImageSet *set;
+    gint w, h;
+    RrPixel32 *data;
+    gchar *path;
+
+    g_return_val_if_fail(cache != NULL, NULL);
+    g_return_val_if_fail(name != NULL, NULL);
+
+    set = g_hash_table_lookup(cache->name_table, name);
+    if (set) {
+        self = set->images->data;
+        RrImageRef(self);
+        return self;
+    }
+
+    /* XXX find the path via freedesktop icon spec (use obt) ! */
+    path = g_strdup(name);
+
+    if (!(data = LoadFile(path, &w, &h))) {
+        g_message("Cannot load image \"%s\" from file \"%s\"", name, path);
+        g_free(path);
         return NULL;
     }
 
@@ -681,144 +849,897 @@ RrImage* RrImageNewFromName(RrImageCache *cache, const gchar *name)
     self = RrImageNewFromData(cache, data, w, h);
     RrImageSetAddName(self->set, name);
 
-#if defined(USE_LIBRSVG)
-    DestroyRsvgLoader(rsvg_loader);
-#endif
-#if defined(USE_IMLIB2)
-    DestroyImlibLoader(imlib_loader);
-#endif
+    g_free(data);
 
     return self;
 }
 
+/*! An image file being decoded in the loader thread */
+typedef struct _RrImageLoad {
+    /*! The image that the file's picture will be added to */
+    RrImage *image;
+    gchar *path;
+    /*! The decoded picture, filled in by the loader thread */
+    RrPixel32 *data;
+    gint w, h;
+} RrImageLoad;
+
+static void LoadFree(RrImageLoad *load)
+{
+    RrImageCache *cache = load->image->set->cache;
+
+    loads = g_slist_remove(loads, load);
+    RrImageUnref(load->image);
+    RrImageCacheUnref(cache);
+    g_free(load->data);
+    g_free(load->path);
+    g_slice_free(RrImageLoad, load);
+}
+
+/*! Adds a picture decoded by the loader thread to its image.  This runs in
+  the main loop. */
+static gboolean LoadDone(gpointer data)
+{
+    RrImageLoad *load = data;
+    RrImageCache *cache = load->image->set->cache;
+    RrImageSet *set = load->image->set;
+    GSList *it;
+
+    if (load->data)
+        RrImageAddFromData(load->image, load->data, load->w, load->h);
+    else {
+        g_message("Cannot load image from file \"%s\"", load->path);
+
+        /* forget the name, so the empty image isn't handed out for it again
+           and a later try can load the file if it shows up */
+        for (it = set->names; it; it = g_slist_next(it))
+            if (!strcmp(it->data, load->path)) {
+                g_hash_table_remove(cache->name_table, it->data);
+                g_free(it->data);
+                set->names = g_slist_delete_link(set->names, it);
+                break;
+            }
+    }
+    if (cache->loaded_func)
+        cache->loaded_func(load->image, load->data != NULL,
+                           cache->loaded_data);
+
+    LoadFree(load);
+    return FALSE; /* don't repeat */
+}
+
+/*! Decodes an image file for RrImageNewFromNameAsync().  This runs in the
+  loader thread. */
+static void LoadThread(gpointer data, gpointer user_data)
+{
+    RrImageLoad *load = data;
+
+    load->data = LoadFile(load->path, &load->w, &load->h);
+    g_idle_add(LoadDone, load);
+}
+
+RrImage* RrImageNewFromNameAsync(RrImageCache *cache, const gchar *name)
+{
+    RrImage *self;
+    RrImageSet *set;
+    RrImageLoad *load;
+
+    g_return_val_if_fail(cache != NULL, NULL);
+    g_return_val_if_fail(name != NULL, NULL);
+
+    /* this also finds images that are still loading */
+    set = g_hash_table_lookup(cache->name_table, name);
+    if (set) {
+        self = set->images->data;
+        RrImageRef(self);
+        return self;
+    }
+
+    /* XXX find the path via freedesktop icon spec (use obt) ! */
+    /* a missing file is the usual reason for failing, and is cheap to find
+       out about here */
+    if (!g_file_test(name, G_FILE_TEST_IS_REGULAR)) {
+        g_message("Cannot load image \"%s\" from file \"%s\"", name, name);
+        return NULL;
+    }
+
+    /* make an empty image, to hold the picture once it is loaded */
+    self = RrImageNew(cache);
+    RrImageSetAddName(self->set, name);
+
+    load = g_slice_new(RrImageLoad);
+    load->image = self;
+    RrImageRef(self);
+    RrImageCacheRef(cache);
+    load->path = g_strdup(name);
+    load->data = NULL;
+    loads = g_slist_prepend(loads, load);
+
+    /* one thread is enough, since only one file can be decoded at a time */
+    if (!load_pool)
+        load_pool = g_thread_pool_new(LoadThread, NULL, 1, FALSE, NULL);
+    g_thread_pool_push(load_pool, load, NULL);
+
+    return self;
+}
+
+void RrImageCancelLoads(void)
+{
+    if (load_pool) {
+        /* drop the files that haven't started, and wait for the one being
+           decoded now */
+        g_thread_pool_free(load_pool, TRUE, TRUE);
+        load_pool = NULL;
+    }
+
+    /* the loader thread is gone now, so nothing else touches the loads */
+    while (loads) {
+        g_idle_remove_by_data(loads->data);
+        LoadFree(loads->data);
+    }
+}
+
 /************************************************************************
  Image drawing and resizing operations.
 **************************************************************************/
 
-/*! Given a picture in RGBA format, of a specified size, resize it to the new
-  requested size (but keep its aspect ratio).  If the image does not need to
-  be resized (it is already the right size) then this returns NULL.  Otherwise
-  it returns a newly allocated RrImagePic with the resized picture inside it
-  @return Returns a newly allocated RrImagePic object with a new version of the
-    image in the requested size (keeping aspect ratio).
+/* The weights for each resized pixel add up to 1 << WEIGHT_BITS */
+#define WEIGHT_BITS 14
+/* The number of fraction bits kept between the horizontal and vertical
+   passes, small enough that the channels still fit in a gint16 */
+#define INTER_BITS  7
+
+/*! How the pixels along one axis of a picture are combined when resizing it.
+  Each resized pixel is the average of the source pixels under it, weighted
+  by how much of each one it covers. */
+typedef struct _RrResizeAxis {
+    /*! The number of weights for each resized pixel */
+    gint taps;
+    /*! The first source pixel used by each resized pixel */
+    gint *start;
+    /*! taps weights for each resized pixel, some of which may be 0 */
+    gint16 *weights;
+} RrResizeAxis;
+
+static void resize_axis_init(RrResizeAxis *ax, gint src, gint dst)
+{
+    gint i, j;
+
+    /* find the most source pixels that are under any resized pixel */
+    ax->taps = 1;
+    for (i = 0; i < dst; ++i) {
+        const gint first = (glong)i * src / dst;
+        const gint last = ((glong)(i + 1) * src - 1) / dst;
+        ax->taps = MAX(ax->taps, last - first + 1);
+    }
+    ax->start = g_new(gint, dst);
+    ax->weights = g_new0(gint16, dst * ax->taps);
+
+    for (i = 0; i < dst; ++i) {
+        /* measured in units where a source pixel is dst long, and a resized
+           pixel is src long */
+        const glong lo = (glong)i * src, hi = lo + src;
+        const gint first = lo / dst, last = (hi - 1) / dst;
+        gint16 *w;
+        gint sum = 0, big = first;
+
+        /* keep all the weights' pixels inside the source */
+        ax->start[i] = MIN(first, src - ax->taps);
+        w = ax->weights + i * ax->taps - ax->start[i];
+
+        for (j = first; j <= last; ++j) {
+            const glong a = MAX(lo, (glong)j * dst);
+            const glong b = MIN(hi, (glong)(j + 1) * dst);
+
+            w[j] = ((b - a) << WEIGHT_BITS) / src;
+            sum += w[j];
+            if (w[j] > w[big]) big = j;
+        }
+        /* give what was lost to rounding to the biggest weight, so that they
+           add up exactly */
+        w[big] += (1 << WEIGHT_BITS) - sum;
+    }
+}
+
+static void resize_axis_clear(RrResizeAxis *ax)
+{
+    g_free(ax->start);
+    g_free(ax->weights);
+}
+
+/*! The loops of the resizing passes, picked by RrImageInit() to match what
+  the cpu can do.  Every variant produces exactly the same pixels. */
+typedef struct _RrResizeKernels {
+    /*! Resizes a row of pixels horizontally, to dstw pixels whose channels
+      are each stored in a gint16 with INTER_BITS fraction bits */
+    void (*row)(const RrPixel32 *src, gint16 *dst, const RrResizeAxis *ax,
+                gint dstw);
+    /*! Combines taps rows from the horizontal pass, which are stride apart,
+      into a row of dstw pixels */
+    void (*column)(const gint16 *src, gint stride, const gint16 *w,
+                   gint taps, RrPixel32 *dst, gint dstw);
+} RrResizeKernels;
+
+static void row_scalar(const RrPixel32 *src, gint16 *dst,
+                       const RrResizeAxis *ax, gint dstw)
+{
+    const gint round = 1 << (WEIGHT_BITS - INTER_BITS - 1);
+    gint i, t;
+
+    for (i = 0; i < dstw; ++i) {
+        const RrPixel32 *p = src + ax->start[i];
+        const gint16 *w = ax->weights + i * ax->taps;
+        gint c0 = round, c1 = round, c2 = round, c3 = round;
+
+        for (t = 0; t < ax->taps; ++t) {
+            c0 += (p[t]         & 0xFF) * w[t];
+            c1 += ((p[t] >> 8)  & 0xFF) * w[t];
+            c2 += ((p[t] >> 16) & 0xFF) * w[t];
+            c3 += (p[t] >> 24)          * w[t];
+        }
+        *dst++ = c0 >> (WEIGHT_BITS - INTER_BITS);
+        *dst++ = c1 >> (WEIGHT_BITS - INTER_BITS);
+        *dst++ = c2 >> (WEIGHT_BITS - INTER_BITS);
+        *dst++ = c3 >> (WEIGHT_BITS - INTER_BITS);
+    }
+}
+
+static void column_scalar(const gint16 *src, gint stride, const gint16 *w,
+                          gint taps, RrPixel32 *dst, gint dstw)
+{
+    const gint round = 1 << (WEIGHT_BITS + INTER_BITS - 1);
+    gint x, t;
+
+    for (x = 0; x < dstw; ++x, src += 4) {
+        gint c0 = round, c1 = round, c2 = round, c3 = round;
+
+        for (t = 0; t < taps; ++t) {
+            const gint16 *s = src + t * stride;
+
+            c0 += s[0] * w[t];
+            c1 += s[1] * w[t];
+            c2 += s[2] * w[t];
+            c3 += s[3] * w[t];
+        }
+        dst[x] = ((RrPixel32)(c0 >> (WEIGHT_BITS + INTER_BITS))      ) |
+                 ((RrPixel32)(c1 >> (WEIGHT_BITS + INTER_BITS)) << 8 ) |
+                 ((RrPixel32)(c2 >> (WEIGHT_BITS + INTER_BITS)) << 16) |
+                 ((RrPixel32)(c3 >> (WEIGHT_BITS + INTER_BITS)) << 24);
+    }
+}
+
+static const RrResizeKernels resize_scalar = {
+    row_scalar,
+    column_scalar
+};
+
+#ifdef RR_CPU_X86
+
+/* Two gint16 weights in each 32 bit lane, for _mm_madd_epi16 */
+#define WEIGHT_PAIR(w0, w1) ((gint)(((guint)(guint16)(w1) << 16) | \
+                                    (guint16)(w0)))
+
+RR_TARGET_SSE2
+static void row_sse2(const RrPixel32 *src, gint16 *dst,
+                     const RrResizeAxis *ax, gint dstw)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (WEIGHT_BITS - INTER_BITS - 1));
+    __m128i acc, v;
+    gint i, t;
+
+    for (i = 0; i < dstw; ++i) {
+        const RrPixel32 *p = src + ax->start[i];
+        const gint16 *w = ax->weights + i * ax->taps;
+
+        acc = zero;
+        for (t = 0; t + 1 < ax->taps; t += 2) {
+            /* the channels of the two pixels side by side, as 16 bits */
+            v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(p[t]),
+                                  _mm_cvtsi32_si128(p[t + 1]));
+            v = _mm_unpacklo_epi8(v, zero);
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(
+                v, _mm_set1_epi32(WEIGHT_PAIR(w[t], w[t + 1]))));
+        }
+        if (t < ax->taps) {
+            v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(p[t]), zero);
+            v = _mm_unpacklo_epi16(v, zero);
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(
+                v, _mm_set1_epi32(WEIGHT_PAIR(w[t], 0))));
+        }
+        acc = _mm_srai_epi32(_mm_add_epi32(acc, round),
+                             WEIGHT_BITS - INTER_BITS);
+        _mm_storel_epi64((__m128i*)(dst + i * 4), _mm_packs_epi32(acc, acc));
+    }
+}
+
+RR_TARGET_SSE2
+static void column_sse2(const gint16 *src, gint stride, const gint16 *w,
+                        gint taps, RrPixel32 *dst, gint dstw)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (WEIGHT_BITS + INTER_BITS - 1));
+    __m128i lo, hi, a, b, wt;
+    gint x, t;
+
+    /* two pixels at a time */
+    for (x = 0; x + 2 <= dstw; x += 2) {
+        const gint16 *s = src + x * 4;
+
+        lo = hi = zero;
+        for (t = 0; t + 1 < taps; t += 2) {
+            a = _mm_loadu_si128((const __m128i*)(s + t * stride));
+            b = _mm_loadu_si128((const __m128i*)(s + (t + 1) * stride));
+            wt = _mm_set1_epi32(WEIGHT_PAIR(w[t], w[t + 1]));
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b),
+                                                  wt));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b),
+                                                  wt));
+        }
+        if (t < taps) {
+            a = _mm_loadu_si128((const __m128i*)(s + t * stride));
+            wt = _mm_set1_epi32(WEIGHT_PAIR(w[t], 0));
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, zero),
+                                                  wt));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, zero),
+                                                  wt));
+        }
+        lo = _mm_srai_epi32(_mm_add_epi32(lo, round),
+                            WEIGHT_BITS + INTER_BITS);
+        hi = _mm_srai_epi32(_mm_add_epi32(hi, round),
+                            WEIGHT_BITS + INTER_BITS);
+        lo = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(lo, lo));
+    }
+    column_scalar(src + x * 4, stride, w, taps, dst + x, dstw - x);
+}
+
+RR_TARGET_AVX2
+static void column_avx2(const gint16 *src, gint stride, const gint16 *w,
+                        gint taps, RrPixel32 *dst, gint dstw)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i round =
+        _mm256_set1_epi32(1 << (WEIGHT_BITS + INTER_BITS - 1));
+    __m256i lo, hi, a, b, wt;
+    gint x, t;
+
+    /* four pixels at a time */
+    for (x = 0; x + 4 <= dstw; x += 4) {
+        const gint16 *s = src + x * 4;
+
+        lo = hi = zero;
+        for (t = 0; t + 1 < taps; t += 2) {
+            a = _mm256_loadu_si256((const __m256i*)(s + t * stride));
+            b = _mm256_loadu_si256((const __m256i*)(s + (t + 1) * stride));
+            wt = _mm256_set1_epi32(WEIGHT_PAIR(w[t], w[t + 1]));
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(
+                _mm256_unpacklo_epi16(a, b), wt));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(
+                _mm256_unpackhi_epi16(a, b), wt));
+        }
+        if (t < taps) {
+            a = _mm256_loadu_si256((const __m256i*)(s + t * stride));
+            wt = _mm256_set1_epi32(WEIGHT_PAIR(w[t], 0));
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(
+                _mm256_unpacklo_epi16(a, zero), wt));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(
+                _mm256_unpackhi_epi16(a, zero), wt));
+        }
+        lo = _mm256_srai_epi32(_mm256_add_epi32(lo, round),
+                               WEIGHT_BITS + INTER_BITS);
+        hi = _mm256_srai_epi32(_mm256_add_epi32(hi, round),
+                               WEIGHT_BITS + INTER_BITS);
+        /* unpacking and packing both work within each 128 bit lane, so the
+           pixels come out in order, two in the bottom of each lane */
+        lo = _mm256_packs_epi32(lo, hi);
+        lo = _mm256_packus_epi16(lo, lo);
+        lo = _mm256_permute4x64_epi64(lo, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(dst + x), _mm256_castsi256_si128(lo));
+    }
+    column_sse2(src + x * 4, stride, w, taps, dst + x, dstw - x);
+}
+
+static const RrResizeKernels resize_sse2 = {
+    row_sse2,
+    column_sse2
+};
+
+static const RrResizeKernels resize_avx2 = {
+    row_sse2, /* each pixel only fills 128 bits in the horizontal pass */
+    column_avx2
+};
+
+#endif /* RR_CPU_X86 */
+
+static const RrResizeKernels *resize = &resize_scalar;
+
+/* Divides a product of two 8 bit values by 255, rounding to the nearest */
+#define DIV255(x) ((((x) + 128) + (((x) + 128) >> 8)) >> 8)
+
+/*! The loops that put pictures onto a surface, picked by RrImageInit() to
+  match what the cpu can do.  Every variant produces exactly the same
+  pixels. */
+typedef struct _RrBlendKernels {
+    /*! Multiplies the color channels of n pixels by their alpha, which is how
+      RrImagePics keep their pixels */
+    void (*premultiply)(const RrPixel32 *src, RrPixel32 *dst, gint n);
+    /*! Draws n premultiplied pixels over the opaque pixels in dst, with
+      their opacity multiplied by alpha as well */
+    void (*over)(const RrPixel32 *src, RrPixel32 *dst, gint n, gint alpha);
+} RrBlendKernels;
+
+/* Multiplies all four channels of a pixel by a, and divides them by 255 like
+   DIV255, two channels at a time */
+static inline RrPixel32 pixel_mul_div255(RrPixel32 p, guint32 a)
+{
+    guint32 lo = (p & 0x00FF00FF) * a + 0x00800080;
+    guint32 hi = ((p >> 8) & 0x00FF00FF) * a + 0x00800080;
+
+    lo = ((lo + ((lo >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+    hi = (hi + ((hi >> 8) & 0x00FF00FF)) & 0xFF00FF00;
+    return lo | hi;
+}
+
+#define ALPHA_MASK (0xFFU << RrDefaultAlphaOffset)
+
+static void premultiply_scalar(const RrPixel32 *src, RrPixel32 *dst, gint n)
+{
+    gint i;
+
+    for (i = 0; i < n; ++i)
+        dst[i] = (pixel_mul_div255(src[i], src[i] >> RrDefaultAlphaOffset) &
+                  ~ALPHA_MASK) | (src[i] & ALPHA_MASK);
+}
+
+static void over_scalar(const RrPixel32 *src, RrPixel32 *dst, gint n,
+                        gint alpha)
+{
+    RrPixel32 p;
+    guint32 a;
+    gint i;
+
+    for (i = 0; i < n; ++i) {
+        p = alpha == 255 ? src[i] : pixel_mul_div255(src[i], alpha);
+        a = p >> RrDefaultAlphaOffset;
+
+        /* most pixels in icons are either see-through or solid */
+        if (a == 255)
+            dst[i] = p & ~ALPHA_MASK;
+        else if (a)
+            /* premultiplied channels are never more than the alpha, so
+               adding can't carry from one channel to the next */
+            dst[i] = (p + pixel_mul_div255(dst[i] & ~ALPHA_MASK, 255 - a)) &
+                ~ALPHA_MASK;
+        else
+            dst[i] &= ~ALPHA_MASK;
+    }
+}
+
+static const RrBlendKernels blend_scalar = {
+    premultiply_scalar,
+    over_scalar
+};
+
+#ifdef RR_CPU_X86
+
+/* The vector kernels work on the 8 bit channels spread out to 16 bits, and
+   find each pixel's alpha at its place in the 16 bit lanes.  The channel
+   order doesn't matter to them otherwise. */
+#define ALPHA_LANE (RrDefaultAlphaOffset / 8)
+#define ALPHA_SHUFFLE \
+    _MM_SHUFFLE(ALPHA_LANE, ALPHA_LANE, ALPHA_LANE, ALPHA_LANE)
+
+RR_TARGET_SSE2
+static inline __m128i div255_sse2(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+/* Copies each pixel's alpha to all four of its 16 bit lanes */
+RR_TARGET_SSE2
+static inline __m128i alpha_sse2(__m128i x)
+{
+    x = _mm_shufflelo_epi16(x, ALPHA_SHUFFLE);
+    return _mm_shufflehi_epi16(x, ALPHA_SHUFFLE);
+}
+
+RR_TARGET_SSE2
+static void premultiply_sse2(const RrPixel32 *src, RrPixel32 *dst, gint n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    /* the alpha lanes get multiplied by 255, which leaves them as they are */
+    const __m128i keep = _mm_set1_epi64x(0xFFLL << (ALPHA_LANE * 16));
+    const __m128i mask =
+        _mm_set1_epi64x(~(0xFFFFULL << (ALPHA_LANE * 16)));
+    __m128i v, lo, hi;
+    gint i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        v = _mm_loadu_si128((const __m128i*)(src + i));
+        lo = _mm_unpacklo_epi8(v, zero);
+        hi = _mm_unpackhi_epi8(v, zero);
+        lo = div255_sse2(_mm_mullo_epi16(
+            lo, _mm_or_si128(_mm_and_si128(alpha_sse2(lo), mask), keep)));
+        hi = div255_sse2(_mm_mullo_epi16(
+            hi, _mm_or_si128(_mm_and_si128(alpha_sse2(hi), mask), keep)));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    premultiply_scalar(src + i, dst + i, n - i);
+}
+
+RR_TARGET_SSE2
+static void over_sse2(const RrPixel32 *src, RrPixel32 *dst, gint n,
+                      gint alpha)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i galpha = _mm_set1_epi16(alpha);
+    const __m128i opaque = _mm_set1_epi32(~ALPHA_MASK);
+    __m128i s, d, slo, shi, dlo, dhi;
+    gint i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        s = _mm_loadu_si128((const __m128i*)(src + i));
+        d = _mm_loadu_si128((const __m128i*)(dst + i));
+        slo = div255_sse2(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), galpha));
+        shi = div255_sse2(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), galpha));
+        dlo = div255_sse2(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero),
+                                          _mm_sub_epi16(full,
+                                                        alpha_sse2(slo))));
+        dhi = div255_sse2(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero),
+                                          _mm_sub_epi16(full,
+                                                        alpha_sse2(shi))));
+        d = _mm_packus_epi16(_mm_add_epi16(slo, dlo), _mm_add_epi16(shi, dhi));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_and_si128(d, opaque));
+    }
+    over_scalar(src + i, dst + i, n - i, alpha);
+}
+
+RR_TARGET_AVX2
+static inline __m256i div255_avx2(__m256i x)
+{
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+RR_TARGET_AVX2
+static inline __m256i alpha_avx2(__m256i x)
+{
+    x = _mm256_shufflelo_epi16(x, ALPHA_SHUFFLE);
+    return _mm256_shufflehi_epi16(x, ALPHA_SHUFFLE);
+}
+
+/* Unpacking and packing both work within each 128 bit lane, so the pixels
+   come back out in the order they went in */
+
+RR_TARGET_AVX2
+static void premultiply_avx2(const RrPixel32 *src, RrPixel32 *dst, gint n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i keep = _mm256_set1_epi64x(0xFFLL << (ALPHA_LANE * 16));
+    const __m256i mask =
+        _mm256_set1_epi64x(~(0xFFFFULL << (ALPHA_LANE * 16)));
+    __m256i v, lo, hi;
+    gint i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        v = _mm256_loadu_si256((const __m256i*)(src + i));
+        lo = _mm256_unpacklo_epi8(v, zero);
+        hi = _mm256_unpackhi_epi8(v, zero);
+        lo = div255_avx2(_mm256_mullo_epi16(
+            lo, _mm256_or_si256(_mm256_and_si256(alpha_avx2(lo), mask),
+                                keep)));
+        hi = div255_avx2(_mm256_mullo_epi16(
+            hi, _mm256_or_si256(_mm256_and_si256(alpha_avx2(hi), mask),
+                                keep)));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    premultiply_sse2(src + i, dst + i, n - i);
+}
+
+RR_TARGET_AVX2
+static void over_avx2(const RrPixel32 *src, RrPixel32 *dst, gint n,
+                      gint alpha)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i full = _mm256_set1_epi16(255);
+    const __m256i galpha = _mm256_set1_epi16(alpha);
+    const __m256i opaque = _mm256_set1_epi32(~ALPHA_MASK);
+    __m256i s, d, slo, shi, dlo, dhi;
+    gint i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        s = _mm256_loadu_si256((const __m256i*)(src + i));
+        d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        slo = div255_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(s, zero),
+                                             galpha));
+        shi = div255_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(s, zero),
+                                             galpha));
+        dlo = div255_avx2(_mm256_mullo_epi16(
+            _mm256_unpacklo_epi8(d, zero),
+            _mm256_sub_epi16(full, alpha_avx2(slo))));
+        dhi = div255_avx2(_mm256_mullo_epi16(
+            _mm256_unpackhi_epi8(d, zero),
+            _mm256_sub_epi16(full, alpha_avx2(shi))));
+        d = _mm256_packus_epi16(_mm256_add_epi16(slo, dlo),
+                                _mm256_add_epi16(shi, dhi));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_and_si256(d, opaque));
+    }
+    over_sse2(src + i, dst + i, n - i, alpha);
+}
+
+static const RrBlendKernels blend_sse2 = {
+    premultiply_sse2,
+    over_sse2
+};
+
+static const RrBlendKernels blend_avx2 = {
+    premultiply_avx2,
+    over_avx2
+};
+
+#endif /* RR_CPU_X86 */
+
+static const RrBlendKernels *blend = &blend_scalar;
+
+/* The picture hash runs four 64 bit lanes over blocks of 8 pixels, with lane
+   j taking pixels 2j and 2j+1 of each block.  A lane is rotated for every
+   block, and then has the pair of pixels added to it along with their
+   product once mixed with the lane's key.  The lanes and the last few pixels
+   are folded together by HashFinish().  Every variant gives the same hash. */
+#define HASH_PRIME1 G_GUINT64_CONSTANT(0x9E3779B185EBCA87)
+#define HASH_PRIME2 G_GUINT64_CONSTANT(0xC2B2AE3D27D4EB4F)
+#define HASH_ROT 17
+
+static const guint64 hash_keys[4] = {
+    G_GUINT64_CONSTANT(0xBE4BA423396CFEB8),
+    G_GUINT64_CONSTANT(0x1CAD21F72C81017C),
+    G_GUINT64_CONSTANT(0xDB979083E96DD4DE),
+    G_GUINT64_CONSTANT(0x1F67B3B7A4A44072)
+};
+
+static inline guint64 rotl64(guint64 x, gint r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline guint64 hash_avalanche(guint64 h)
+{
+    h ^= h >> 33;
+    h *= HASH_PRIME2;
+    h ^= h >> 29;
+    h *= HASH_PRIME1;
+    return h ^ (h >> 32);
+}
+
+static guint64 HashFinish(const guint64 *acc, const RrPixel32 *tail,
+                          gint n)
+{
+    guint64 h = (guint64)n * HASH_PRIME1;
+    gint i;
+
+    for (i = 0; i < 4; ++i)
+        h = (h ^ hash_avalanche(acc[i])) * HASH_PRIME1;
+    for (i = 0; i < (n & 7); ++i)
+        h = rotl64(h ^ (tail[i] * HASH_PRIME2), 27) * HASH_PRIME1;
+    return hash_avalanche(h);
+}
+
+static guint64 hash_scalar(const RrPixel32 *data, gint n)
+{
+    guint64 acc[4];
+    gint i, j;
+
+    for (j = 0; j < 4; ++j)
+        acc[j] = hash_keys[j];
+    for (i = 0; i + 8 <= n; i += 8)
+        for (j = 0; j < 4; ++j) {
+            const guint64 m =
+                data[i+2*j] | ((guint64)data[i+2*j+1] << 32);
+            const guint64 k = m ^ hash_keys[j];
+
+            acc[j] = rotl64(acc[j], HASH_ROT) + m +
+                (k & 0xFFFFFFFF) * (k >> 32);
+        }
+    return HashFinish(acc, data + i, n);
+}
+
+#ifdef RR_CPU_X86
+
+RR_TARGET_SSE2
+static inline __m128i hash_lane_sse2(__m128i acc, __m128i m, __m128i key)
+{
+    const __m128i k = _mm_xor_si128(m, key);
+
+    acc = _mm_or_si128(_mm_slli_epi64(acc, HASH_ROT),
+                       _mm_srli_epi64(acc, 64 - HASH_ROT));
+    return _mm_add_epi64(_mm_add_epi64(acc, m),
+                         _mm_mul_epu32(k, _mm_srli_epi64(k, 32)));
+}
+
+RR_TARGET_SSE2
+static guint64 hash_sse2(const RrPixel32 *data, gint n)
+{
+    const __m128i key0 = _mm_loadu_si128((const __m128i*)hash_keys);
+    const __m128i key1 = _mm_loadu_si128((const __m128i*)(hash_keys + 2));
+    __m128i acc0 = key0, acc1 = key1;
+    guint64 acc[4];
+    gint i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        acc0 = hash_lane_sse2(acc0,
+            _mm_loadu_si128((const __m128i*)(data + i)), key0);
+        acc1 = hash_lane_sse2(acc1,
+            _mm_loadu_si128((const __m128i*)(data + i + 4)), key1);
+    }
+    _mm_storeu_si128((__m128i*)acc, acc0);
+    _mm_storeu_si128((__m128i*)(acc + 2), acc1);
+    return HashFinish(acc, data + i, n);
+}
+
+RR_TARGET_AVX2
+static guint64 hash_avx2(const RrPixel32 *data, gint n)
+{
+    const __m256i key = _mm256_loadu_si256((const __m256i*)hash_keys);
+    __m256i a = key;
+    guint64 acc[4];
+    gint i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        const __m256i m = _mm256_loadu_si256((const __m256i*)(data + i));
+        const __m256i k = _mm256_xor_si256(m, key);
+
+        a = _mm256_or_si256(_mm256_slli_epi64(a, HASH_ROT),
+                            _mm256_srli_epi64(a, 64 - HASH_ROT));
+        a = _mm256_add_epi64(_mm256_add_epi64(a, m),
+                             _mm256_mul_epu32(k, _mm256_srli_epi64(k, 32)));
+    }
+    _mm256_storeu_si256((__m256i*)acc, a);
+    return HashFinish(acc, data + i, n);
+}
+
+#endif /* RR_CPU_X86 */
+
+static guint64 (*hash)(const RrPixel32 *data, gint n) = hash_scalar;
+
+void RrImageInit(void)
+{
+#ifdef RR_CPU_X86
+    RrCpuFeatures cpu = RrCpuFeaturesGet();
+
+    if (cpu & RR_CPU_AVX2) {
+        resize = &resize_avx2;
+        blend = &blend_avx2;
+        hash = hash_avx2;
+    }
+    else if (cpu & RR_CPU_SSE2) {
+        resize = &resize_sse2;
+        blend = &blend_sse2;
+        hash = hash_sse2;
+    }
+    else
+#endif
+    {
+        resize = &resize_scalar;
+        blend = &blend_scalar;
+        hash = hash_scalar;
+    }
+}
+
+/*! Returns the hash of some picture data, which RrImagePicInit() keeps with
+  the picture so the image cache never needs to read its pixels again to
+  find it. */
+static guint64 HashPixels(const RrPixel32 *data, gint n)
+{
+    return hash(data, n);
+}
+
+/*! Returns a newly allocated copy of some picture data, with the color
+  channels multiplied by the alpha channel. */
+static RrPixel32* Premultiply(const RrPixel32 *data, gint n)
+{
+    RrPixel32 *p;
+
+    p = g_new(RrPixel32, n);
+    blend->premultiply(data, p, n);
+    return p;
+}
+
+/*! Shrinks the requested size for a picture so that it keeps the picture's
+  aspect ratio, while still fitting inside the requested size.
 */
-static RrImagePic* ResizeImage(RrPixel32 *src,
+static void ResizeKeepAspect(gulong srcW, gulong srcH,
+                             gulong *dstW, gulong *dstH)
+{
+    gulong aspectW, aspectH;
+
+    aspectW = *dstW;
+    aspectH = (gint)(*dstW * ((gdouble)srcH / srcW));
+    if (aspectH > *dstH) {
+        aspectH = *dstH;
+        aspectW = (gint)(*dstH * ((gdouble)srcW / srcH));
+    }
+    *dstW = aspectW ? aspectW : 1;
+    *dstH = aspectH ? aspectH : 1;
+}
+
+/*! Resizes a picture in RGBA format to exactly the given size.
+  @return Returns a newly allocated RrImagePic object with the resized picture
+    inside it.
+*/
+static RrImagePic* ResamplePic(RrPixel32 *src,
                                gulong srcW, gulong srcH,
                                gulong dstW, gulong dstH)
 {
-    RrPixel32 *dst, *dststart;
+    RrPixel32 *dst;
     RrImagePic *pic;
-    gulong dstX, dstY, srcX, srcY;
-    gulong srcX1, srcX2, srcY1, srcY2;
-    gulong ratioX, ratioY;
-    gulong aspectW, aspectH;
+    RrResizeAxis ax, ay;
+    gint16 *inter;
+    gulong y;
 
     g_assert(srcW > 0);
     g_assert(srcH > 0);
     g_assert(dstW > 0);
     g_assert(dstH > 0);
 
-    /* keep the aspect ratio */
-    aspectW = dstW;
-    aspectH = (gint)(dstW * ((gdouble)srcH / srcW));
-    if (aspectH > dstH) {
-        aspectH = dstH;
-        aspectW = (gint)(dstH * ((gdouble)srcW / srcH));
-    }
-    dstW = aspectW ? aspectW : 1;
-    dstH = aspectH ? aspectH : 1;
-
-    if (srcW == dstW && srcH == dstH)
-        return NULL; /* no scaling needed! */
-
-    dststart = dst = g_new(RrPixel32, dstW * dstH);
+    dst = g_new(RrPixel32, dstW * dstH);
 
-    ratioX = (srcW << FRACTION) / dstW;
-    ratioY = (srcH << FRACTION) / dstH;
+    /* resize each row horizontally, and then combine the resized rows */
+    resize_axis_init(&ax, srcW, dstW);
+    resize_axis_init(&ay, srcH, dstH);
+    inter = g_new(gint16, srcH * dstW * 4);
 
-    srcY2 = 0;
-    for (dstY = 0; dstY < dstH; dstY++) {
-        srcY1 = srcY2;
-        srcY2 += ratioY;
+    for (y = 0; y < srcH; ++y)
+        resize->row(src + y * srcW, inter + y * dstW * 4, &ax, dstW);
+    for (y = 0; y < dstH; ++y)
+        resize->column(inter + ay.start[y] * dstW * 4, dstW * 4,
+                       ay.weights + y * ay.taps, ay.taps,
+                       dst + y * dstW, dstW);
 
-        srcX2 = 0;
-        for (dstX = 0; dstX < dstW; dstX++) {
-            gulong red = 0, green = 0, blue = 0, alpha = 0;
-            gulong portionX, portionY, portionXY, sumXY = 0;
-            RrPixel32 pixel;
+    g_free(inter);
+    resize_axis_clear(&ax);
+    resize_axis_clear(&ay);
 
-            srcX1 = srcX2;
-            srcX2 += ratioX;
+    pic = RrImagePicNew(dstW, dstH, dst);
 
-            for (srcY = srcY1; srcY < srcY2; srcY += (1UL << FRACTION)) {
-                if (srcY == srcY1) {
-                    srcY = FLOOR(srcY);
-                    portionY = (1UL << FRACTION) - (srcY1 - srcY);
-                    if (portionY > srcY2 - srcY1)
-                        portionY = srcY2 - srcY1;
-                }
-                else if (srcY == FLOOR(srcY2))
-                    portionY = srcY2 - srcY;
-                else
-                    portionY = (1UL << FRACTION);
-
-                for (srcX = srcX1; srcX < srcX2; srcX += (1UL << FRACTION)) {
-                    if (srcX == srcX1) {
-                        srcX = FLOOR(srcX);
-                        portionX = (1UL << FRACTION) - (srcX1 - srcX);
-                        if (portionX > srcX2 - srcX1)
-                            portionX = srcX2 - srcX1;
-                    }
-                    else if (srcX == FLOOR(srcX2))
-                        portionX = srcX2 - srcX;
-                    else
-                        portionX = (1UL << FRACTION);
-
-                    portionXY = (portionX * portionY) >> FRACTION;
-                    sumXY += portionXY;
-
-                    pixel = *(src + (srcY >> FRACTION) * srcW
-                            + (srcX >> FRACTION));
-                    red   += ((pixel >> RrDefaultRedOffset)   & 0xFF)
-                             * portionXY;
-                    green += ((pixel >> RrDefaultGreenOffset) & 0xFF)
-                             * portionXY;
-                    blue  += ((pixel >> RrDefaultBlueOffset)  & 0xFF)
-                             * portionXY;
-                    alpha += ((pixel >> RrDefaultAlphaOffset) & 0xFF)
-                             * portionXY;
-                }
-            }
+    return pic;
+}
 
-            g_assert(sumXY != 0);
-            red   /= sumXY;
-            green /= sumXY;
-            blue  /= sumXY;
-            alpha /= sumXY;
+/*! Given a picture in RGBA format, of a specified size, resize it to the new
+  requested size (but keep its aspect ratio).  If the image does not need to
+  be resized (it is already the right size) then this returns NULL.  Otherwise
+  it returns a newly allocated RrImagePic with the resized picture inside it
+  @return Returns a newly allocated RrImagePic object with a new version of the
+    image in the requested size (keeping aspect ratio).
+*/
+static RrImagePic* ResizeImage(RrPixel32 *src,
+                               gulong srcW, gulong srcH,
+                               gulong dstW, gulong dstH)
+{
+    g_assert(srcW > 0);
+    g_assert(srcH > 0);
+    g_assert(dstW > 0);
+    g_assert(dstH > 0);
 
-            *dst++ = (red   << RrDefaultRedOffset)   |
-                     (green << RrDefaultGreenOffset) |
-                     (blue  << RrDefaultBlueOffset)  |
-                     (alpha << RrDefaultAlphaOffset);
-        }
-    }
+    ResizeKeepAspect(srcW, srcH, &dstW, &dstH);
 
-    pic = g_slice_new(RrImagePic);
-    RrImagePicInit(pic, dstW, dstH, dststart);
+    if (srcW == dstW && srcH == dstH)
+        return NULL; /* no scaling needed! */
 
-    return pic;
+    return ResamplePic(src, srcW, srcH, dstW, dstH);
 }
 
-/*! This draws an RGBA picture into the target, within the rectangle specified
-  by the area parameter.  If the area's size differs from the source's then it
-  will be centered within the rectangle */
+/*! This draws a premultiplied RGBA picture into the target, within the
+  rectangle specified by the area parameter.  If the area's size differs from
+  the source's then it will be centered within the rectangle */
 void DrawRGBA(RrPixel32 *target, gint target_w, gint target_h,
               RrPixel32 *source, gint source_w, gint source_h,
               gint alpha, RrRect *area)
 {
     RrPixel32 *dest;
-    gint col, num_pixels;
-    gint dw, dh;
+    gint y, dw, dh;
 
     g_assert(source_w <= area->width && source_h <= area->height);
     g_assert(area->x + area->width <= target_w);
@@ -832,41 +1753,14 @@ void DrawRGBA(RrPixel32 *target, gint target_w, gint target_h,
         dw = (gint)(dh * ((gdouble)source_w / source_h));
     }
 
-    /* copy source -> dest, and apply the alpha channel.
+    /* draw source over dest, and apply the alpha channel.
        center the image if it is smaller than the area */
-    col = 0;
-    num_pixels = dw * dh;
     dest = target + area->x + (area->width - dw) / 2 +
         (target_w * (area->y + (area->height - dh) / 2));
-    while (num_pixels-- > 0) {
-        guchar a, r, g, b, bgr, bgg, bgb;
-
-        /* apply the rgba's opacity as well */
-        a = ((*source >> RrDefaultAlphaOffset) * alpha) >> 8;
-        r = *source >> RrDefaultRedOffset;
-        g = *source >> RrDefaultGreenOffset;
-        b = *source >> RrDefaultBlueOffset;
-
-        /* background color */
-        bgr = *dest >> RrDefaultRedOffset;
-        bgg = *dest >> RrDefaultGreenOffset;
-        bgb = *dest >> RrDefaultBlueOffset;
-
-        r = bgr + (((r - bgr) * a) >> 8);
-        g = bgg + (((g - bgg) * a) >> 8);
-        b = bgb + (((b - bgb) * a) >> 8);
-
-        *dest = ((r << RrDefaultRedOffset) |
-                 (g << RrDefaultGreenOffset) |
-                 (b << RrDefaultBlueOffset));
-
-        dest++;
-        source++;
-
-        if (++col >= dw) {
-            col = 0;
-            dest += target_w - dw;
-        }
+    for (y = 0; y < dh; ++y) {
+        blend->over(source, dest, dw, alpha);
+        source += dw;
+        dest += target_w;
     }
 }
 
@@ -876,8 +1770,10 @@ void RrImageDrawRGBA(RrPixel32 *target, RrTextureRGBA *rgba,
                      RrRect *area)
 {
     RrImagePic *scaled;
+    RrPixel32 *data;
 
-    scaled = ResizeImage(rgba->data, rgba->width, rgba->height,
+    data = Premultiply(rgba->data, rgba->width * rgba->height);
+    scaled = ResizeImage(data, rgba->width, rgba->height,
                          area->width, area->height);
 
     if (scaled) {
@@ -892,8 +1788,9 @@ void RrImageDrawRGBA(RrPixel32 *target, RrTextureRGBA *rgba,
     }
     else
         DrawRGBA(target, target_w, target_h,
-                 rgba->data, rgba->width, rgba->height,
+                 data, rgba->width, rgba->height,
                  rgba->alpha, area);
+    g_free(data);
 }
 
 /*! Draw an RrImage texture into a target pixel buffer.  If the RrImage does
@@ -916,6 +1813,10 @@ void RrImageDrawImage(RrPixel32 *target, RrTextureImage *img,
     pic = NULL;
     free_pic = FALSE;
 
+    /* the image's pictures may still be loading */
+    if (!set->n_original)
+        return;
+
     /* is there an original of this size? (only the larger of
        w or h has to be right cuz we maintain aspect ratios) */
     for (i = 0; i < set->n_original; ++i)
@@ -948,23 +1849,41 @@ void RrImageDrawImage(RrPixel32 *target, RrTextureImage *img,
             /* and move the selected one to the top of the list */
             set->resized[0] = saved;
 
+            /* and to the top of the whole cache's list too */
+            g_queue_unlink(&set->cache->resized_lru,
+                           RR_IMAGE_PIC_PRIV(saved)->lru);
+            g_queue_push_head_link(&set->cache->resized_lru,
+                                   RR_IMAGE_PIC_PRIV(saved)->lru);
+
             pic = set->resized[0];
             break;
         }
 
-    if (!pic) {
+    if (pic)
+        ++set->cache->hits;
+    else {
         gdouble aspect;
         RrImageSet *cache_set;
+        RrImagePic *src, *largest;
+        gulong w, h;
+
+        ++set->cache->misses;
 
         /* find an original with a close size */
         min_diff = min_aspect_diff = -1;
         min_i = min_aspect_i = 0;
+        largest = NULL;
         aspect = ((gdouble)area->width) / area->height;
         for (i = 0; i < set->n_original; ++i) {
             gint diff;
             gint wdiff, hdiff;
             gdouble myasp;
 
+            if (!largest || (set->original[i]->width *
+                             set->original[i]->height >
+                             largest->width * largest->height))
+                largest = set->original[i];
+
             /* our size difference metric.. */
             wdiff = set->original[i]->width - area->width;
             if (wdiff < 0) wdiff *= 2; /* prefer scaling down than up */
@@ -994,10 +1913,25 @@ void RrImageDrawImage(RrPixel32 *target, RrTextureImage *img,
             min_i = min_aspect_i;
 
         /* resize the original to the given area */
-        pic = ResizeImage(set->original[min_i]->data,
-                          set->original[min_i]->width,
-                          set->original[min_i]->height,
-                          area->width, area->height);
+        src = set->original[min_i];
+        w = area->width;
+        h = area->height;
+        ResizeKeepAspect(src->width, src->height, &w, &h);
+
+        /* when shrinking the largest original, start from its smallest
+           mipmap that is still big enough, instead of the whole thing */
+        if (src == largest)
+            src = RrImageSetMipmap(set, src, w, h);
+
+        if (src == set->original[min_i])
+            pic = ResizeImage(src->data, src->width, src->height,
+                              area->width, area->height);
+        else if (src->width == w && src->height == h)
+            /* the mipmap is already the right size */
+            pic = RrImagePicNew(w, h, g_memdup(src->data,
+                                               w * h * sizeof(RrPixel32)));
+        else
+            pic = ResamplePic(src->data, src->width, src->height, w, h);
 
         /* is it already in the cache ? */
         cache_set = g_hash_table_lookup(set->cache->pic_table, pic);
@@ -1011,13 +1945,21 @@ void RrImageDrawImage(RrPixel32 *target, RrTextureImage *img,
         else {
             /* add the resized image to the image, as the first in the resized
                list */
-            while (set->n_resized >= set->cache->max_resized_saved)
-                /* remove the last one (last used one) to make space for
-                 adding our resized picture */
-                RrImageSetRemovePictureAt(set, set->n_resized-1, FALSE);
-            if (set->cache->max_resized_saved)
+            if (set->cache->max_resized_saved &&
+                RR_IMAGE_PIC_BYTES(pic) <= set->cache->max_resized_bytes)
+            {
+                while (set->n_resized >= set->cache->max_resized_saved) {
+                    /* remove the last one (last used one) to make space for
+                       adding our resized picture */
+                    RrImageSetRemovePictureAt(set, set->n_resized-1, FALSE);
+                    ++set->cache->evictions;
+                }
+                /* and make space for it in the whole cache */
+                RrImageCacheMakeRoom(set->cache, RR_IMAGE_PIC_BYTES(pic));
+
                 /* add it to the resized list */
                 RrImageSetAddPicture(set, pic, FALSE);
+            }
             else
                 free_pic = TRUE; /* don't leak mem! */
         }
@@ -29,4 +29,7 @@ void RrImageDrawRGBA(RrPixel32 *target, RrTextureRGBA *rgba,
                      gint target_w, gint target_h,
                      RrRect *area);
 
+/*! Picks the fastest image resizing kernels that the cpu supports */
+void RrImageInit(void);
+
 #endif
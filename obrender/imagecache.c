@@ -20,6 +20,8 @@
 #include "imagecache.h"
 #include "image.h"
 
+#include <string.h>
+
 static gboolean RrImagePicEqual(const RrImagePic *p1,
                                 const RrImagePic *p2);
 
@@ -32,6 +34,13 @@ RrImageCache* RrImageCacheNew(gint max_resized_saved)
     self = g_slice_new(RrImageCache);
     self->ref = 1;
     self->max_resized_saved = max_resized_saved;
+    self->max_resized_bytes = G_MAXSIZE;
+    self->resized_bytes = 0;
+    g_queue_init(&self->resized_lru);
+    self->bytes = 0;
+    self->hits = self->misses = self->evictions = 0;
+    self->loaded_func = NULL;
+    self->loaded_data = NULL;
     self->pic_table = g_hash_table_new((GHashFunc)RrImagePicHash,
                                        (GEqualFunc)RrImagePicEqual);
     self->name_table = g_hash_table_new(g_str_hash, g_str_equal);
@@ -54,87 +63,63 @@ void RrImageCacheUnref(RrImageCache *self)
         g_hash_table_destroy(self->name_table);
         self->name_table = NULL;
 
+        g_assert(g_queue_is_empty(&self->resized_lru));
+
         g_slice_free(RrImageCache, self);
     }
 }
 
-#define hashsize(n) ((RrPixel32)1<<(n))
-#define hashmask(n) (hashsize(n)-1)
-#define rot(x,k) (((x)<<(k)) | ((x)>>(32-(k))))
-/* mix -- mix 3 32-bit values reversibly. */
-#define mix(a,b,c) \
-{ \
-  a -= c;  a ^= rot(c, 4);  c += b; \
-  b -= a;  b ^= rot(a, 6);  a += c; \
-  c -= b;  c ^= rot(b, 8);  b += a; \
-  a -= c;  a ^= rot(c,16);  c += b; \
-  b -= a;  b ^= rot(a,19);  a += c; \
-  c -= b;  c ^= rot(b, 4);  b += a; \
-}
-/* final -- final mixing of 3 32-bit values (a,b,c) into c */
-#define final(a,b,c) \
-{ \
-  c ^= b; c -= rot(b,14); \
-  a ^= c; a -= rot(c,11); \
-  b ^= a; b -= rot(a,25); \
-  c ^= b; c -= rot(b,16); \
-  a ^= c; a -= rot(c,4);  \
-  b ^= a; b -= rot(a,14); \
-  c ^= b; c -= rot(b,24); \
+void RrImageCacheSetMaxResizedBytes(RrImageCache *self, gsize bytes)
+{
+    self->max_resized_bytes = bytes;
 }
 
-/* This is a fast, reversable hash function called "lookup3", found here:
-   http://burtleburtle.net/bob/c/lookup3.c, by Bob Jenkins
-
-   This hashing algorithm is "reversible", that is, not cryptographically
-   secure at all.  But we don't care about that, we just want something to
-   tell when images are the same or different relatively quickly.
-*/
-guint32 hashword(const guint32 *key, gint length, guint32 initval)
+void RrImageCacheSetLoadedFunc(RrImageCache *self, RrImageLoadedFunc func,
+                               gpointer data)
 {
-    guint32 a,b,c;
-
-    /* Set up the internal state */
-    a = b = c = 0xdeadbeef + (((guint32)length)<<2) + initval;
-
-    /* handle most of the key */
-    while (length > 3)
-    {
-        a += key[0];
-        b += key[1];
-        c += key[2];
-        mix(a,b,c);
-        length -= 3;
-        key += 3;
-    }
-
-    /* handle the last 3 guint32's */
-    switch(length)      /* all the case statements fall through */
-    { 
-    case 3: c+=key[2];
-    case 2: b+=key[1];
-    case 1: a+=key[0];
-        final(a,b,c);
-    case 0:             /* case 0: nothing left to add */
-        break;
-    }
-    /* report the result */
-    return c;
+    self->loaded_func = func;
+    self->loaded_data = data;
 }
 
-/*! This is some arbitrary initial value for the hashing function.  It's
-  constant so that you get the same result from the same data each time.
-*/
-#define HASH_INITVAL 0xf00d
+void RrImageCacheStats(const RrImageCache *self, gulong *hits,
+                       gulong *misses, gulong *evictions, gsize *bytes)
+{
+    if (hits) *hits = self->hits;
+    if (misses) *misses = self->misses;
+    if (evictions) *evictions = self->evictions;
+    if (bytes) *bytes = self->bytes;
+}
 
 guint RrImagePicHash(const RrImagePic *p)
 {
-    return hashword(p->data, p->width * p->height, HASH_INITVAL);
+    const guint64 hash = RR_IMAGE_PIC_PRIV(p)->hash;
+
+    return (guint)(hash ^ (hash >> 32));
 }
 
+/*! The number of pixels, spread across two pictures, that are compared
+  before comparing all of them */
+#define PIC_SAMPLES 16
+
 static gboolean RrImagePicEqual(const RrImagePic *p1,
                                 const RrImagePic *p2)
 {
-    return p1->width == p2->width && p1->height == p2->height &&
-        p1->sum == p2->sum;
+    gint n, i;
+
+    if (p1->width != p2->width || p1->height != p2->height ||
+        p1->sum != p2->sum ||
+        RR_IMAGE_PIC_PRIV(p1)->hash != RR_IMAGE_PIC_PRIV(p2)->hash)
+        return FALSE;
+
+    n = p1->width * p1->height;
+    if (n == 0) return TRUE;
+
+    /* pictures with the same hash but different pixels tend to differ all
+       over, so a few pixels will usually show it */
+    for (i = 0; i < PIC_SAMPLES; ++i) {
+        const gint j = (gint)((gint64)(n - 1) * i / (PIC_SAMPLES - 1));
+        if (p1->data[j] != p2->data[j])
+            return FALSE;
+    }
+    return memcmp(p1->data, p2->data, n * sizeof(RrPixel32)) == 0;
 }
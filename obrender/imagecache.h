@@ -19,11 +19,29 @@
 #ifndef __imagecache_h
 #define __imagecache_h
 
+#include "render.h"
+
 #include <glib.h>
 
-struct _RrImagePic;
+/*! An RrImagePic along with the cache's own state for it.  Every picture that
+  the cache holds is allocated as one of these. */
+typedef struct _RrImagePicPriv {
+    RrImagePic pic;
+    /*! A hash of the pixels, computed once when the picture is set up.  The
+      cache looks pictures up by it. */
+    guint64 hash;
+    /*! For a resized picture, its link in the cache's least recently used
+      list of resized pictures */
+    GList *lru;
+} RrImagePicPriv;
+
+#define RR_IMAGE_PIC_PRIV(p) ((RrImagePicPriv*)(p))
+
+guint RrImagePicHash(const RrImagePic *p);
 
-guint RrImagePicHash(const struct _RrImagePic *p);
+/*! The bytes of pixel data in a picture */
+#define RR_IMAGE_PIC_BYTES(p) \
+    ((gsize)(p)->width * (p)->height * sizeof(RrPixel32))
 
 /*! Create a new image cache.  An image cache is basically a hash table to look
   up RrImages.  Each RrImage in the cache may contain one or more Pictures,
@@ -44,6 +62,25 @@ struct _RrImageCache {
       "resized" picture is deleted.
     */
     gint max_resized_saved;
+    /*! The most bytes of pixel data that the resized pictures of all the
+      RrImages together may hold.  When this is exceeded, the least recently
+      used resized picture in the whole cache is deleted. */
+    gsize max_resized_bytes;
+    /*! The bytes of pixel data held by resized pictures */
+    gsize resized_bytes;
+    /*! All the resized pictures in the cache, most recently used first */
+    GQueue resized_lru;
+    /*! The bytes of pixel data held by all the pictures in the cache */
+    gsize bytes;
+
+    gulong hits;
+    gulong misses;
+    gulong evictions;
+
+    /*! Called when an image started by RrImageNewFromNameAsync() gets its
+      picture */
+    RrImageLoadedFunc loaded_func;
+    gpointer loaded_data;
 
     /*! A hash table of image sets in the cache that don't have a file name
       attached to them, with their key being a hash of the contents of the
@@ -19,15 +19,16 @@
 
 #include "render.h"
 #include "instance.h"
+#include "gradient.h"
+#include "color.h"
+#include "image.h"
+#include "surfacepool.h"
 
 static RrInstance *definst = NULL;
 
 static void RrTrueColorSetup (RrInstance *inst);
 static void RrPseudoColorSetup (RrInstance *inst);
 
-#ifdef DEBUG
-#include "color.h"
-#endif
 static void
 dest(gpointer data)
 {
@@ -67,13 +68,29 @@ RrInstance* RrInstanceNew (Display *display, gint screen)
     definst->pango = pango_xft_get_context(display, screen);
 
     definst->pseudo_colors = NULL;
+    definst->pict_format = NULL;
 
     definst->color_hash = g_hash_table_new_full(g_int_hash, g_int_equal,
                                                 NULL, dest);
+    definst->pixmap_cache = RrPixmapCacheNew();
+    definst->surface_pool = RrSurfacePoolNew();
+
+    RrGradientInit();
+    RrDepthInit();
+    RrImageInit();
 
     switch (definst->visual->class) {
     case TrueColor:
         RrTrueColorSetup(definst);
+        {
+            gint event_base, error_base;
+
+            /* only for TrueColor, the server's idea of which pixel to use
+               for a color could differ from RrPickColor's otherwise */
+            if (XRenderQueryExtension(display, &event_base, &error_base))
+                definst->pict_format = XRenderFindVisualFormat(
+                    display, definst->visual);
+        }
         break;
     case PseudoColor:
     case StaticColor:
@@ -211,6 +228,8 @@ void RrInstanceFree (RrInstance *inst)
         if (inst == definst) definst = NULL;
         g_free(inst->pseudo_colors);
         g_hash_table_destroy(inst->color_hash);
+        RrPixmapCacheFree(inst->pixmap_cache, inst->display);
+        RrSurfacePoolFree(inst->surface_pool, inst->display);
         g_object_unref(inst->pango);
         g_slice_free(RrInstance, inst);
     }
@@ -305,3 +324,18 @@ GHashTable* RrColorHash (const RrInstance *inst)
 {
     return (inst ? inst : definst)->color_hash;
 }
+
+RrPixmapCache* RrPixmapCacheFor (const RrInstance *inst)
+{
+    return (inst ? inst : definst)->pixmap_cache;
+}
+
+RrSurfacePool* RrSurfacePoolFor (const RrInstance *inst)
+{
+    return (inst ? inst : definst)->surface_pool;
+}
+
+XRenderPictFormat* RrPictFormat (const RrInstance *inst)
+{
+    return (inst ? inst : definst)->pict_format;
+}
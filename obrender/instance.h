@@ -19,7 +19,10 @@
 #ifndef __render_instance_h
 #define __render_instance_h
 
+#include "pixmapcache.h"
+
 #include <X11/Xlib.h>
+#include <X11/extensions/Xrender.h>
 #include <glib.h>
 #include <pango/pangoxft.h>
 
@@ -48,10 +51,21 @@ struct _RrInstance {
     XColor *pseudo_colors;
 
     GHashTable *color_hash;
+
+    RrPixmapCache *pixmap_cache;
+    /* buffers kept between paints, see surfacepool.h, which isn't
+       installed */
+    struct _RrSurfacePool *surface_pool;
+
+    /* the format for drawing on our pixmaps with the render extension, or
+       NULL if we don't */
+    XRenderPictFormat *pict_format;
 };
 
 guint       RrPseudoBPC    (const RrInstance *inst);
 XColor*     RrPseudoColors (const RrInstance *inst);
 GHashTable* RrColorHash    (const RrInstance *inst);
+RrPixmapCache* RrPixmapCacheFor(const RrInstance *inst);
+XRenderPictFormat* RrPictFormat(const RrInstance *inst);
 
 #endif
@@ -0,0 +1,270 @@
+/* -*- indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*-
+
+   pixmapcache.c for the Openbox window manager
+   Copyright (c) 2026        Openbox developers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   See the COPYING file for a copy of the GNU General Public License.
+*/
+
+#include "render.h"
+#include "pixmapcache.h"
+#include "instance.h"
+#include "color.h"
+#include "font.h"
+
+#include <string.h>
+
+typedef struct _RrSharedPixmap RrSharedPixmap;
+
+struct _RrSharedPixmap {
+    gint ref;
+    GString *key;
+    Pixmap pixmap;
+    /*! A copy of the pixels the pixmap was painted from, for appearances
+      that are parent relative to the ones sharing it */
+    RrPixel32 *pixel_data;
+};
+
+static void shared_free(RrSharedPixmap *sp)
+{
+    g_string_free(sp->key, TRUE);
+    g_free(sp->pixel_data);
+    g_slice_free(RrSharedPixmap, sp);
+}
+
+RrPixmapCache* RrPixmapCacheNew(void)
+{
+    RrPixmapCache *self;
+
+    self = g_slice_new(RrPixmapCache);
+    self->table = g_hash_table_new((GHashFunc)g_string_hash,
+                                   (GEqualFunc)g_string_equal);
+    self->pixmaps = g_hash_table_new(g_direct_hash, g_direct_equal);
+    self->hits = self->misses = 0;
+    return self;
+}
+
+static gboolean free_shared(gpointer key, gpointer value, gpointer display)
+{
+    RrSharedPixmap *sp = value;
+
+    XFreePixmap(display, sp->pixmap);
+    shared_free(sp);
+    return TRUE;
+}
+
+void RrPixmapCacheFree(RrPixmapCache *self, Display *display)
+{
+    if (self) {
+        g_hash_table_destroy(self->pixmaps);
+        g_hash_table_foreach_remove(self->table, free_shared, display);
+        g_hash_table_destroy(self->table);
+        g_slice_free(RrPixmapCache, self);
+    }
+}
+
+#define KEY_INT(key, i) \
+    { gint _v = (i); g_string_append_len(key, (gchar*)&_v, sizeof(_v)); }
+
+static void key_color(GString *key, const RrColor *c)
+{
+    if (c) {
+        KEY_INT(key, c->r);
+        KEY_INT(key, c->g);
+        KEY_INT(key, c->b);
+    } else
+        KEY_INT(key, -1);
+}
+
+/* fonts and masks are described by what they draw and not by where they
+   live, as a new one can be given the address of one that was freed */
+
+static void key_string(GString *key, const gchar *str)
+{
+    /* include the terminating nul */
+    g_string_append_len(key, str, strlen(str) + 1);
+}
+
+static void key_font(GString *key, const RrFont *f)
+{
+    gchar *desc;
+
+    desc = pango_font_description_to_string(f->font_desc);
+    key_string(key, desc);
+    g_free(desc);
+}
+
+static void key_mask(GString *key, const RrPixmapMask *m)
+{
+    if (m) {
+        KEY_INT(key, m->width);
+        KEY_INT(key, m->height);
+        /* rows are rounded up to the nearest byte */
+        g_string_append_len(key, m->data, (m->width + 7) / 8 * m->height);
+    } else
+        KEY_INT(key, -1);
+}
+
+static gboolean key_appearance(GString *key, const RrAppearance *a)
+{
+    const RrSurface *s = &a->surface;
+    gint i;
+
+    KEY_INT(key, s->grad);
+    KEY_INT(key, s->relief);
+    KEY_INT(key, s->bevel);
+    key_color(key, s->primary);
+    key_color(key, s->secondary);
+    key_color(key, s->border_color);
+    key_color(key, s->interlace_color);
+    key_color(key, s->split_primary);
+    key_color(key, s->split_secondary);
+    KEY_INT(key, s->interlaced);
+    KEY_INT(key, s->border);
+    KEY_INT(key, s->bevel_dark_adjust);
+    KEY_INT(key, s->bevel_light_adjust);
+
+    if (s->grad == RR_SURFACE_PARENTREL) {
+        /* the parent's pixels are copied from wherever they were painted */
+        if (!s->parent) return FALSE;
+        KEY_INT(key, s->parentx);
+        KEY_INT(key, s->parenty);
+        KEY_INT(key, s->parent->w);
+        KEY_INT(key, s->parent->h);
+        if (!key_appearance(key, s->parent)) return FALSE;
+    }
+
+    KEY_INT(key, a->textures);
+    for (i = 0; i < a->textures; ++i) {
+        const RrTextureData *d = &a->texture[i].data;
+
+        KEY_INT(key, a->texture[i].type);
+        switch (a->texture[i].type) {
+        case RR_TEXTURE_NONE:
+            break;
+        case RR_TEXTURE_MASK:
+            key_color(key, d->mask.color);
+            key_mask(key, d->mask.mask);
+            break;
+        case RR_TEXTURE_TEXT:
+            key_font(key, d->text.font);
+            KEY_INT(key, d->text.justify);
+            key_color(key, d->text.color);
+            KEY_INT(key, d->text.shadow_offset_x);
+            KEY_INT(key, d->text.shadow_offset_y);
+            key_color(key, d->text.shadow_color);
+            KEY_INT(key, d->text.shadow_alpha);
+            KEY_INT(key, d->text.shortcut);
+            KEY_INT(key, d->text.shortcut_pos);
+            KEY_INT(key, d->text.ellipsize);
+            KEY_INT(key, d->text.flow);
+            KEY_INT(key, d->text.maxwidth);
+            if (d->text.string) {
+                KEY_INT(key, 1);
+                key_string(key, d->text.string);
+            } else
+                KEY_INT(key, 0);
+            break;
+        case RR_TEXTURE_LINE_ART:
+            key_color(key, d->lineart.color);
+            KEY_INT(key, d->lineart.x1);
+            KEY_INT(key, d->lineart.y1);
+            KEY_INT(key, d->lineart.x2);
+            KEY_INT(key, d->lineart.y2);
+            break;
+        case RR_TEXTURE_RGBA:
+        case RR_TEXTURE_IMAGE:
+            /* the pixels behind these can change at any time */
+            return FALSE;
+        case RR_TEXTURE_NUM_TYPES:
+            g_assert_not_reached();
+        }
+    }
+    return TRUE;
+}
+
+GString* RrPixmapCacheKey(const RrAppearance *a, gint w, gint h)
+{
+    GString *key;
+
+    key = g_string_sized_new(256);
+    KEY_INT(key, w);
+    KEY_INT(key, h);
+    if (!key_appearance(key, a)) {
+        g_string_free(key, TRUE);
+        key = NULL;
+    }
+    return key;
+}
+
+Pixmap RrPixmapCacheLookup(const RrInstance *inst, const GString *key,
+                           const RrPixel32 **pixel_data)
+{
+    RrPixmapCache *self = RrPixmapCacheFor(inst);
+    RrSharedPixmap *sp;
+
+    sp = g_hash_table_lookup(self->table, key);
+    if (!sp) {
+        ++self->misses;
+        return None;
+    }
+
+    ++self->hits;
+    ++sp->ref;
+    *pixel_data = sp->pixel_data;
+    return sp->pixmap;
+}
+
+void RrPixmapCacheAdd(const RrInstance *inst, GString *key, Pixmap pixmap,
+                      const RrPixel32 *pixel_data, gint w, gint h)
+{
+    RrPixmapCache *self = RrPixmapCacheFor(inst);
+    RrSharedPixmap *sp;
+
+    g_assert(g_hash_table_lookup(self->table, key) == NULL);
+
+    sp = g_slice_new(RrSharedPixmap);
+    sp->ref = 1;
+    sp->key = key;
+    sp->pixmap = pixmap;
+    sp->pixel_data = g_memdup(pixel_data, w * h * sizeof(RrPixel32));
+    g_hash_table_insert(self->table, sp->key, sp);
+    g_hash_table_insert(self->pixmaps, GUINT_TO_POINTER(sp->pixmap), sp);
+}
+
+gboolean RrPixmapCacheRelease(const RrInstance *inst, Pixmap pixmap)
+{
+    RrPixmapCache *self = RrPixmapCacheFor(inst);
+    RrSharedPixmap *sp;
+
+    sp = g_hash_table_lookup(self->pixmaps, GUINT_TO_POINTER(pixmap));
+    if (!sp) return FALSE;
+
+    if (--sp->ref == 0) {
+        g_hash_table_remove(self->pixmaps, GUINT_TO_POINTER(sp->pixmap));
+        g_hash_table_remove(self->table, sp->key);
+        XFreePixmap(RrDisplay(inst), sp->pixmap);
+        shared_free(sp);
+    }
+    return TRUE;
+}
+
+void RrPixmapCacheStats(const RrInstance *inst, gulong *hits, gulong *misses,
+                        guint *shared)
+{
+    RrPixmapCache *self = RrPixmapCacheFor(inst);
+
+    if (hits) *hits = self->hits;
+    if (misses) *misses = self->misses;
+    if (shared) *shared = g_hash_table_size(self->table);
+}
@@ -0,0 +1,69 @@
+/* -*- indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*-
+
+   pixmapcache.h for the Openbox window manager
+   Copyright (c) 2026        Openbox developers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   See the COPYING file for a copy of the GNU General Public License.
+*/
+
+#ifndef __pixmapcache_h
+#define __pixmapcache_h
+
+#include "render.h"
+
+#include <X11/Xlib.h>
+#include <glib.h>
+
+typedef struct _RrPixmapCache RrPixmapCache;
+
+/*! A cache of the pixmaps painted for appearances, shared between all the
+  appearances that would paint exactly the same thing at the same size.  For
+  example, the title bars of all unfocused windows of the same width. */
+struct _RrPixmapCache {
+    /*! The shared pixmaps, keyed by a description of their contents (see
+      RrPixmapCacheKey) */
+    GHashTable *table;
+    /*! The same shared pixmaps, keyed by their Pixmap id */
+    GHashTable *pixmaps;
+
+    gulong hits;
+    gulong misses;
+};
+
+RrPixmapCache* RrPixmapCacheNew(void);
+void           RrPixmapCacheFree(RrPixmapCache *self, Display *display);
+
+/*! Returns a description of everything that would be painted for the
+  appearance at the given size, or NULL if the appearance can't share its
+  pixmap with others (when it draws RGBA or image textures, which can
+  change without the appearance itself changing). */
+GString* RrPixmapCacheKey(const RrAppearance *a, gint w, gint h);
+
+/*! Finds a shared pixmap and adds a reference to it.
+  @param pixel_data Returns the pixel data the pixmap was painted from.  It
+    belongs to the cache.
+  @return None if there is no pixmap painted for the key yet. */
+Pixmap RrPixmapCacheLookup(const RrInstance *inst, const GString *key,
+                           const RrPixel32 **pixel_data);
+
+/*! Shares a newly painted pixmap, with a single reference held by its
+  painter.  The cache takes ownership of the key. */
+void RrPixmapCacheAdd(const RrInstance *inst, GString *key, Pixmap pixmap,
+                      const RrPixel32 *pixel_data, gint w, gint h);
+
+/*! Drops a reference on a shared pixmap, freeing it once it is unused.
+  @return FALSE if the pixmap is not in the cache, and so belongs to the
+    caller */
+gboolean RrPixmapCacheRelease(const RrInstance *inst, Pixmap pixmap);
+
+#endif
@@ -25,6 +25,9 @@
 #include "color.h"
 #include "image.h"
 #include "theme.h"
+#include "pixmapcache.h"
+#include "surfacepool.h"
+#include "shm.h"
 
 #include <glib.h>
 #include <X11/Xlib.h>
@@ -34,16 +37,36 @@
 #ifdef HAVE_STDLIB_H
 #  include <stdlib.h>
 #endif
+#ifdef HAVE_STRING_H
+#  include <string.h>
+#endif
 
 static void pixel_data_to_pixmap(RrAppearance *l,
                                  gint x, gint y, gint w, gint h);
 
-Pixmap RrPaintPixmap(RrAppearance *a, gint w, gint h)
+/*! Makes sure the appearance's surface has room for w x h pixels.  The buffer grows by
+  half again when it is too small, so a surface growing a bit at a time
+  doesn't need a new one every time. */
+static void reserve_pixel_data(RrAppearance *a, gint w, gint h)
+{
+    if (w * h > a->pixel_data_size) {
+        g_free(a->surface.pixel_data);
+        a->pixel_data_size = MAX(w * h,
+                                 a->pixel_data_size + a->pixel_data_size / 2);
+        a->surface.pixel_data = g_new(RrPixel32, a->pixel_data_size);
+    }
+}
+
+/*! Paints the appearance, and returns its old pixmap, which the caller must
+  give to release_pixmap().  If share is TRUE, then the appearance can use a
+  pixmap from the pixmap cache, and add its own to it. */
+static Pixmap paint_pixmap(RrAppearance *a, gint w, gint h, gboolean share)
 {
     gint i, transferred = 0, force_transfer = 0;
+    gboolean drawn; /* the surface is already on the pixmap */
     Pixmap oldp = None;
     RrRect tarea; /* area in which to draw textures */
-    gboolean resized;
+    GString *key = NULL;
 
     if (w <= 0 || h <= 0) return None;
 
@@ -59,30 +82,45 @@ Pixmap RrPaintPixmap(RrAppearance *a, gint w, gint h)
         return None;
     }
 
-    resized = (a->w != w || a->h != h);
-
     oldp = a->pixmap; /* save to free after changing the visible pixmap */
-    a->pixmap = XCreatePixmap(RrDisplay(a->inst),
-                              RrRootWindow(a->inst),
+
+    if (share && (key = RrPixmapCacheKey(a, w, h))) {
+        const RrPixel32 *shared_data;
+
+        a->pixmap = RrPixmapCacheLookup(a->inst, key, &shared_data);
+        if (a->pixmap != None) {
+            g_string_free(key, TRUE);
+
+            a->w = w;
+            a->h = h;
+            /* keep the pixel data around for parent relative children */
+            reserve_pixel_data(a, w, h);
+            memcpy(a->surface.pixel_data, shared_data,
+                   w * h * sizeof(RrPixel32));
+            return oldp;
+        }
+    }
+
+    a->pixmap = XCreatePixmap(RrDisplay(a->inst), RrRootWindow(a->inst),
                               w, h, RrDepth(a->inst));
 
     g_assert(a->pixmap != None);
     a->w = w;
     a->h = h;
 
+    /* the xftdraw is created when text is first drawn, and then follows the
+       appearance from pixmap to pixmap */
     if (a->xftdraw != NULL)
-        XftDrawDestroy(a->xftdraw);
-    a->xftdraw = XftDrawCreate(RrDisplay(a->inst), a->pixmap,
-                               RrVisual(a->inst), RrColormap(a->inst));
-    g_assert(a->xftdraw != NULL);
+        XftDrawChange(a->xftdraw, a->pixmap);
 
-    if (resized) {
-        g_free(a->surface.pixel_data);
-        a->surface.pixel_data = g_new(RrPixel32, w * h);
-    }
+    reserve_pixel_data(a, w, h);
 
     RrRender(a, w, h);
 
+    /* solid surfaces are drawn onto the pixmap as they are rendered */
+    drawn = (a->surface.grad == RR_SURFACE_SOLID && !a->surface.interlaced) ||
+        RrGradientFillPixmap(a, w, h);
+
     {
         gint l, t, r, b;
         RrMargins(a, &l, &t, &r, &b);
@@ -96,8 +134,7 @@ Pixmap RrPaintPixmap(RrAppearance *a, gint w, gint h)
         case RR_TEXTURE_TEXT:
             if (!transferred) {
                 transferred = 1;
-                if ((a->surface.grad != RR_SURFACE_SOLID)
-                    || (a->surface.interlaced))
+                if (!drawn)
                     pixel_data_to_pixmap(a, 0, 0, w, h);
             }
             if (a->xftdraw == NULL) {
@@ -110,8 +147,7 @@ Pixmap RrPaintPixmap(RrAppearance *a, gint w, gint h)
         case RR_TEXTURE_LINE_ART:
             if (!transferred) {
                 transferred = 1;
-                if ((a->surface.grad != RR_SURFACE_SOLID)
-                    || (a->surface.interlaced))
+                if (!drawn)
                     pixel_data_to_pixmap(a, 0, 0, w, h);
             }
             XDrawLine(RrDisplay(a->inst), a->pixmap,
@@ -124,8 +160,7 @@ Pixmap RrPaintPixmap(RrAppearance *a, gint w, gint h)
         case RR_TEXTURE_MASK:
             if (!transferred) {
                 transferred = 1;
-                if ((a->surface.grad != RR_SURFACE_SOLID)
-                    || (a->surface.interlaced))
+                if (!drawn)
                     pixel_data_to_pixmap(a, 0, 0, w, h);
             }
             RrPixmapMaskDraw(a->pixmap, &a->texture[i].data.mask, &tarea);
@@ -177,13 +212,33 @@ Pixmap RrPaintPixmap(RrAppearance *a, gint w, gint h)
 
     if (!transferred) {
         transferred = 1;
-        if ((a->surface.grad != RR_SURFACE_SOLID) || (a->surface.interlaced) ||
-            force_transfer)
-        {
+        if (!drawn || force_transfer)
             pixel_data_to_pixmap(a, 0, 0, w, h);
-        }
     }
 
+    if (key)
+        RrPixmapCacheAdd(a->inst, key, a->pixmap, a->surface.pixel_data, w, h);
+
+    return oldp;
+}
+
+/*! Frees a pixmap that an appearance is done with, unless other appearances
+  are still sharing it.  Windows may still have it as their background, which
+  the server keeps for them, so it is never painted into again. */
+static void release_pixmap(const RrInstance *inst, Pixmap p)
+{
+    if (p && !RrPixmapCacheRelease(inst, p))
+        XFreePixmap(RrDisplay(inst), p);
+}
+
+Pixmap RrPaintPixmap(RrAppearance *a, gint w, gint h)
+{
+    Pixmap oldp;
+
+    oldp = paint_pixmap(a, w, h, FALSE);
+    /* a pixmap shared with other appearances is not the caller's to free */
+    if (oldp && RrPixmapCacheRelease(a->inst, oldp))
+        oldp = None;
     return oldp;
 }
 
@@ -191,11 +246,11 @@ void RrPaint(RrAppearance *a, Window win, gint w, gint h)
 {
     Pixmap oldp;
 
-    oldp = RrPaintPixmap(a, w, h);
+    oldp = paint_pixmap(a, w, h, TRUE);
     XSetWindowBackgroundPixmap(RrDisplay(a->inst), win, a->pixmap);
     XClearWindow(RrDisplay(a->inst), win);
     /* free this after changing the visible pixmap */
-    if (oldp) XFreePixmap(RrDisplay(a->inst), oldp);
+    release_pixmap(a->inst, oldp);
 }
 
 RrAppearance *RrAppearanceNew(const RrInstance *inst, gint numtex)
@@ -315,6 +370,7 @@ RrAppearance *RrAppearanceCopy(RrAppearance *orig)
     copy->pixmap = None;
     copy->xftdraw = NULL;
     copy->w = copy->h = 0;
+    copy->pixel_data_size = 0;
     return copy;
 }
 
@@ -323,7 +379,7 @@ void RrAppearanceFree(RrAppearance *a)
 {
     if (a) {
         RrSurface *p;
-        if (a->pixmap != None) XFreePixmap(RrDisplay(a->inst), a->pixmap);
+        release_pixmap(a->inst, a->pixmap);
         if (a->xftdraw != NULL) XftDrawDestroy(a->xftdraw);
         if (a->textures)
             g_free(a->texture);
@@ -338,6 +394,7 @@ void RrAppearanceFree(RrAppearance *a)
         RrColorFree(p->split_secondary);
         g_free(p->pixel_data);
         p->pixel_data = NULL;
+        a->pixel_data_size = 0;
         g_slice_free(RrAppearance, a);
     }
 }
@@ -347,26 +404,39 @@ static void pixel_data_to_pixmap(RrAppearance *l,
 {
     RrPixel32 *in, *scratch;
     Pixmap out;
+    GC gc;
+    RrShm *shm;
     XImage *im = NULL;
-    im = XCreateImage(RrDisplay(l->inst), RrVisual(l->inst), RrDepth(l->inst),
-                      ZPixmap, 0, NULL, w, h, 32, 0);
-    g_assert(im != NULL);
 
     in = l->surface.pixel_data;
     out = l->pixmap;
+    gc = DefaultGC(RrDisplay(l->inst), RrScreen(l->inst));
+
+    /* when the server is on this machine, hand it the pixels through shared
+       memory instead of sending them over the socket */
+    if ((shm = RrSurfacePoolShm(l->inst)) &&
+        (im = RrShmImage(shm, l->inst, w, h)))
+    {
+        RrReduceDepth(l->inst, in, im);
+        RrShmPutImage(shm, l->inst, out, gc, im, x, y);
+        im->data = NULL;
+        XDestroyImage(im);
+        return;
+    }
+
+    im = XCreateImage(RrDisplay(l->inst), RrVisual(l->inst), RrDepth(l->inst),
+                      ZPixmap, 0, NULL, w, h, 32, 0);
+    g_assert(im != NULL);
 
-/* this malloc is a complete waste of time on normal 32bpp
+/* this buffer is a complete waste of time on normal 32bpp
    as reduce_depth just sets im->data = data and returns
 */
-    scratch = g_new(RrPixel32, im->width * im->height);
+    scratch = RrSurfacePoolScratch(l->inst, im->width * im->height);
     im->data = (gchar*) scratch;
     RrReduceDepth(l->inst, in, im);
-    XPutImage(RrDisplay(l->inst), out,
-              DefaultGC(RrDisplay(l->inst), RrScreen(l->inst)),
-              im, 0, 0, x, y, w, h);
+    XPutImage(RrDisplay(l->inst), out, gc, im, 0, 0, x, y, w, h);
     im->data = NULL;
     XDestroyImage(im);
-    g_free(scratch);
 }
 
 void RrMargins (RrAppearance *a, gint *l, gint *t, gint *r, gint *b)
@@ -231,11 +231,13 @@ struct _RrAppearance {
 
     /* cached for internal use */
     gint w, h;
+    gint pixel_data_size; /* number of pixels surface.pixel_data can hold */
 };
 
 /*! Holds a RGBA image picture */
 struct _RrImagePic {
     gint width, height;
+    /* The pixels, with their color channels premultiplied by their alpha */
     RrPixel32 *data;
     /* The sum of all the pixels.  This is used to compare pictures if their
        hashes match. */
@@ -243,6 +245,10 @@ struct _RrImagePic {
 };
 
 typedef void (*RrImageDestroyFunc)(RrImage *image, gpointer data);
+/*! @param loaded FALSE if the file could not be decoded, in which case the
+  image stays empty and should be dropped */
+typedef void (*RrImageLoadedFunc)(RrImage *image, gboolean loaded,
+                                  gpointer data);
 
 /*! An RrImage refers to a RrImageSet.  If multiple RrImageSets end up
   holding the same image data, they will be marged and the RrImages that
@@ -285,6 +291,13 @@ struct _RrImageSet
       RrImage. */
     RrImagePic **resized;
     gint n_resized;
+    /*! The largest "original" picture, followed by copies of it that are
+      each half the size of the one before.  Resizing the largest original
+      starts from the smallest of these that is still big enough.  They are
+      made when they are first needed, and are not in the cache's
+      pic_table. */
+    RrImagePic **mipmap;
+    gint n_mipmap;
 };
 
 struct _RrButton {
@@ -396,12 +409,18 @@ RrSize *RrFontMeasureString (const RrFont *f, const gchar *str,
                              gint shadow_offset_x, gint shadow_offset_y,
                              gboolean flow, gint maxwidth);
 gint    RrFontHeight        (const RrFont *f, gint shadow_offset_y);
+/*! Returns how often RrFontMeasureString found a string's size already
+  measured with the font, and how often it had to measure it.  Either of the
+  pointers may be NULL. */
+void    RrFontMeasureStats  (const RrFont *f, gulong *hits, gulong *misses);
 gint    RrFontMaxCharWidth  (const RrFont *f);
 
 /* Paint into the appearance. The old pixmap is returned (if there was one). It
    is the responsibility of the caller to call XFreePixmap on the return when
    it is non-null. */
 Pixmap RrPaintPixmap (RrAppearance *a, gint w, gint h);
+/* Paint the appearance as the window's background.  The pixmap may be shared
+   with other appearances that paint the very same thing at the same size. */
 void   RrPaint       (RrAppearance *a, Window win, gint w, gint h);
 void   RrMinSize     (RrAppearance *a, gint *w, gint *h);
 gint   RrMinWidth    (RrAppearance *a);
@@ -414,6 +433,12 @@ gboolean RrPixmapToRGBA(const RrInstance *inst,
                         Pixmap pmap, Pixmap mask,
                         gint *w, gint *h, RrPixel32 **data);
 
+/*! Returns how often RrPaint found an identical pixmap to share, how often it
+  had to paint a new one, and the number of shared pixmaps that exist now.
+  Any of the pointers may be NULL. */
+void RrPixmapCacheStats(const RrInstance *inst, gulong *hits, gulong *misses,
+                        guint *shared);
+
 /*! Create a new image cache for RrImages.
   @param max_resized_saved The number of resized copies of an image to save
 */
@@ -421,6 +446,26 @@ RrImageCache* RrImageCacheNew(gint max_resized_saved);
 void          RrImageCacheRef(RrImageCache *self);
 void          RrImageCacheUnref(RrImageCache *self);
 
+/*! Sets the most memory that the resized copies of all the images in the
+  cache together may use, in bytes.  There is no limit until this is called.
+  If the copies use more than this already, the least recently used ones are
+  thrown away the next time an image is resized.
+*/
+void RrImageCacheSetMaxResizedBytes(RrImageCache *self, gsize bytes);
+
+/*! Sets a function to call when an image from RrImageNewFromNameAsync()
+  finishes loading, so that whatever shows the image can draw it again, or
+  stop showing it if loading failed.  Pass NULL to stop calling it. */
+void RrImageCacheSetLoadedFunc(RrImageCache *self, RrImageLoadedFunc func,
+                               gpointer data);
+
+/*! Returns how often drawing an image found a picture of the right size, how
+  often it had to resize one, how many resized pictures were thrown away to
+  make room for others, and how much memory all the pictures in the cache
+  use now, in bytes.  Any of the pointers may be NULL. */
+void RrImageCacheStats(const RrImageCache *self, gulong *hits,
+                       gulong *misses, gulong *evictions, gsize *bytes);
+
 /*! Create a new image, or return one from the cache that matches.
   @param cache The image cache.
   @param old The current RrImage, which the new image should be added to.
@@ -433,6 +478,26 @@ void          RrImageCacheUnref(RrImageCache *self);
 */
 RrImage* RrImageNewFromName(RrImageCache *cache, const gchar *name);
 
+/*! Like RrImageNewFromName, but the file is loaded in another thread.  This
+  returns right away with an image that has no picture in it, and draws as
+  nothing, until loading finishes.  The picture is added to it from the main
+  loop, and then the cache's loaded function is called.  If the file can't be
+  decoded, the image stays empty, its name is forgotten, and the loaded
+  function is told so.
+  @param cache The image cache.
+  @param name The name of the icon to be loaded off disk, or used in the cache
+  @return Returns NULL if there is no file by the name and it is not in the
+    cache already
+*/
+RrImage* RrImageNewFromNameAsync(RrImageCache *cache, const gchar *name);
+
+/*! Stops the thread that loads images for RrImageNewFromNameAsync().  Files
+  not being decoded yet are skipped, and pictures which are decoded but not
+  yet added to their images are thrown away.  Call this before freeing the
+  image caches.
+*/
+void RrImageCancelLoads(void);
+
 /*! Create a new image, or return one from the cache that matches.
   @param cache The image cache.
   @param data The image data in RGBA32 format.  There should be @w * @h many
@@ -0,0 +1,279 @@
+/* -*- indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*-
+
+   shm.c for the Openbox window manager
+   Copyright (c) 2026        Openbox developers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   See the COPYING file for a copy of the GNU General Public License.
+*/
+
+#include "shm.h"
+#include "instance.h"
+
+#ifdef XSHM
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#include <string.h>
+
+/*! The size of the first segment, which grows as bigger images are put */
+#define FIRST_SIZE (256 * 1024)
+/*! Images with fewer pixels than this are sent with XPutImage.  Buttons,
+  labels and grips are small enough that copying them through the socket
+  is cheaper than managing the segment for them */
+#define MIN_PIXELS (64 * 64)
+/*! Images are placed in the segment at multiples of this */
+#define ALIGN(x) (((x) + 63) & ~(gsize)63)
+
+typedef struct _RrShmRegion RrShmRegion;
+
+/*! A part of the segment which the server may still be reading */
+struct _RrShmRegion {
+    gsize start;
+    gsize end;
+    /*! The request which reads from the region */
+    gulong serial;
+};
+
+struct _RrShm {
+    XShmSegmentInfo info;
+    gsize size;
+    /*! The MIT-SHM extension's major opcode */
+    gint opcode;
+    /*! Where the next image goes in the segment, which is used as a ring */
+    gsize head;
+    /*! The offset and size of the image from RrShmImage() which has not
+      been put yet */
+    gsize pending;
+    gsize pending_size;
+    /*! RrShmRegions that have been put, oldest first */
+    GQueue busy;
+};
+
+static gboolean attach_failed;
+static gulong attach_serial;
+static gint attach_opcode;
+static XErrorHandler attach_old_handler;
+
+static gint attach_error_handler(Display *d, XErrorEvent *e)
+{
+    /* only the attach request's error is ours, anything else goes on to the
+       handler that was there before */
+    if (e->serial == attach_serial && e->request_code == attach_opcode) {
+        attach_failed = TRUE;
+        return 0;
+    }
+    return attach_old_handler ? attach_old_handler(d, e) : 0;
+}
+
+/*! Creates a segment and attaches it to both us and the server */
+static gboolean attach(RrShm *self, Display *d, gsize size)
+{
+    self->info.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (self->info.shmid < 0)
+        return FALSE;
+    self->info.shmaddr = shmat(self->info.shmid, NULL, 0);
+    if (self->info.shmaddr == (gchar*)-1) {
+        shmctl(self->info.shmid, IPC_RMID, NULL);
+        return FALSE;
+    }
+    self->info.readOnly = True;
+
+    /* the server refuses to attach if it can't see our memory, which is the
+       real test for if it is on the same machine */
+    attach_failed = FALSE;
+    attach_opcode = self->opcode;
+    attach_serial = NextRequest(d);
+    attach_old_handler = XSetErrorHandler(attach_error_handler);
+    XShmAttach(d, &self->info);
+    XSync(d, False);
+    XSetErrorHandler(attach_old_handler);
+    attach_old_handler = NULL;
+
+    /* the segment goes away by itself once both sides let go of it */
+    shmctl(self->info.shmid, IPC_RMID, NULL);
+
+    if (attach_failed) {
+        shmdt(self->info.shmaddr);
+        return FALSE;
+    }
+    self->size = size;
+    self->head = 0;
+    return TRUE;
+}
+
+static void forget_busy(RrShm *self)
+{
+    RrShmRegion *r;
+
+    while ((r = g_queue_pop_head(&self->busy)))
+        g_slice_free(RrShmRegion, r);
+}
+
+static void detach(RrShm *self, Display *d)
+{
+    /* the server handles the detach after any puts still reading it */
+    XShmDetach(d, &self->info);
+    shmdt(self->info.shmaddr);
+    self->size = 0;
+    forget_busy(self);
+}
+
+/*! Returns TRUE if the display is reached through a local socket */
+static gboolean display_is_local(Display *d)
+{
+    const gchar *name = DisplayString(d);
+
+    return name[0] == ':' || !strncmp(name, "unix:", 5);
+}
+
+RrShm* RrShmNew(const RrInstance *inst)
+{
+    Display *d = RrDisplay(inst);
+    RrShm *self;
+    gint opcode, junk;
+
+    if (!display_is_local(d) ||
+        !XQueryExtension(d, "MIT-SHM", &opcode, &junk, &junk))
+        return NULL;
+
+    self = g_slice_new(RrShm);
+    self->opcode = opcode;
+    self->pending_size = 0;
+    g_queue_init(&self->busy);
+    if (!attach(self, d, FIRST_SIZE)) {
+        g_slice_free(RrShm, self);
+        return NULL;
+    }
+    return self;
+}
+
+void RrShmFree(RrShm *self, Display *display)
+{
+    if (self) {
+        if (self->size) detach(self, display);
+        forget_busy(self);
+        g_slice_free(RrShm, self);
+    }
+}
+
+/*! Returns TRUE if the server may still be reading any of start to end */
+static gboolean in_use(RrShm *self, Display *d, gsize start, gsize end)
+{
+    gulong done = LastKnownRequestProcessed(d);
+    RrShmRegion *r;
+    GList *it;
+
+    /* any event or reply from after a put means the server is done with
+       the region it read */
+    while ((r = g_queue_peek_head(&self->busy)) &&
+           (glong)(done - r->serial) >= 0)
+    {
+        g_queue_pop_head(&self->busy);
+        g_slice_free(RrShmRegion, r);
+    }
+
+    for (it = self->busy.head; it; it = g_list_next(it)) {
+        r = it->data;
+        if (start < r->end && r->start < end)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+XImage* RrShmImage(RrShm *self, const RrInstance *inst, gint w, gint h)
+{
+    Display *d = RrDisplay(inst);
+    XImage *im;
+    gsize need, start;
+
+    if (w * h < MIN_PIXELS)
+        return NULL;
+
+    im = XShmCreateImage(d, RrVisual(inst), RrDepth(inst), ZPixmap, NULL,
+                         &self->info, w, h);
+    if (!im) return NULL;
+
+    need = ALIGN((gsize)im->bytes_per_line * h);
+    if (need > self->size) {
+        if (self->size) detach(self, d);
+        if (!attach(self, d, MAX(need, self->size + self->size / 2))) {
+            XDestroyImage(im);
+            return NULL;
+        }
+    }
+
+    /* put the image after the last one, going back to the start of the
+       segment when it doesn't fit at the end.  only wait for the server
+       when it may still be reading the space the image needs */
+    start = self->head + need > self->size ? 0 : self->head;
+    if (in_use(self, d, start, start + need)) {
+        XSync(d, False);
+        forget_busy(self);
+    }
+
+    self->pending = start;
+    self->pending_size = need;
+    im->data = self->info.shmaddr + start;
+    return im;
+}
+
+void RrShmPutImage(RrShm *self, const RrInstance *inst, Drawable d, GC gc,
+                   XImage *im, gint x, gint y)
+{
+    gchar *data = self->info.shmaddr + self->pending;
+    RrShmRegion *r;
+
+    g_assert(self->pending_size > 0);
+
+    /* RrReduceDepth doesn't copy pixels which are already in the server's
+       format, it just points the image at them */
+    if (im->data != data) {
+        memcpy(data, im->data, (gsize)im->bytes_per_line * im->height);
+        im->data = data;
+    }
+
+    r = g_slice_new(RrShmRegion);
+    r->start = self->pending;
+    r->end = self->pending + self->pending_size;
+    r->serial = NextRequest(RrDisplay(inst));
+    g_queue_push_tail(&self->busy, r);
+    self->head = r->end;
+    self->pending_size = 0;
+
+    XShmPutImage(RrDisplay(inst), d, gc, im, 0, 0, x, y,
+                 im->width, im->height, False);
+}
+
+#else
+
+RrShm* RrShmNew(const RrInstance *inst)
+{
+    return NULL;
+}
+
+void RrShmFree(RrShm *self, Display *display)
+{
+}
+
+XImage* RrShmImage(RrShm *self, const RrInstance *inst, gint w, gint h)
+{
+    return NULL;
+}
+
+void RrShmPutImage(RrShm *self, const RrInstance *inst, Drawable d, GC gc,
+                   XImage *im, gint x, gint y)
+{
+}
+
+#endif
@@ -0,0 +1,49 @@
+/* -*- indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*-
+
+   shm.h for the Openbox window manager
+   Copyright (c) 2026        Openbox developers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   See the COPYING file for a copy of the GNU General Public License.
+*/
+
+#ifndef __render_shm_h
+#define __render_shm_h
+
+#include "render.h"
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <glib.h>
+
+/*! A shared memory segment for giving images to the X server without
+  sending them through the socket, using the MIT-SHM extension */
+typedef struct _RrShm RrShm;
+
+/*! Returns NULL if shared memory can't be used with the instance's display,
+  because the extension is missing or the server is not on this machine */
+RrShm*  RrShmNew(const RrInstance *inst);
+void    RrShmFree(RrShm *self, Display *display);
+
+/*! Creates a w x h image whose data lives in the shared memory segment.
+  Images are placed one after another around the segment, so this only waits
+  for the server when it wraps onto an image the server may still be reading.
+  @return NULL if the image is too small to be worth sharing, or if the
+          segment can't hold it */
+XImage* RrShmImage(RrShm *self, const RrInstance *inst, gint w, gint h);
+
+/*! Puts the image from the last RrShmImage() onto the drawable.  The image
+  still belongs to the caller afterward. */
+void    RrShmPutImage(RrShm *self, const RrInstance *inst, Drawable d, GC gc,
+                      XImage *im, gint x, gint y);
+
+#endif
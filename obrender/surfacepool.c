@@ -0,0 +1,66 @@
+/* -*- indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*-
+
+   surfacepool.c for the Openbox window manager
+   Copyright (c) 2026        Openbox developers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   See the COPYING file for a copy of the GNU General Public License.
+*/
+
+#include "render.h"
+#include "surfacepool.h"
+#include "instance.h"
+#include "shm.h"
+
+RrSurfacePool* RrSurfacePoolNew(void)
+{
+    RrSurfacePool *self;
+
+    self = g_slice_new(RrSurfacePool);
+    self->scratch = NULL;
+    self->scratch_size = 0;
+    self->shm = NULL;
+    self->shm_checked = FALSE;
+    return self;
+}
+
+void RrSurfacePoolFree(RrSurfacePool *self, Display *display)
+{
+    if (self) {
+        g_free(self->scratch);
+        RrShmFree(self->shm, display);
+        g_slice_free(RrSurfacePool, self);
+    }
+}
+
+RrPixel32* RrSurfacePoolScratch(const RrInstance *inst, gint n)
+{
+    RrSurfacePool *self = RrSurfacePoolFor(inst);
+
+    if (n > self->scratch_size) {
+        g_free(self->scratch);
+        self->scratch_size = MAX(n, self->scratch_size + self->scratch_size/2);
+        self->scratch = g_new(RrPixel32, self->scratch_size);
+    }
+    return self->scratch;
+}
+
+RrShm* RrSurfacePoolShm(const RrInstance *inst)
+{
+    RrSurfacePool *self = RrSurfacePoolFor(inst);
+
+    if (!self->shm_checked) {
+        self->shm = RrShmNew(inst);
+        self->shm_checked = TRUE;
+    }
+    return self->shm;
+}
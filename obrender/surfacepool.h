@@ -0,0 +1,57 @@
+/* -*- indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*-
+
+   surfacepool.h for the Openbox window manager
+   Copyright (c) 2026        Openbox developers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   See the COPYING file for a copy of the GNU General Public License.
+*/
+
+#ifndef __surfacepool_h
+#define __surfacepool_h
+
+#include "render.h"
+
+#include <X11/Xlib.h>
+#include <glib.h>
+
+typedef struct _RrSurfacePool RrSurfacePool;
+
+/*! Keeps the buffers that painting needs from one paint to the next, so that
+  steady painting, such as while resizing a window, doesn't allocate them
+  every time.  This is private to the library, and not installed. */
+struct _RrSurfacePool {
+    /*! A buffer for converting pixel data into the server's format */
+    RrPixel32 *scratch;
+    gint scratch_size;
+
+    /*! Shared memory for giving the converted pixel data to the server, or
+      NULL if it can't be used */
+    struct _RrShm *shm;
+    gboolean shm_checked;
+};
+
+RrSurfacePool* RrSurfacePoolNew(void);
+void           RrSurfacePoolFree(RrSurfacePool *self, Display *display);
+
+/*! Returns the instance's pool */
+RrSurfacePool* RrSurfacePoolFor(const RrInstance *inst);
+
+/*! Returns a buffer with room for at least n pixels, which is only valid
+  until the next call. */
+RrPixel32* RrSurfacePoolScratch(const RrInstance *inst, gint n);
+
+/*! Returns the shared memory segment for putting images, or NULL if the
+  server can't use it */
+struct _RrShm* RrSurfacePoolShm(const RrInstance *inst);
+
+#endif
@@ -25,6 +25,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include "render.h"
+#include "image.h"
 #include <glib.h>
 
 static gint x_error_handler(Display * disp, XErrorEvent * error)
@@ -88,6 +89,46 @@ gint main()
     exit (0);
 #endif
 
+#if RESIZETEST
+    {
+        /* time resizing a large icon down to the sizes it gets drawn at.  it
+           is drawn as an RGBA texture, which is resized straight from the
+           icon every time, rather than as an RrImage which would resize it
+           from a smaller copy */
+        const gint sizes[] = { 128, 64, 48, 32, 24, 16 };
+        RrTextureRGBA tex;
+        RrPixel32 *icon, *target;
+        GTimer *timer;
+        gint i, j;
+
+        icon = g_new(RrPixel32, 256 * 256);
+        for (i = 0; i < 256 * 256; ++i)
+            icon[i] = g_random_int();
+        target = g_new(RrPixel32, 128 * 128);
+
+        tex.width = tex.height = 256;
+        tex.data = icon;
+        tex.alpha = 0xff;
+        tex.tx = tex.ty = tex.twidth = tex.theight = 0;
+
+        timer = g_timer_new();
+        for (i = 0; i < G_N_ELEMENTS(sizes); ++i) {
+            RrRect area = { 0, 0, sizes[i], sizes[i] };
+
+            g_timer_start(timer);
+            for (j = 0; j < 1000; ++j)
+                RrImageDrawRGBA(target, &tex, 128, 128, &area);
+            printf("256x256 -> %dx%d: %.1f us\n", sizes[i], sizes[i],
+                   g_timer_elapsed(timer, NULL) * 1000.0);
+        }
+        g_timer_destroy(timer);
+
+        g_free(target);
+        g_free(icon);
+    }
+    exit (0);
+#endif
+
     RrPaint(look, win, w, h);
     done = 0;
     while (!done) {
@@ -23,11 +23,9 @@
 #include "mask.h"
 #include "theme.h"
 #include "icon.h"
-#include "obt/paths.h"
+#include "themecache.h"
 
 #include <X11/Xlib.h>
-#include <X11/Xresource.h>
-#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -48,21 +46,19 @@ struct fallbacks {
     RrAppearance *unfocused_pressed_toggled;
 };
 
-static XrmDatabase loaddb(const gchar *name, gchar **path);
-static gboolean read_int(XrmDatabase db, const gchar *rname, gint *value);
-static gboolean read_string(XrmDatabase db, const gchar *rname, gchar **value);
-static gboolean read_color(XrmDatabase db, const RrInstance *inst,
+static gboolean read_int(RrThemeDb *db, const gchar *rname, gint *value);
+static gboolean read_string(RrThemeDb *db, const gchar *rname, gchar **value);
+static gboolean read_color(RrThemeDb *db, const RrInstance *inst,
                            const gchar *rname, RrColor **value);
-static gboolean read_mask(const RrInstance *inst, const gchar *path,
+static gboolean read_mask(RrThemeDb *db, const RrInstance *inst,
                           const gchar *maskname, RrPixmapMask **value);
-static gboolean read_appearance(XrmDatabase db, const RrInstance *inst,
+static gboolean read_appearance(RrThemeDb *db, const RrInstance *inst,
                                 const gchar *rname, RrAppearance *value,
                                 gboolean allow_trans);
 static int parse_inline_number(const char *p);
 static RrPixel32* read_c_image(gint width, gint height, const guint8 *data);
 static void set_default_appearance(RrAppearance *a);
-static void read_button_styles(XrmDatabase db, const RrInstance *inst, 
-                               gchar *path,
+static void read_button_styles(RrThemeDb *db, const RrInstance *inst, 
                                const RrTheme *theme, RrButton *btn, 
                                const gchar *btnname,
                                struct fallbacks *fbs,
@@ -101,7 +97,7 @@ static RrFont *get_font(RrFont *target, RrFont **default_font,
         x_var = x_def;
 
 #define READ_MASK_COPY(x_file, x_var, x_copysrc) \
-    if (!read_mask(inst, path, x_file, & x_var)) \
+    if (!read_mask(db, inst, x_file, & x_var)) \
         x_var = RrPixmapMaskCopy(x_copysrc);
 
 #define READ_APPEARANCE(x_resstr, x_var, x_parrel) \
@@ -132,17 +128,16 @@ RrTheme* RrThemeNew(const RrInstance *inst, const gchar *name,
                     RrFont *menu_title_font, RrFont *menu_item_font,
                     RrFont *active_osd_font, RrFont *inactive_osd_font)
 {
-    XrmDatabase db = NULL;
+    RrThemeDb *db = NULL;
     RrJustify winjust, mtitlejust;
     gchar *str;
     RrTheme *theme;
     RrFont *default_font = NULL;
-    gchar *path;
     gint menu_overlap = 0;
     struct fallbacks fbs;
 
     if (name) {
-        db = loaddb(name, &path);
+        db = RrThemeDbOpen(name);
         if (db == NULL) {
             g_message("Unable to load the theme '%s'", name);
             if (allow_fallback)
@@ -154,7 +149,7 @@ RrTheme* RrThemeNew(const RrInstance *inst, const gchar *name,
     }
     if (name == NULL) {
         if (allow_fallback) {
-            db = loaddb(DEFAULT_THEME, &path);
+            db = RrThemeDbOpen(DEFAULT_THEME);
             if (db == NULL) {
                 g_message("Unable to load the theme '%s'", DEFAULT_THEME);
                 return NULL;
@@ -487,14 +482,14 @@ RrTheme* RrThemeNew(const RrInstance *inst, const gchar *name,
     {
         guchar normal_mask[] =  { 0x3f, 0x3f, 0x21, 0x21, 0x21, 0x3f };
         guchar toggled_mask[] = { 0x3e, 0x22, 0x2f, 0x29, 0x39, 0x0f };
-        read_button_styles(db, inst, path, theme, theme->btn_max, "max",
+        read_button_styles(db, inst, theme, theme->btn_max, "max",
                            &fbs, normal_mask, toggled_mask);
     }
 
     /* close button */
     {
         guchar normal_mask[] = { 0x33, 0x3f, 0x1e, 0x1e, 0x3f, 0x33 };
-        read_button_styles(db, inst, path, theme, theme->btn_close, "close",
+        read_button_styles(db, inst, theme, theme->btn_close, "close",
                            &fbs, normal_mask, NULL);
     }
 
@@ -502,26 +497,26 @@ RrTheme* RrThemeNew(const RrInstance *inst, const gchar *name,
     {
         guchar normal_mask[] =  { 0x33, 0x33, 0x00, 0x00, 0x33, 0x33 };
         guchar toggled_mask[] = { 0x00, 0x1e, 0x1a, 0x16, 0x1e, 0x00 };
-        read_button_styles(db, inst, path, theme, theme->btn_desk, "desk",
+        read_button_styles(db, inst, theme, theme->btn_desk, "desk",
                            &fbs, normal_mask, toggled_mask);
     }
 
     /* shade button */
     {
         guchar normal_mask[] = { 0x3f, 0x3f, 0x00, 0x00, 0x00, 0x00 };
-        read_button_styles(db, inst, path, theme, theme->btn_shade, "shade",
+        read_button_styles(db, inst, theme, theme->btn_shade, "shade",
                            &fbs, normal_mask, normal_mask);
     }
 
     /* iconify button */
     {
         guchar normal_mask[] = { 0x00, 0x00, 0x00, 0x00, 0x3f, 0x3f };
-        read_button_styles(db, inst, path, theme, theme->btn_iconify, "iconify",
+        read_button_styles(db, inst, theme, theme->btn_iconify, "iconify",
                            &fbs, normal_mask, NULL);
     }
 
     /* submenu bullet mask */
-    if (!read_mask(inst, path, "bullet.xbm", &theme->menu_bullet_mask))
+    if (!read_mask(db, inst, "bullet.xbm", &theme->menu_bullet_mask))
     {
         guchar data[] = { 0x01, 0x03, 0x07, 0x0f, 0x07, 0x03, 0x01 };
         theme->menu_bullet_mask = RrPixmapMaskNew(inst, 4, 7, (gchar*)data);
@@ -940,8 +935,7 @@ RrTheme* RrThemeNew(const RrInstance *inst, const gchar *name,
     theme->a_menu_bullet_selected->texture[0].data.mask.color =
         theme->menu_bullet_selected_color;
 
-    g_free(path);
-    XrmDestroyDatabase(db);
+    RrThemeDbClose(db);
 
     /* set the font heights */
     theme->win_font_height = RrFontHeight(theme->win_font_focused,
@@ -1112,146 +1106,253 @@ void RrThemeFree(RrTheme *theme)
     }
 }
 
-static XrmDatabase loaddb(const gchar *name, gchar **path)
+static gboolean color_same(const RrColor *a, const RrColor *b)
 {
-    GSList *it;
-    XrmDatabase db = NULL;
-    gchar *s;
-
-    if (name[0] == '/') {
-        s = g_build_filename(name, "openbox-3", "themerc", NULL);
-        if ((db = XrmGetFileDatabase(s)))
-            *path = g_path_get_dirname(s);
-        g_free(s);
-    } else {
-        ObtPaths *p;
-
-        p = obt_paths_new();
-
-        /* XXX backwards compatibility, remove me sometime later */
-        s = g_build_filename(g_get_home_dir(), ".themes", name,
-                             "openbox-3", "themerc", NULL);
-        if ((db = XrmGetFileDatabase(s)))
-            *path = g_path_get_dirname(s);
-        g_free(s);
-
-        for (it = obt_paths_data_dirs(p); !db && it; it = g_slist_next(it))
-        {
-            s = g_build_filename(it->data, "themes", name,
-                                 "openbox-3", "themerc", NULL);
-            if ((db = XrmGetFileDatabase(s)))
-                *path = g_path_get_dirname(s);
-            g_free(s);
-        }
+    if (!a || !b) return a == b;
+    return a->r == b->r && a->g == b->g && a->b == b->b;
+}
 
-        obt_paths_unref(p);
-    }
+static gboolean mask_same(const RrPixmapMask *a, const RrPixmapMask *b)
+{
+    if (!a || !b) return a == b;
+    return a->width == b->width && a->height == b->height &&
+        !memcmp(a->data, b->data, (a->width + 7) / 8 * a->height);
+}
+
+static gboolean font_same(const RrFont *a, const RrFont *b)
+{
+    if (a == b) return TRUE;
+    if (!a || !b) return FALSE;
+    /* the fonts are opened again for every theme, so compare what they
+       were opened as */
+    return pango_font_description_equal(a->font_desc, b->font_desc);
+}
 
-    if (db == NULL) {
-        s = g_build_filename(name, "themerc", NULL);
-        if ((db = XrmGetFileDatabase(s)))
-            *path = g_path_get_dirname(s);
-        g_free(s);
+static gboolean texture_same(const RrTexture *a, const RrTexture *b)
+{
+    const RrTextureText *ta, *tb;
+    const RrTextureLineArt *la, *lb;
+
+    if (a->type != b->type) return FALSE;
+
+    switch (a->type) {
+    case RR_TEXTURE_MASK:
+        return color_same(a->data.mask.color, b->data.mask.color) &&
+            mask_same(a->data.mask.mask, b->data.mask.mask);
+    case RR_TEXTURE_TEXT:
+        /* the string is set by whoever draws the text, not the theme */
+        ta = &a->data.text;
+        tb = &b->data.text;
+        return font_same(ta->font, tb->font) &&
+            ta->justify == tb->justify &&
+            color_same(ta->color, tb->color) &&
+            ta->shadow_offset_x == tb->shadow_offset_x &&
+            ta->shadow_offset_y == tb->shadow_offset_y &&
+            color_same(ta->shadow_color, tb->shadow_color) &&
+            ta->shadow_alpha == tb->shadow_alpha &&
+            ta->ellipsize == tb->ellipsize &&
+            ta->flow == tb->flow;
+    case RR_TEXTURE_LINE_ART:
+        la = &a->data.lineart;
+        lb = &b->data.lineart;
+        return color_same(la->color, lb->color) &&
+            la->x1 == lb->x1 && la->y1 == lb->y1 &&
+            la->x2 == lb->x2 && la->y2 == lb->y2;
+    default:
+        /* images are given to the appearance when it is drawn */
+        return TRUE;
     }
+}
+
+static gboolean appearance_same(const RrAppearance *a, const RrAppearance *b)
+{
+    const RrSurface *sa, *sb;
+    gint i;
 
-    return db;
+    if (!a || !b) return a == b;
+
+    /* the bevel colors are made from the primary color when the appearance
+       is first drawn, and the parent is set by whoever draws it */
+    sa = &a->surface;
+    sb = &b->surface;
+    if (sa->grad != sb->grad ||
+        sa->relief != sb->relief ||
+        sa->bevel != sb->bevel ||
+        sa->interlaced != sb->interlaced ||
+        sa->border != sb->border ||
+        sa->bevel_dark_adjust != sb->bevel_dark_adjust ||
+        sa->bevel_light_adjust != sb->bevel_light_adjust ||
+        !color_same(sa->primary, sb->primary) ||
+        !color_same(sa->secondary, sb->secondary) ||
+        !color_same(sa->border_color, sb->border_color) ||
+        !color_same(sa->interlace_color, sb->interlace_color) ||
+        !color_same(sa->split_primary, sb->split_primary) ||
+        !color_same(sa->split_secondary, sb->split_secondary))
+        return FALSE;
+
+    if (a->textures != b->textures) return FALSE;
+    for (i = 0; i < a->textures; ++i)
+        if (!texture_same(&a->texture[i], &b->texture[i]))
+            return FALSE;
+    return TRUE;
 }
 
-static gchar *create_class_name(const gchar *rname)
+static gboolean button_same(const RrButton *a, const RrButton *b)
 {
-    gchar *rclass = g_strdup(rname);
-    gchar *p = rclass;
+#define SAME(f) (color_same(a->f##_color, b->f##_color) &&     \
+                 appearance_same(a->a_##f, b->a_##f))
+#define SAME_MASK(f) mask_same(a->f##_mask, b->f##_mask)
+
+    return SAME(focused_unpressed) && SAME(unfocused_unpressed) &&
+        SAME(focused_pressed) && SAME(unfocused_pressed) &&
+        SAME(focused_disabled) && SAME(unfocused_disabled) &&
+        SAME(focused_hover) && SAME(unfocused_hover) &&
+        SAME(focused_hover_toggled) && SAME(unfocused_hover_toggled) &&
+        SAME(focused_pressed_toggled) && SAME(unfocused_pressed_toggled) &&
+        SAME(focused_unpressed_toggled) &&
+        SAME(unfocused_unpressed_toggled) &&
+        SAME_MASK(unpressed) && SAME_MASK(pressed) &&
+        SAME_MASK(disabled) && SAME_MASK(hover) &&
+        SAME_MASK(unpressed_toggled) && SAME_MASK(hover_toggled) &&
+        SAME_MASK(pressed_toggled);
+
+#undef SAME
+#undef SAME_MASK
+}
 
-    while (TRUE) {
-        *p = toupper(*p);
-        p = strchr(p+1, '.');
-        if (p == NULL) break;
-        ++p;
-        if (*p == '\0') break;
-    }
-    return rclass;
+RrThemeChanges RrThemeDiff(const RrTheme *a, const RrTheme *b)
+{
+    RrThemeChanges changes = RR_THEME_SAME;
+
+#define INT(f) (a->f == b->f)
+#define COLOR(f) color_same(a->f, b->f)
+#define FONT(f) font_same(a->f, b->f)
+#define MASK(f) mask_same(a->f, b->f)
+#define BUTTON(f) button_same(a->f, b->f)
+#define APP(f) appearance_same(a->f, b->f)
+
+    if (!(INT(paddingx) && INT(paddingy) && INT(handle_height) &&
+          INT(fbwidth) && INT(ubwidth) && INT(cbwidthx) && INT(cbwidthy) &&
+          INT(win_font_height) && INT(label_height) && INT(title_height) &&
+          INT(button_size) && INT(grip_width)))
+        changes |= RR_THEME_FRAME_SIZE;
+
+    if (!(FONT(win_font_focused) && FONT(win_font_unfocused) &&
+          COLOR(frame_focused_border_color) &&
+          COLOR(frame_undecorated_focused_border_color) &&
+          COLOR(frame_unfocused_border_color) &&
+          COLOR(frame_undecorated_unfocused_border_color) &&
+          COLOR(title_separator_focused_color) &&
+          COLOR(title_separator_unfocused_color) &&
+          COLOR(cb_focused_color) && COLOR(cb_unfocused_color) &&
+          COLOR(title_focused_color) && COLOR(title_unfocused_color) &&
+          COLOR(title_focused_shadow_color) &&
+          INT(title_focused_shadow_alpha) &&
+          COLOR(title_unfocused_shadow_color) &&
+          INT(title_unfocused_shadow_alpha) &&
+          INT(def_win_icon_w) && INT(def_win_icon_h) &&
+          !memcmp(a->def_win_icon, b->def_win_icon,
+                  a->def_win_icon_w * a->def_win_icon_h * sizeof(RrPixel32)) &&
+          BUTTON(btn_max) && BUTTON(btn_close) && BUTTON(btn_desk) &&
+          BUTTON(btn_shade) && BUTTON(btn_iconify) &&
+          APP(a_focused_grip) && APP(a_unfocused_grip) &&
+          APP(a_focused_title) && APP(a_unfocused_title) &&
+          APP(a_focused_label) && APP(a_unfocused_label) &&
+          APP(a_icon) &&
+          APP(a_focused_handle) && APP(a_unfocused_handle)))
+        changes |= RR_THEME_FRAME_LOOK;
+
+    if (!(FONT(menu_title_font) && FONT(menu_font) &&
+          INT(mbwidth) && INT(menu_overlap_x) && INT(menu_overlap_y) &&
+          INT(menu_sep_width) && INT(menu_sep_paddingx) &&
+          INT(menu_sep_paddingy) && INT(menu_title_font_height) &&
+          INT(menu_font_height) && INT(menu_title_label_height) &&
+          INT(menu_title_height) &&
+          COLOR(menu_border_color) && COLOR(menu_title_color) &&
+          COLOR(menu_sep_color) && COLOR(menu_color) &&
+          COLOR(menu_bullet_color) && COLOR(menu_bullet_selected_color) &&
+          COLOR(menu_selected_color) && COLOR(menu_disabled_color) &&
+          COLOR(menu_disabled_selected_color) &&
+          COLOR(menu_title_shadow_color) && COLOR(menu_text_shadow_color) &&
+          MASK(menu_bullet_mask) &&
+          APP(a_menu_text_title) && APP(a_menu_title) && APP(a_menu) &&
+          APP(a_menu_normal) && APP(a_menu_selected) &&
+          APP(a_menu_disabled) && APP(a_menu_disabled_selected) &&
+          APP(a_menu_text_normal) && APP(a_menu_text_disabled) &&
+          APP(a_menu_text_disabled_selected) &&
+          APP(a_menu_text_selected) &&
+          APP(a_menu_bullet_normal) && APP(a_menu_bullet_selected)))
+        changes |= RR_THEME_MENU;
+
+    if (!(FONT(osd_font_hilite) && FONT(osd_font_unhilite) &&
+          INT(obwidth) && COLOR(osd_border_color) &&
+          COLOR(osd_text_active_color) && COLOR(osd_text_inactive_color) &&
+          COLOR(osd_text_active_shadow_color) &&
+          COLOR(osd_text_inactive_shadow_color) &&
+          INT(osd_text_active_shadow_alpha) &&
+          INT(osd_text_inactive_shadow_alpha) &&
+          COLOR(osd_pressed_color) && COLOR(osd_unpressed_color) &&
+          COLOR(osd_focused_color) && COLOR(osd_pressed_lineart) &&
+          COLOR(osd_focused_lineart) &&
+          MASK(down_arrow_mask) && MASK(up_arrow_mask) &&
+          APP(osd_bg) && APP(osd_hilite_bg) && APP(osd_hilite_label) &&
+          APP(osd_unhilite_bg) && APP(osd_unhilite_label) &&
+          APP(osd_pressed_button) && APP(osd_unpressed_button) &&
+          APP(osd_focused_button)))
+        changes |= RR_THEME_OSD;
+
+    /* everything draws with these */
+    if (!(APP(a_clear) && APP(a_clear_tex)))
+        changes |= RR_THEME_FRAME_LOOK | RR_THEME_MENU | RR_THEME_OSD;
+
+#undef INT
+#undef COLOR
+#undef FONT
+#undef MASK
+#undef BUTTON
+#undef APP
+
+    return changes;
 }
 
-static gboolean read_int(XrmDatabase db, const gchar *rname, gint *value)
+static gboolean read_int(RrThemeDb *db, const gchar *rname, gint *value)
 {
     gboolean ret = FALSE;
-    gchar *rclass = create_class_name(rname);
-    gchar *rettype, *end;
-    XrmValue retvalue;
-
-    if (XrmGetResource(db, rname, rclass, &rettype, &retvalue) &&
-        retvalue.addr != NULL) {
-        *value = (gint)strtol(retvalue.addr, &end, 10);
-        if (end != retvalue.addr)
+    gchar *str, *end;
+
+    if ((str = RrThemeDbResource(db, rname))) {
+        *value = (gint)strtol(str, &end, 10);
+        if (end != str)
             ret = TRUE;
     }
 
-    g_free(rclass);
     return ret;
 }
 
-static gboolean read_string(XrmDatabase db, const gchar *rname, gchar **value)
+static gboolean read_string(RrThemeDb *db, const gchar *rname, gchar **value)
 {
     gboolean ret = FALSE;
-    gchar *rclass = create_class_name(rname);
-    gchar *rettype;
-    XrmValue retvalue;
-
-    if (XrmGetResource(db, rname, rclass, &rettype, &retvalue) &&
-        retvalue.addr != NULL) {
-        g_strstrip(retvalue.addr);
-        *value = retvalue.addr;
+    gchar *str;
+
+    if ((str = RrThemeDbResource(db, rname))) {
+        g_strstrip(str);
+        *value = str;
         ret = TRUE;
     }
 
-    g_free(rclass);
     return ret;
 }
 
-static gboolean read_color(XrmDatabase db, const RrInstance *inst,
+static gboolean read_color(RrThemeDb *db, const RrInstance *inst,
                            const gchar *rname, RrColor **value)
 {
-    gboolean ret = FALSE;
-    gchar *rclass = create_class_name(rname);
-    gchar *rettype;
-    XrmValue retvalue;
-
-    if (XrmGetResource(db, rname, rclass, &rettype, &retvalue) &&
-        retvalue.addr != NULL) {
-        RrColor *c;
-
-        /* retvalue.addr is inside the xrdb database so we can't destroy it
-           but we can edit it in place, as g_strstrip does. */
-        g_strstrip(retvalue.addr);
-        c = RrColorParse(inst, retvalue.addr);
-        if (c != NULL) {
-            *value = c;
-            ret = TRUE;
-        }
-    }
-
-    g_free(rclass);
-    return ret;
+    return RrThemeDbColor(db, inst, rname, value);
 }
 
-static gboolean read_mask(const RrInstance *inst, const gchar *path,
+static gboolean read_mask(RrThemeDb *db, const RrInstance *inst,
                           const gchar *maskname, RrPixmapMask **value)
 {
-    gboolean ret = FALSE;
-    gchar *s;
-    gint hx, hy; /* ignored */
-    guint w, h;
-    guchar *b;
-
-    s = g_build_filename(path, maskname, NULL);
-    if (XReadBitmapFileData(s, &w, &h, &b, &hx, &hy) == BitmapSuccess) {
-        ret = TRUE;
-        *value = RrPixmapMaskNew(inst, w, h, (gchar*)b);
-        XFree(b);
-    }
-    g_free(s);
-
-    return ret;
+    return RrThemeDbMask(db, inst, maskname, value);
 }
 
 static void parse_appearance(gchar *tex, RrSurfaceColorType *grad,
@@ -1315,16 +1416,14 @@ static void parse_appearance(gchar *tex, RrSurfaceColorType *grad,
         *interlaced = FALSE;
 }
 
-static gboolean read_appearance(XrmDatabase db, const RrInstance *inst,
+static gboolean read_appearance(RrThemeDb *db, const RrInstance *inst,
                                 const gchar *rname, RrAppearance *value,
                                 gboolean allow_trans)
 {
     gboolean ret = FALSE;
-    gchar *rclass = create_class_name(rname);
     gchar *cname, *ctoname, *bcname, *icname, *hname, *sname;
     gchar *csplitname, *ctosplitname;
-    gchar *rettype;
-    XrmValue retvalue;
+    gchar *str;
     gint i;
 
     cname = g_strconcat(rname, ".color", NULL);
@@ -1336,9 +1435,8 @@ static gboolean read_appearance(XrmDatabase db, const RrInstance *inst,
     csplitname = g_strconcat(rname, ".color.splitTo", NULL);
     ctosplitname = g_strconcat(rname, ".colorTo.splitTo", NULL);
 
-    if (XrmGetResource(db, rname, rclass, &rettype, &retvalue) &&
-        retvalue.addr != NULL) {
-        parse_appearance(retvalue.addr,
+    if ((str = RrThemeDbResource(db, rname))) {
+        parse_appearance(str,
                          &value->surface.grad,
                          &value->surface.relief,
                          &value->surface.bevel,
@@ -1407,7 +1505,6 @@ static gboolean read_appearance(XrmDatabase db, const RrInstance *inst,
     g_free(bcname);
     g_free(ctoname);
     g_free(cname);
-    g_free(rclass);
     return ret;
 }
 
@@ -1461,8 +1558,7 @@ static RrPixel32* read_c_image(gint width, gint height, const guint8 *data)
     return im;
 }
 
-static void read_button_styles(XrmDatabase db, const RrInstance *inst, 
-                               gchar *path,
+static void read_button_styles(RrThemeDb *db, const RrInstance *inst, 
                                const RrTheme *theme, RrButton *btn, 
                                const gchar *btnname,
                                struct fallbacks *fbs,
@@ -1473,13 +1569,13 @@ static void read_button_styles(XrmDatabase db, const RrInstance *inst,
     gboolean userdef = TRUE;
 
     g_snprintf(name, 128, "%s.xbm", btnname);
-    if (!read_mask(inst, path, name, &btn->unpressed_mask) && normal_mask)
+    if (!read_mask(db, inst, name, &btn->unpressed_mask) && normal_mask)
     {
         btn->unpressed_mask = RrPixmapMaskNew(inst, 6, 6, (gchar*)normal_mask);
         userdef = FALSE;
     }
     g_snprintf(name, 128, "%s_toggled.xbm", btnname);
-    if (toggled_mask && !read_mask(inst, path, name, &btn->unpressed_toggled_mask))
+    if (toggled_mask && !read_mask(db, inst, name, &btn->unpressed_toggled_mask))
     {
         if (userdef)
             btn->unpressed_toggled_mask = RrPixmapMaskCopy(btn->unpressed_mask);
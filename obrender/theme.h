@@ -185,6 +185,27 @@ RrTheme* RrThemeNew(const RrInstance *inst, const gchar *theme,
                     RrFont *active_osd_font, RrFont *inactive_osd_font);
 void RrThemeFree(RrTheme *theme);
 
+/*! The parts of a theme's look that can change when it is loaded again */
+typedef enum {
+    RR_THEME_SAME       = 0,
+    /*! The sizes that window frames are laid out with */
+    RR_THEME_FRAME_SIZE = 1 << 0,
+    /*! How window frames are drawn, at the same sizes */
+    RR_THEME_FRAME_LOOK = 1 << 1,
+    /*! How menus are laid out or drawn */
+    RR_THEME_MENU       = 1 << 2,
+    /*! How on-screen displays like popups, prompts and the dock are laid out
+      or drawn */
+    RR_THEME_OSD        = 1 << 3
+} RrThemeChanges;
+
+/*! Compares what two themes look like, field by field, so that things drawn
+  with the old theme only need to be drawn again when they would look
+  different with the new one.  Fonts, colors and masks are compared by their
+  values, as every theme opens its own. */
+RrThemeChanges RrThemeDiff(const RrTheme *old_theme,
+                           const RrTheme *new_theme);
+
 G_END_DECLS
 
 #endif
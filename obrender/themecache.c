@@ -0,0 +1,699 @@
+/* -*- indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*-
+
+   themecache.c for the Openbox window manager
+   Copyright (c) 2026        Openbox developers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   See the COPYING file for a copy of the GNU General Public License.
+*/
+
+#include "themecache.h"
+#include "color.h"
+#include "mask.h"
+#include "obt/paths.h"
+
+#include <X11/Xlib.h>
+#include <X11/Xresource.h>
+#include <ctype.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#  include <sys/stat.h>
+#endif
+#ifdef HAVE_SYS_TYPES_H
+#  include <sys/types.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#  include <string.h>
+#endif
+
+#define THEME_CACHE_MAGIC   0x6854624f /* "ObTh" */
+#define THEME_CACHE_VERSION 2
+
+/* A snapshot starts with a header, which is followed by its records.  Each
+   record is a key and a value, which are both padded out to a multiple of 4
+   bytes.  The snapshots are only read on the machine that wrote them, so
+   they are in native byte order. */
+typedef struct _RrThemeCacheHeader {
+    guint32 magic;
+    guint32 version;
+    guint32 records;
+    guint32 pad;
+} RrThemeCacheHeader;
+
+typedef enum {
+    /*! A file that the theme was read from, or looked for.  The key is its
+      path, and the value is its RrThemeCacheStamp, or empty if it didn't
+      exist */
+    RECORD_FILE,
+    /*! The same as RECORD_FILE, for the theme's themerc.  The files that
+      the themerc pulls in with #include are RECORD_FILEs */
+    RECORD_THEMERC,
+    /*! The key is a resource name, and the value is its string with the
+      terminating nul, or empty if it isn't set */
+    RECORD_RESOURCE,
+    /*! The key is a resource name, and the value is the color parsed from
+      it, as a guint32 with COLOR_VALID set, or empty if it isn't a color */
+    RECORD_COLOR,
+    /*! The key is the name of an .xbm file, and the value is an
+      RrThemeCacheMask followed by its bits, or empty if there isn't one */
+    RECORD_MASK
+} RrThemeCacheRecordType;
+
+typedef struct _RrThemeCacheRecord {
+    guint32 type;
+    guint32 key_len;
+    guint32 value_len;
+} RrThemeCacheRecord;
+
+typedef struct _RrThemeCacheStamp {
+    gint64 mtime;
+    /*! The part of the modification time under a second, where the system
+      keeps it, so that quick edits which keep a file's size are seen */
+    gint64 mtime_nsec;
+    gint64 size;
+} RrThemeCacheStamp;
+
+/*! The start of a mask, followed by its bits laid out the way
+  XReadBitmapFileData gives them */
+typedef struct _RrThemeCacheMask {
+    guint32 width;
+    guint32 height;
+} RrThemeCacheMask;
+
+#define SPACE(len) ((((gsize)(len)) + 3) & ~(gsize)3)
+#define MASK_BYTES(w, h) (((gsize)(w) + 7) / 8 * (h))
+#define COLOR_VALID 0x1000000
+/*! How deep #include lines in a themerc are followed */
+#define MAX_INCLUDE_DEPTH 8
+
+typedef struct _RrThemeDbFile {
+    const gchar *path;
+    gboolean themerc;
+    gboolean exists;
+    RrThemeCacheStamp stamp;
+} RrThemeDbFile;
+
+struct _RrThemeDb {
+    /*! Where the theme's snapshot is saved, or NULL if there is no cache
+      directory */
+    gchar *cache_file;
+    /*! The snapshot that the theme was opened from, if any.  The strings
+      and masks found in it point into here. */
+    gpointer map;
+    gsize map_len;
+
+    /*! The RrThemeDbFiles that the theme depends on */
+    GArray *files;
+    /*! The path of the themerc, one of the files */
+    const gchar *themerc;
+    /*! The directory holding the themerc */
+    gchar *dir;
+    /*! The parsed themerc, which is NULL until something isn't found in the
+      snapshot */
+    XrmDatabase xrm;
+    gboolean xrm_failed;
+
+    /*! Maps resource names to strings */
+    GHashTable *resources;
+    /*! Maps resource names to colors, stored like RECORD_COLOR */
+    GHashTable *colors;
+    /*! Maps .xbm file names to RrThemeCacheMasks */
+    GHashTable *masks;
+
+    /*! Holds the strings that were not found in the snapshot */
+    GStringChunk *strings;
+    /*! Holds the masks that were not found in the snapshot */
+    GPtrArray *blobs;
+    /*! Set when something that isn't in the snapshot was read */
+    gboolean dirty;
+};
+
+static gpointer make_dir(gpointer data)
+{
+    ObtPaths *p;
+    gchar *dir;
+
+    p = obt_paths_new();
+    dir = g_build_filename(obt_paths_cache_home(p), "openbox", "themes",
+                           NULL);
+    obt_paths_unref(p);
+
+    if (!obt_paths_mkdir_path(dir, 0700)) {
+        g_free(dir);
+        dir = NULL;
+    }
+    return dir;
+}
+
+/*! Returns the name of a snapshot's file, or NULL if there is no cache
+  directory */
+static gchar* cache_file(const gchar *key)
+{
+    static GOnce dir_once = G_ONCE_INIT;
+    const gchar *dir;
+    gchar *sum, *file;
+
+    if (!(dir = g_once(&dir_once, make_dir, NULL)))
+        return NULL;
+
+    sum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+    file = g_build_filename(dir, sum, NULL);
+    g_free(sum);
+    return file;
+}
+
+/*! Returns the places to look for a theme's themerc, in order */
+static GSList* themerc_paths(const gchar *name)
+{
+    GSList *paths = NULL, *it;
+
+    if (name[0] == '/') {
+        paths = g_slist_append(paths, g_build_filename(name, "openbox-3",
+                                                       "themerc", NULL));
+    } else {
+        ObtPaths *p;
+
+        p = obt_paths_new();
+
+        /* XXX backwards compatibility, remove me sometime later */
+        paths = g_slist_append(paths,
+                               g_build_filename(g_get_home_dir(), ".themes",
+                                                name, "openbox-3", "themerc",
+                                                NULL));
+
+        for (it = obt_paths_data_dirs(p); it; it = g_slist_next(it))
+            paths = g_slist_append(paths,
+                                   g_build_filename(it->data, "themes", name,
+                                                    "openbox-3", "themerc",
+                                                    NULL));
+
+        obt_paths_unref(p);
+    }
+
+    paths = g_slist_append(paths, g_build_filename(name, "themerc", NULL));
+    return paths;
+}
+
+static void get_stamp(const struct stat *st, RrThemeCacheStamp *stamp)
+{
+    stamp->mtime = st->st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+    stamp->mtime_nsec = st->st_mtim.tv_nsec;
+#else
+    stamp->mtime_nsec = 0;
+#endif
+    stamp->size = st->st_size;
+}
+
+/*! Adds a file that the theme depends on, as it is right now */
+static RrThemeDbFile* add_file(RrThemeDb *db, const gchar *path)
+{
+    RrThemeDbFile f;
+    struct stat st;
+
+    f.path = g_string_chunk_insert(db->strings, path);
+    f.themerc = FALSE;
+    f.exists = stat(path, &st) == 0;
+    if (f.exists)
+        get_stamp(&st, &f.stamp);
+    else
+        memset(&f.stamp, 0, sizeof(f.stamp));
+    g_array_append_val(db->files, f);
+
+    db->dirty = TRUE;
+    return &g_array_index(db->files, RrThemeDbFile, db->files->len - 1);
+}
+
+/*! Adds the files that Xrm pulls in with #include lines in the file at
+  path, and the ones they include in turn.  Their names are relative to the
+  file that includes them. */
+static void add_includes(RrThemeDb *db, const gchar *path, gint depth)
+{
+    gchar *contents, **lines, **it, *dir;
+
+    if (depth > MAX_INCLUDE_DEPTH ||
+        !g_file_get_contents(path, &contents, NULL, NULL))
+        return;
+
+    dir = g_path_get_dirname(path);
+    lines = g_strsplit(contents, "\n", -1);
+    for (it = lines; *it; ++it) {
+        gchar *p = *it, *end, *inc;
+
+        while (*p == ' ' || *p == '\t') ++p;
+        if (strncmp(p, "#include", 8)) continue;
+        p += 8;
+        while (*p == ' ' || *p == '\t') ++p;
+        if (*p++ != '"' || !(end = strchr(p, '"'))) continue;
+        *end = '\0';
+
+        inc = g_path_is_absolute(p) ?
+            g_strdup(p) : g_build_filename(dir, p, NULL);
+        if (add_file(db, inc)->exists)
+            add_includes(db, inc, depth + 1);
+        g_free(inc);
+    }
+    g_strfreev(lines);
+    g_free(dir);
+    g_free(contents);
+}
+
+static void find_themerc(RrThemeDb *db, const gchar *path)
+{
+    RrThemeDbFile *f;
+
+    f = add_file(db, path);
+    if (f->exists && (db->xrm = XrmGetFileDatabase(path))) {
+        f->themerc = TRUE;
+        db->themerc = f->path;
+        /* edits to included files change the theme too */
+        add_includes(db, path, 1);
+    }
+}
+
+#ifdef HAVE_SYS_MMAN_H
+
+/*! Adds a file from the snapshot, if it hasn't changed since */
+static gboolean snapshot_file(RrThemeDb *db, const gchar *path,
+                              gboolean themerc, gconstpointer value,
+                              gsize len)
+{
+    RrThemeDbFile f;
+    RrThemeCacheStamp now;
+    struct stat st;
+
+    f.path = path;
+    f.themerc = themerc;
+    f.exists = stat(path, &st) == 0;
+    if (len == 0) {
+        if (f.exists || themerc) return FALSE;
+        memset(&f.stamp, 0, sizeof(f.stamp));
+    }
+    else {
+        if (!f.exists || len != sizeof(f.stamp)) return FALSE;
+        memcpy(&f.stamp, value, sizeof(f.stamp));
+        get_stamp(&st, &now);
+        if (f.stamp.mtime != now.mtime ||
+            f.stamp.mtime_nsec != now.mtime_nsec ||
+            f.stamp.size != now.size)
+            return FALSE;
+    }
+    g_array_append_val(db->files, f);
+
+    if (themerc)
+        db->themerc = path;
+    return TRUE;
+}
+
+/*! Reads the record at *p and moves *p past it */
+static gboolean snapshot_record(RrThemeDb *db, guchar **p,
+                                const guchar *end)
+{
+    RrThemeCacheRecord rec;
+    const RrThemeCacheMask *m;
+    gchar *key;
+    guchar *value;
+    guint32 rgb;
+
+    if ((gsize)(end - *p) < sizeof(rec))
+        return FALSE;
+    memcpy(&rec, *p, sizeof(rec));
+    *p += sizeof(rec);
+
+    if (rec.key_len == 0 ||
+        (gsize)(end - *p) < SPACE(rec.key_len) + SPACE(rec.value_len))
+        return FALSE;
+    key = (gchar*)*p;
+    value = *p + SPACE(rec.key_len);
+    *p = value + SPACE(rec.value_len);
+    if (key[rec.key_len - 1] != '\0')
+        return FALSE;
+
+    switch (rec.type) {
+    case RECORD_FILE:
+    case RECORD_THEMERC:
+        return snapshot_file(db, key, rec.type == RECORD_THEMERC,
+                             value, rec.value_len);
+    case RECORD_RESOURCE:
+        if (rec.value_len && value[rec.value_len - 1] != '\0')
+            return FALSE;
+        g_hash_table_insert(db->resources, key,
+                            rec.value_len ? value : NULL);
+        return TRUE;
+    case RECORD_COLOR:
+        if (rec.value_len != 0 && rec.value_len != sizeof(rgb))
+            return FALSE;
+        rgb = 0;
+        if (rec.value_len)
+            memcpy(&rgb, value, sizeof(rgb));
+        g_hash_table_insert(db->colors, key, GUINT_TO_POINTER(rgb));
+        return TRUE;
+    case RECORD_MASK:
+        m = (const RrThemeCacheMask*)value;
+        if (rec.value_len &&
+            (rec.value_len < sizeof(*m) ||
+             m->width > G_MAXUINT16 || m->height > G_MAXUINT16 ||
+             rec.value_len != sizeof(*m) + MASK_BYTES(m->width, m->height)))
+            return FALSE;
+        g_hash_table_insert(db->masks, key,
+                            rec.value_len ? value : NULL);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*! Opens the theme from its snapshot, if there is one and none of the
+  theme's files have changed since it was saved */
+static gboolean snapshot_load(RrThemeDb *db)
+{
+    const RrThemeCacheHeader *head;
+    struct stat st;
+    guchar *p, *end;
+    gboolean ok;
+    guint32 i;
+    gint fd;
+
+    if ((fd = open(db->cache_file, O_RDONLY)) < 0)
+        return FALSE;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*head)) {
+        close(fd);
+        return FALSE;
+    }
+
+    /* the theme loader changes the strings in place, so the map is private
+       and writable */
+    db->map_len = st.st_size;
+    db->map = mmap(NULL, db->map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                   fd, 0);
+    close(fd);
+    if (db->map == MAP_FAILED) {
+        db->map = NULL;
+        return FALSE;
+    }
+
+    head = db->map;
+    p = (guchar*)(head + 1);
+    end = (guchar*)db->map + db->map_len;
+    ok = head->magic == THEME_CACHE_MAGIC &&
+        head->version == THEME_CACHE_VERSION;
+    for (i = 0; ok && i < head->records; ++i)
+        ok = snapshot_record(db, &p, end);
+    ok = ok && p == end && db->themerc != NULL;
+
+    if (!ok) {
+        /* forget everything that came from it */
+        g_array_set_size(db->files, 0);
+        g_hash_table_remove_all(db->resources);
+        g_hash_table_remove_all(db->colors);
+        g_hash_table_remove_all(db->masks);
+        db->themerc = NULL;
+        munmap(db->map, db->map_len);
+        db->map = NULL;
+    }
+    return ok;
+}
+
+static void put_record(GByteArray *out, RrThemeCacheRecordType type,
+                       const gchar *key, gconstpointer value, gsize len)
+{
+    static const guint8 zeros[4] = { 0, 0, 0, 0 };
+    RrThemeCacheRecord rec;
+
+    rec.type = type;
+    rec.key_len = strlen(key) + 1;
+    rec.value_len = len;
+    g_byte_array_append(out, (const guint8*)&rec, sizeof(rec));
+    g_byte_array_append(out, (const guint8*)key, rec.key_len);
+    g_byte_array_append(out, zeros, SPACE(rec.key_len) - rec.key_len);
+    if (len) {
+        g_byte_array_append(out, value, len);
+        g_byte_array_append(out, zeros, SPACE(len) - len);
+    }
+}
+
+static void snapshot_save(RrThemeDb *db)
+{
+    RrThemeCacheHeader head;
+    GByteArray *out;
+    GHashTableIter it;
+    gpointer key, value;
+    gchar *tmp;
+    gboolean ok;
+    guint i;
+    gint fd;
+
+    memset(&head, 0, sizeof(head));
+    head.magic = THEME_CACHE_MAGIC;
+    head.version = THEME_CACHE_VERSION;
+    head.records = db->files->len +
+        g_hash_table_size(db->resources) +
+        g_hash_table_size(db->colors) +
+        g_hash_table_size(db->masks);
+
+    out = g_byte_array_new();
+    g_byte_array_append(out, (const guint8*)&head, sizeof(head));
+
+    for (i = 0; i < db->files->len; ++i) {
+        const RrThemeDbFile *f = &g_array_index(db->files, RrThemeDbFile, i);
+
+        put_record(out, f->themerc ? RECORD_THEMERC : RECORD_FILE, f->path,
+                   &f->stamp, f->exists ? sizeof(f->stamp) : 0);
+    }
+
+    g_hash_table_iter_init(&it, db->resources);
+    while (g_hash_table_iter_next(&it, &key, &value))
+        put_record(out, RECORD_RESOURCE, key, value,
+                   value ? strlen(value) + 1 : 0);
+
+    g_hash_table_iter_init(&it, db->colors);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        guint32 rgb = GPOINTER_TO_UINT(value);
+
+        put_record(out, RECORD_COLOR, key, &rgb, rgb ? sizeof(rgb) : 0);
+    }
+
+    g_hash_table_iter_init(&it, db->masks);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        const RrThemeCacheMask *m = value;
+
+        put_record(out, RECORD_MASK, key, m,
+                   m ? sizeof(*m) + MASK_BYTES(m->width, m->height) : 0);
+    }
+
+    /* write the whole file under another name and then move it into place,
+       so that nobody ever maps half of it */
+    tmp = g_strconcat(db->cache_file, ".XXXXXX", NULL);
+    if ((fd = g_mkstemp(tmp)) >= 0) {
+        ok = write(fd, out->data, out->len) == (gssize)out->len;
+        ok = (close(fd) == 0) && ok;
+        if (!ok || rename(tmp, db->cache_file) < 0)
+            unlink(tmp);
+    }
+    g_free(tmp);
+    g_byte_array_free(out, TRUE);
+}
+
+#else
+
+static gboolean snapshot_load(RrThemeDb *db)
+{
+    return FALSE;
+}
+
+static void snapshot_save(RrThemeDb *db)
+{
+}
+
+#endif
+
+static void db_free(RrThemeDb *db)
+{
+    g_hash_table_destroy(db->masks);
+    g_hash_table_destroy(db->colors);
+    g_hash_table_destroy(db->resources);
+    g_ptr_array_unref(db->blobs);
+    g_string_chunk_free(db->strings);
+    g_array_free(db->files, TRUE);
+    if (db->xrm) XrmDestroyDatabase(db->xrm);
+#ifdef HAVE_SYS_MMAN_H
+    if (db->map) munmap(db->map, db->map_len);
+#endif
+    g_free(db->dir);
+    g_free(db->cache_file);
+    g_slice_free(RrThemeDb, db);
+}
+
+RrThemeDb* RrThemeDbOpen(const gchar *name)
+{
+    RrThemeDb *db;
+    GSList *paths, *it;
+    GString *key;
+
+    db = g_slice_new0(RrThemeDb);
+    db->files = g_array_new(FALSE, FALSE, sizeof(RrThemeDbFile));
+    db->resources = g_hash_table_new(g_str_hash, g_str_equal);
+    db->colors = g_hash_table_new(g_str_hash, g_str_equal);
+    db->masks = g_hash_table_new(g_str_hash, g_str_equal);
+    db->strings = g_string_chunk_new(1024);
+    db->blobs = g_ptr_array_new_with_free_func(g_free);
+
+    /* where the theme is found depends on the environment, so the snapshot
+       belongs to the list of places it is looked for */
+    paths = themerc_paths(name);
+    key = g_string_new(NULL);
+    for (it = paths; it; it = g_slist_next(it)) {
+        g_string_append(key, it->data);
+        g_string_append_c(key, '\n');
+    }
+    db->cache_file = cache_file(key->str);
+    g_string_free(key, TRUE);
+
+    if (!db->cache_file || !snapshot_load(db))
+        for (it = paths; it && !db->themerc; it = g_slist_next(it))
+            find_themerc(db, it->data);
+    g_slist_free_full(paths, g_free);
+
+    if (!db->themerc) {
+        db_free(db);
+        return NULL;
+    }
+    db->dir = g_path_get_dirname(db->themerc);
+    return db;
+}
+
+void RrThemeDbClose(RrThemeDb *db)
+{
+    if (db->dirty && db->cache_file)
+        snapshot_save(db);
+    db_free(db);
+}
+
+static gchar *create_class_name(const gchar *rname)
+{
+    gchar *rclass = g_strdup(rname);
+    gchar *p = rclass;
+
+    while (TRUE) {
+        *p = toupper(*p);
+        p = strchr(p+1, '.');
+        if (p == NULL) break;
+        ++p;
+        if (*p == '\0') break;
+    }
+    return rclass;
+}
+
+gchar* RrThemeDbResource(RrThemeDb *db, const gchar *rname)
+{
+    gpointer value;
+
+    if (!g_hash_table_lookup_extended(db->resources, rname, NULL, &value)) {
+        gchar *rclass, *rettype;
+        XrmValue retvalue;
+
+        /* the themerc is only parsed when the snapshot doesn't know */
+        if (!db->xrm && !db->xrm_failed)
+            if (!(db->xrm = XrmGetFileDatabase(db->themerc)))
+                db->xrm_failed = TRUE;
+
+        value = NULL;
+        if (db->xrm) {
+            rclass = create_class_name(rname);
+            if (XrmGetResource(db->xrm, rname, rclass, &rettype,
+                               &retvalue) && retvalue.addr != NULL)
+                value = g_string_chunk_insert(db->strings, retvalue.addr);
+            g_free(rclass);
+        }
+        g_hash_table_insert(db->resources,
+                            g_string_chunk_insert(db->strings, rname),
+                            value);
+        db->dirty = TRUE;
+    }
+    return value;
+}
+
+gboolean RrThemeDbColor(RrThemeDb *db, const RrInstance *inst,
+                        const gchar *rname, RrColor **value)
+{
+    gpointer rgb;
+    gchar *str;
+    RrColor *c;
+    guint32 v;
+
+    if (!g_hash_table_lookup_extended(db->colors, rname, NULL, &rgb)) {
+        c = NULL;
+        if ((str = RrThemeDbResource(db, rname))) {
+            g_strstrip(str);
+            c = RrColorParse(inst, str);
+        }
+        g_hash_table_insert(db->colors,
+                            g_string_chunk_insert(db->strings, rname),
+                            GUINT_TO_POINTER(c ? COLOR_VALID | c->r << 16 |
+                                             c->g << 8 | c->b : 0));
+        db->dirty = TRUE;
+
+        if (c) *value = c;
+        return c != NULL;
+    }
+
+    v = GPOINTER_TO_UINT(rgb);
+    if (!(v & COLOR_VALID))
+        return FALSE;
+    *value = RrColorNew(inst, (v >> 16) & 0xFF, (v >> 8) & 0xFF, v & 0xFF);
+    return TRUE;
+}
+
+gboolean RrThemeDbMask(RrThemeDb *db, const RrInstance *inst,
+                       const gchar *maskname, RrPixmapMask **value)
+{
+    gpointer found;
+    RrThemeCacheMask *m;
+
+    if (g_hash_table_lookup_extended(db->masks, maskname, NULL, &found))
+        m = found;
+    else {
+        gchar *s;
+        gint hx, hy; /* ignored */
+        guint w, h;
+        guchar *b;
+
+        m = NULL;
+        s = g_build_filename(db->dir, maskname, NULL);
+        add_file(db, s);
+        if (XReadBitmapFileData(s, &w, &h, &b, &hx, &hy) == BitmapSuccess) {
+            m = g_malloc(sizeof(*m) + MASK_BYTES(w, h));
+            m->width = w;
+            m->height = h;
+            memcpy(m + 1, b, MASK_BYTES(w, h));
+            g_ptr_array_add(db->blobs, m);
+            XFree(b);
+        }
+        g_free(s);
+
+        g_hash_table_insert(db->masks,
+                            g_string_chunk_insert(db->strings, maskname), m);
+    }
+
+    if (!m)
+        return FALSE;
+    *value = RrPixmapMaskNew(inst, m->width, m->height, (gchar*)(m + 1));
+    return TRUE;
+}
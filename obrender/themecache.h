@@ -0,0 +1,62 @@
+/* -*- indent-tabs-mode: nil; tab-width: 4; c-basic-offset: 4; -*-
+
+   themecache.h for the Openbox window manager
+   Copyright (c) 2026        Openbox developers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   See the COPYING file for a copy of the GNU General Public License.
+*/
+
+#ifndef __render_themecache_h
+#define __render_themecache_h
+
+#include "render.h"
+
+#include <glib.h>
+
+/* Where RrThemeNew() gets a theme's resources from.
+
+   The first time a theme is loaded, its themerc is parsed with Xrm and its
+   masks are read from their .xbm files, and every answer that the theme
+   loader gets is remembered, along with the colors parsed from them.  That
+   is written to a compiled snapshot under the user's cache directory when
+   the theme is closed.  Later loads map the snapshot and answer from it,
+   without parsing anything, while all of the theme's files keep the same
+   modification times and sizes.  A question that the snapshot has no answer
+   for goes to the theme's files, and the snapshot is written again with the
+   new answer. */
+
+typedef struct _RrThemeDb RrThemeDb;
+
+/*! Finds a theme by name, or by the path to its directory.
+  @return NULL if the theme can't be found */
+RrThemeDb* RrThemeDbOpen(const gchar *name);
+
+/*! Closes the theme, saving its snapshot if anything new was read */
+void RrThemeDbClose(RrThemeDb *db);
+
+/*! Returns the value of a resource in the theme, or NULL if it isn't set.
+  The string may be changed in place, and is valid until the theme is
+  closed. */
+gchar* RrThemeDbResource(RrThemeDb *db, const gchar *rname);
+
+/*! Reads a color resource from the theme.
+  @return FALSE if the resource isn't set or isn't a valid color */
+gboolean RrThemeDbColor(RrThemeDb *db, const RrInstance *inst,
+                        const gchar *rname, RrColor **value);
+
+/*! Reads a mask from an .xbm file in the theme's directory.
+  @return FALSE if the file doesn't exist or isn't a valid bitmap */
+gboolean RrThemeDbMask(RrThemeDb *db, const RrInstance *inst,
+                       const gchar *maskname, RrPixmapMask **value);
+
+#endif
@@ -38,8 +38,6 @@ extern void xqueue_destroy(void);
 
 Display* obt_display = NULL;
 
-gboolean obt_display_error_occured = FALSE;
-
 gboolean obt_display_extension_xkb       = FALSE;
 gint     obt_display_extension_xkb_basep;
 gboolean obt_display_extension_shape     = FALSE;
@@ -51,9 +49,21 @@ gint     obt_display_extension_randr_basep;
 gboolean obt_display_extension_sync      = FALSE;
 gint     obt_display_extension_sync_basep;
 
+/*! A range of requests whose errors are ignored */
+typedef struct _ObtErrorTrap {
+    gulong start; /*!< The serial of the first request in the range */
+    gulong end;   /*!< The serial of the last request in the range */
+    gboolean open; /*!< Requests being made are still in the range */
+    gboolean error; /*!< An error occured for a request in the range */
+} ObtErrorTrap;
+
 static gint xerror_handler(Display *d, XErrorEvent *e);
 
-static gboolean xerror_ignore = FALSE;
+/* the ranges of requests whose errors are being ignored, with the newest at
+   the tail.  the newest range is kept until another one is made, so that
+   obt_display_error_occured() can answer for it */
+static GQueue xerror_traps = G_QUEUE_INIT;
+static ObtErrorTrap *xerror_open_trap = NULL;
 
 gboolean obt_display_open(const char *display_name)
 {
@@ -134,15 +144,37 @@ void obt_display_close(void)
         xqueue_destroy();
         XCloseDisplay(obt_display);
     }
+    while (!g_queue_is_empty(&xerror_traps))
+        g_slice_free(ObtErrorTrap, g_queue_pop_head(&xerror_traps));
+    xerror_open_trap = NULL;
+}
+
+/*! Finds the range of ignored requests that a request is in */
+static ObtErrorTrap* find_error_trap(gulong serial)
+{
+    GList *it;
+
+    for (it = xerror_traps.head; it; it = g_list_next(it)) {
+        ObtErrorTrap *t = it->data;
+        if (serial >= t->start && (t->open || serial <= t->end))
+            return t;
+    }
+    return NULL;
 }
 
 static gint xerror_handler(Display *d, XErrorEvent *e)
 {
+    ObtErrorTrap *t;
 #ifdef DEBUG
     gchar errtxt[128];
+#endif
+
+    t = find_error_trap(e->serial);
+    if (t) t->error = TRUE;
 
+#ifdef DEBUG
     XGetErrorText(d, e->error_code, errtxt, 127);
-    if (!xerror_ignore) {
+    if (!t) {
         if (e->error_code == BadWindow)
             /*g_debug(_("X Error: %s\n"), errtxt)*/;
         else
@@ -150,16 +182,62 @@ static gint xerror_handler(Display *d, XErrorEvent *e)
     } else
         g_debug("Ignoring XError code %d '%s'", e->error_code, errtxt);
 #else
-    (void)d; (void)e;
+    (void)d;
 #endif
 
-    obt_display_error_occured = TRUE;
     return 0;
 }
 
+/*! Forgets the ranges of requests that the server has finished with, except
+  for the newest one */
+static void prune_error_traps(void)
+{
+    gulong processed;
+
+    processed = LastKnownRequestProcessed(obt_display);
+    while (xerror_traps.length > 1) {
+        ObtErrorTrap *t = g_queue_peek_head(&xerror_traps);
+        if (t->open || t->end > processed) break;
+        g_slice_free(ObtErrorTrap, g_queue_pop_head(&xerror_traps));
+    }
+}
+
 void obt_display_ignore_errors(gboolean ignore)
 {
-    XSync(obt_display, FALSE);
-    xerror_ignore = ignore;
-    if (ignore) obt_display_error_occured = FALSE;
+    if (xerror_open_trap) {
+        /* the range ends with the last request that was made, and is empty
+           if none were made */
+        xerror_open_trap->end = NextRequest(obt_display) - 1;
+        xerror_open_trap->open = FALSE;
+        xerror_open_trap = NULL;
+    }
+
+    if (ignore) {
+        ObtErrorTrap *t;
+
+        prune_error_traps();
+
+        t = g_slice_new(ObtErrorTrap);
+        t->start = NextRequest(obt_display);
+        t->end = 0;
+        t->open = TRUE;
+        t->error = FALSE;
+        g_queue_push_tail(&xerror_traps, t);
+        xerror_open_trap = t;
+    }
+}
+
+gboolean obt_display_error_occured(void)
+{
+    ObtErrorTrap *t;
+
+    if (!(t = g_queue_peek_tail(&xerror_traps)))
+        return FALSE;
+
+    g_assert(!t->open); /* the range has to be closed first */
+
+    /* wait for errors only if the server hasn't replied past the range */
+    if (t->end >= t->start && LastKnownRequestProcessed(obt_display) < t->end)
+        XSync(obt_display, FALSE);
+    return t->error;
 }
@@ -41,8 +41,6 @@
 
 G_BEGIN_DECLS
 
-extern gboolean obt_display_error_occured;
-
 extern gboolean obt_display_extension_xkb;
 extern gint     obt_display_extension_xkb_basep;
 extern gboolean obt_display_extension_shape;
@@ -61,7 +59,14 @@ extern Display* obt_display;
 gboolean obt_display_open(const char *display_name);
 void     obt_display_close(void);
 
+/*! Starts or stops ignoring X errors.  The errors are matched to the
+  requests that caused them by their serial numbers, so this does not wait
+  for the X server. */
 void     obt_display_ignore_errors(gboolean ignore);
+/*! Returns TRUE if any of the requests made while errors were last being
+  ignored caused an error.  This waits for the X server to process those
+  requests if it hasn't yet. */
+gboolean obt_display_error_occured(void);
 
 #define  obt_root(screen) (RootWindow(obt_display, screen))
 
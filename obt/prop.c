@@ -21,18 +21,83 @@
 #include "obt/display.h"
 
 #include <X11/Xatom.h>
+#ifdef USE_XCB
+#  include <X11/Xlib-xcb.h>
+#  include <stdlib.h>
+#endif
 #ifdef HAVE_STRING_H
 #  include <string.h>
 #endif
 
+struct _ObtPropCookie {
+    Window win;
+    Atom prop;
+    Atom type;
+#ifdef USE_XCB
+    xcb_get_property_cookie_t xcb;
+#endif
+};
+
+/*! A property's value as read from the X server.  The items are packed
+  at the size given by their format. */
+typedef struct {
+    Atom type;
+    gint format;
+    gulong nitems;
+    guchar *data;
+    gpointer reply; /* the memory that holds data */
+} PropValue;
+
+/*! A property's value kept for a window */
+typedef struct {
+    PropValue value;
+    gboolean stale; /*!< The property has changed since it was read */
+} CachedProp;
+
+/* values bigger than this, like icons, are not kept */
+#define CACHE_MAX_BYTES 4096
+
+#define XID_KEY(x) (GSIZE_TO_POINTER((gsize)(x)))
+
 Atom prop_atoms[OBT_PROP_NUM_ATOMS];
 gboolean prop_started = FALSE;
 
-#define CREATE_NAME(var, name) (prop_atoms[OBT_PROP_##var] = \
-                                XInternAtom((obt_display), (name), FALSE))
+/* requests made by obt_prop_prefetch() that haven't been read yet */
+static GSList *prefetched = NULL;
+
+/* the properties kept for windows, by window and then by atom */
+static GHashTable *prop_cache = NULL;
+
+static ObtPropCookie* take_prefetched(Window win, Atom prop);
+static void forget_value(Window win, Atom prop);
+
+/* the names of the atoms in prop_atoms, or NULL for the ones that are
+   constants instead of atoms */
+static const gchar *atom_names[OBT_PROP_NUM_ATOMS];
+
+#define CREATE_NAME(var, name) (atom_names[OBT_PROP_##var] = (name))
 #define CREATE(var) CREATE_NAME(var, #var)
 #define CREATE_(var) CREATE_NAME(var, "_" #var)
 
+static void intern_atoms(void)
+{
+    gchar *names[OBT_PROP_NUM_ATOMS];
+    Atom atoms[OBT_PROP_NUM_ATOMS];
+    gint i, n;
+
+    n = 0;
+    for (i = 0; i < OBT_PROP_NUM_ATOMS; ++i)
+        if (atom_names[i]) names[n++] = (gchar*)atom_names[i];
+
+    /* this sends all of the requests before waiting for any of the replies,
+       so it costs a single round trip */
+    XInternAtoms(obt_display, names, n, FALSE, atoms);
+
+    n = 0;
+    for (i = 0; i < OBT_PROP_NUM_ATOMS; ++i)
+        if (atom_names[i]) prop_atoms[i] = atoms[n++];
+}
+
 void obt_prop_startup(void)
 {
     if (prop_started) return;
@@ -200,6 +265,8 @@ void obt_prop_startup(void)
     CREATE_(OB_APP_GROUP_NAME);
     CREATE_(OB_APP_GROUP_CLASS);
     CREATE_(OB_APP_TYPE);
+
+    intern_atoms();
 }
 
 Atom obt_prop_atom(ObtPropAtom a)
@@ -209,109 +276,22 @@ Atom obt_prop_atom(ObtPropAtom a)
     return prop_atoms[a];
 }
 
-static gboolean get_prealloc(Window win, Atom prop, Atom type, gint size,
-                             guchar *data, gulong num)
-{
-    gboolean ret = FALSE;
-    gint res;
-    guchar *xdata = NULL;
-    Atom ret_type;
-    gint ret_size;
-    gulong ret_items, bytes_left;
-    glong num32 = 32 / size * num; /* num in 32-bit elements */
-
-    res = XGetWindowProperty(obt_display, win, prop, 0l, num32,
-                             FALSE, type, &ret_type, &ret_size,
-                             &ret_items, &bytes_left, &xdata);
-    if (res == Success && ret_items && xdata) {
-        if (ret_size == size && ret_items >= num) {
-            guint i;
-            for (i = 0; i < num; ++i)
-                switch (size) {
-                case 8:
-                    data[i] = xdata[i];
-                    break;
-                case 16:
-                    ((guint16*)data)[i] = ((gushort*)xdata)[i];
-                    break;
-                case 32:
-                    ((guint32*)data)[i] = ((gulong*)xdata)[i];
-                    break;
-                default:
-                    g_assert_not_reached(); /* unhandled size */
-                }
-            ret = TRUE;
-        }
-        XFree(xdata);
-    }
-    return ret;
-}
-
-static gboolean get_all(Window win, Atom prop, Atom type, gint size,
-                        guchar **data, guint *num)
-{
-    gboolean ret = FALSE;
-    gint res;
-    guchar *xdata = NULL;
-    Atom ret_type;
-    gint ret_size;
-    gulong ret_items, bytes_left;
-
-    res = XGetWindowProperty(obt_display, win, prop, 0l, G_MAXLONG,
-                             FALSE, type, &ret_type, &ret_size,
-                             &ret_items, &bytes_left, &xdata);
-    if (res == Success) {
-        if (ret_size == size && ret_items > 0) {
-            guint i;
-
-            *data = g_malloc(ret_items * (size / 8));
-            for (i = 0; i < ret_items; ++i)
-                switch (size) {
-                case 8:
-                    (*data)[i] = xdata[i];
-                    break;
-                case 16:
-                    ((guint16*)*data)[i] = ((gushort*)xdata)[i];
-                    break;
-                case 32:
-                    ((guint32*)*data)[i] = ((gulong*)xdata)[i];
-                    break;
-                default:
-                    g_assert_not_reached(); /* unhandled size */
-                }
-            *num = ret_items;
-            ret = TRUE;
-        }
-        XFree(xdata);
-    }
-    return ret;
-}
-
-/*! Get a text property from a window, and fill out the XTextProperty with it.
-  @param win The window to read the property from.
-  @param prop The atom of the property to read off the window.
-  @param tprop The XTextProperty to fill out.
-  @param type 0 to get text of any type, or a value from
-    ObtPropTextType to restrict the value to a specific type.
-  @return TRUE if the text was read and validated against the @type, and FALSE
-    otherwise.
+/*! Checks the encoding of a text property against the type it must have.
+  @param type 0 to allow text of any type, or a value from ObtPropTextType.
 */
-static gboolean get_text_property(Window win, Atom prop,
-                                  XTextProperty *tprop, ObtPropTextType type)
+static gboolean text_type_ok(Atom encoding, ObtPropTextType type)
 {
-    if (!(XGetTextProperty(obt_display, win, tprop, prop) && tprop->nitems))
-        return FALSE;
     if (!type)
         return TRUE; /* no type checking */
     switch (type) {
     case OBT_PROP_TEXT_STRING:
     case OBT_PROP_TEXT_STRING_XPCS:
     case OBT_PROP_TEXT_STRING_NO_CC:
-        return tprop->encoding == OBT_PROP_ATOM(STRING);
+        return encoding == OBT_PROP_ATOM(STRING);
     case OBT_PROP_TEXT_COMPOUND_TEXT:
-        return tprop->encoding == OBT_PROP_ATOM(COMPOUND_TEXT);
+        return encoding == OBT_PROP_ATOM(COMPOUND_TEXT);
     case OBT_PROP_TEXT_UTF8_STRING:
-        return tprop->encoding == OBT_PROP_ATOM(UTF8_STRING);
+        return encoding == OBT_PROP_ATOM(UTF8_STRING);
     default:
         g_assert_not_reached();
         return FALSE;
@@ -470,58 +450,445 @@ static void* convert_text_property(XTextProperty *tprop,
         return retlist;
 }
 
+ObtPropCookie* obt_prop_request(Window win, Atom prop, Atom type)
+{
+    ObtPropCookie *c;
+
+    c = g_slice_new(ObtPropCookie);
+    c->win = win;
+    c->prop = prop;
+    c->type = type;
+#ifdef USE_XCB
+    /* the length is in 32-bit units, and is kept small enough that the
+       server can turn it into bytes */
+    c->xcb = xcb_get_property(XGetXCBConnection(obt_display), FALSE,
+                              win, prop, type, 0, G_MAXUINT32 / 4);
+#endif
+    return c;
+}
+
+/*! Reads the reply for a request, and frees the request.  Without XCB the
+  property is read from the server now, in a round trip of its own.
+  @return FALSE if the server returned an error.  A property that doesn't
+    exist, or doesn't have the requested type, has no items.
+*/
+static gboolean get_reply(ObtPropCookie *c, PropValue *v)
+{
+    gboolean ok;
+#ifdef USE_XCB
+    xcb_get_property_reply_t *r;
+    xcb_generic_error_t *err = NULL;
+
+    r = xcb_get_property_reply(XGetXCBConnection(obt_display), c->xcb, &err);
+    free(err);
+    if ((ok = (r != NULL))) {
+        v->type = r->type;
+        v->format = r->format;
+        v->nitems = r->value_len;
+        v->data = xcb_get_property_value(r);
+        v->reply = r;
+    }
+#else
+    gint res;
+    gulong bytes_left;
+
+    v->data = NULL;
+    res = XGetWindowProperty(obt_display, c->win, c->prop, 0l, G_MAXLONG,
+                             FALSE, c->type, &v->type, &v->format,
+                             &v->nitems, &bytes_left, &v->data);
+    if ((ok = (res == Success))) {
+        if (v->format == 32 && v->data) {
+            /* Xlib gives 32-bit items as longs, so pack them down in place */
+            gulong i;
+            for (i = 0; i < v->nitems; ++i)
+                ((guint32*)v->data)[i] = ((gulong*)v->data)[i];
+        }
+        if (!v->data)
+            v->nitems = 0;
+        v->reply = v->data;
+    }
+#endif
+    if (ok && c->type != AnyPropertyType && v->type != c->type)
+        v->nitems = 0;
+    g_slice_free(ObtPropCookie, c);
+    return ok;
+}
+
+/*! Frees a value that was read from the server.  Values that come from the
+  cache don't have a reply to free. */
+static void free_reply(PropValue *v)
+{
+#ifdef USE_XCB
+    free(v->reply);
+#else
+    if (v->reply) XFree(v->reply);
+#endif
+}
+
+static gboolean value32(const PropValue *v, Atom type, guint32 *ret)
+{
+    if (v->format == 32 && v->nitems >= 1 &&
+        (type == AnyPropertyType || v->type == type))
+    {
+        *ret = ((guint32*)v->data)[0];
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static gboolean value_array32(const PropValue *v, Atom type, guint32 **ret,
+                              guint *nret)
+{
+    if (v->format == 32 && v->nitems > 0 &&
+        (type == AnyPropertyType || v->type == type))
+    {
+        *ret = g_new(guint32, v->nitems);
+        memcpy(*ret, v->data, v->nitems * sizeof(guint32));
+        *nret = v->nitems;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*! Converts the value of a text property to UTF-8, the same way as
+  convert_text_property().
+  @return NULL if the value isn't text of the given type
+*/
+static void* value_text(const PropValue *v, ObtPropTextType type, gint max)
+{
+    XTextProperty tprop;
+    void *ret;
+
+    if (!(v->format == 8 && v->nitems > 0 && text_type_ok(v->type, type)))
+        return NULL;
+
+    /* the last string has to be nul-terminated too */
+    tprop.value = g_malloc(v->nitems + 1);
+    memcpy(tprop.value, v->data, v->nitems);
+    tprop.value[v->nitems] = '\0';
+    tprop.encoding = v->type;
+    tprop.format = v->format;
+    tprop.nitems = v->nitems;
+
+    ret = convert_text_property(&tprop, type, max);
+    g_free(tprop.value);
+    return ret;
+}
+
+gboolean obt_prop_reply32(ObtPropCookie *cookie, guint32 *ret)
+{
+    PropValue v;
+    gboolean ok = FALSE;
+
+    if (get_reply(cookie, &v)) {
+        ok = value32(&v, AnyPropertyType, ret);
+        free_reply(&v);
+    }
+    return ok;
+}
+
+gboolean obt_prop_reply_array32(ObtPropCookie *cookie, guint32 **ret,
+                                guint *nret)
+{
+    PropValue v;
+    gboolean ok = FALSE;
+
+    if (get_reply(cookie, &v)) {
+        ok = value_array32(&v, AnyPropertyType, ret, nret);
+        free_reply(&v);
+    }
+    return ok;
+}
+
+gboolean obt_prop_reply_text(ObtPropCookie *cookie, ObtPropTextType type,
+                             gchar **ret_string)
+{
+    PropValue v;
+    gchar *str = NULL;
+
+    if (get_reply(cookie, &v)) {
+        str = (gchar*)value_text(&v, type, 1);
+        free_reply(&v);
+    }
+    if (str) *ret_string = str;
+    return str != NULL;
+}
+
+gboolean obt_prop_reply_array_text(ObtPropCookie *cookie,
+                                   ObtPropTextType type, gchar ***ret_strings)
+{
+    PropValue v;
+    gchar **strs = NULL;
+
+    if (get_reply(cookie, &v)) {
+        strs = (gchar**)value_text(&v, type, -1);
+        free_reply(&v);
+    }
+    if (strs) *ret_strings = strs;
+    return strs != NULL;
+}
+
+void obt_prop_reply_discard(ObtPropCookie *cookie)
+{
+#ifdef USE_XCB
+    xcb_discard_reply(XGetXCBConnection(obt_display), cookie->xcb.sequence);
+#endif
+    g_slice_free(ObtPropCookie, cookie);
+}
+
+void obt_prop_prefetch(Window win, const Atom *props, guint nprops)
+{
+    guint i;
+
+    /* the type is checked when each property is read */
+    for (i = 0; i < nprops; ++i)
+        prefetched = g_slist_prepend(
+            prefetched, obt_prop_request(win, props[i], AnyPropertyType));
+}
+
+void obt_prop_prefetch_done(Window win)
+{
+    GSList *it, *next;
+
+    for (it = prefetched; it; it = next) {
+        ObtPropCookie *c = it->data;
+
+        next = g_slist_next(it);
+        if (c->win == win) {
+            obt_prop_reply_discard(c);
+            prefetched = g_slist_delete_link(prefetched, it);
+        }
+    }
+}
+
+static ObtPropCookie* take_prefetched(Window win, Atom prop)
+{
+    GSList *it;
+
+    for (it = prefetched; it; it = g_slist_next(it)) {
+        ObtPropCookie *c = it->data;
+
+        if (c->win == win && c->prop == prop) {
+            prefetched = g_slist_delete_link(prefetched, it);
+            return c;
+        }
+    }
+    return NULL;
+}
+
+static void free_cached_prop(CachedProp *cp)
+{
+    g_free(cp->value.data);
+    g_slice_free(CachedProp, cp);
+}
+
+void obt_prop_cache_window(Window win)
+{
+    if (!prop_cache)
+        prop_cache = g_hash_table_new_full(
+            g_direct_hash, g_direct_equal, NULL,
+            (GDestroyNotify)g_hash_table_destroy);
+    if (!g_hash_table_lookup(prop_cache, XID_KEY(win)))
+        g_hash_table_insert(prop_cache, XID_KEY(win),
+                            g_hash_table_new_full(
+                                g_direct_hash, g_direct_equal, NULL,
+                                (GDestroyNotify)free_cached_prop));
+}
+
+void obt_prop_cache_forget(Window win)
+{
+    if (prop_cache)
+        g_hash_table_remove(prop_cache, XID_KEY(win));
+}
+
+/*! Returns the cached properties for a window, or NULL if the window's
+  properties are not being cached */
+static GHashTable* window_cache(Window win)
+{
+    return prop_cache ? g_hash_table_lookup(prop_cache, XID_KEY(win)) : NULL;
+}
+
+void obt_prop_cache_invalidate(Window win, Atom prop)
+{
+    GHashTable *props;
+    CachedProp *cp;
+
+    if ((props = window_cache(win)) &&
+        (cp = g_hash_table_lookup(props, XID_KEY(prop))))
+        cp->stale = TRUE;
+}
+
+/*! Keeps a value that was read from the server in a window's cache.
+  @return TRUE if the value is different than the one that was kept before
+*/
+static gboolean cache_store(GHashTable *props, Atom prop, const PropValue *v)
+{
+    CachedProp *cp;
+    gsize len;
+    gboolean changed;
+
+    cp = g_hash_table_lookup(props, XID_KEY(prop));
+    len = v->nitems * (v->format / 8);
+
+    if (len > CACHE_MAX_BYTES) {
+        /* too big to keep around, so it is read each time it's wanted */
+        if (cp) g_hash_table_remove(props, XID_KEY(prop));
+        return TRUE;
+    }
+
+    changed = (!cp ||
+               cp->value.type != v->type ||
+               cp->value.format != v->format ||
+               cp->value.nitems != v->nitems ||
+               (len && memcmp(cp->value.data, v->data, len)));
+
+    if (!cp) {
+        cp = g_slice_new(CachedProp);
+        g_hash_table_insert(props, XID_KEY(prop), cp);
+    }
+    else
+        g_free(cp->value.data);
+    cp->value = *v;
+    cp->value.data = g_malloc(len + 1);
+    if (len) memcpy(cp->value.data, v->data, len);
+    cp->value.reply = NULL;
+    cp->stale = FALSE;
+    return changed;
+}
+
+gboolean obt_prop_cache_refresh(Window win, const Atom *props, guint nprops)
+{
+    GHashTable *wprops;
+    ObtPropCookie **cookies;
+    gboolean changed;
+    guint i;
+
+    /* without a cache there's nothing to compare the values against */
+    if (!(wprops = window_cache(win))) return TRUE;
+
+    /* request all of the stale properties before reading any of them */
+    cookies = g_new(ObtPropCookie*, nprops);
+    for (i = 0; i < nprops; ++i) {
+        CachedProp *cp = g_hash_table_lookup(wprops, XID_KEY(props[i]));
+
+        if (cp && !cp->stale)
+            cookies[i] = NULL;
+        else if (!(cookies[i] = take_prefetched(win, props[i])))
+            cookies[i] = obt_prop_request(win, props[i], AnyPropertyType);
+    }
+
+    changed = FALSE;
+    for (i = 0; i < nprops; ++i)
+        if (cookies[i]) {
+            PropValue v;
+
+            if (get_reply(cookies[i], &v)) {
+                if (cache_store(wprops, props[i], &v))
+                    changed = TRUE;
+                free_reply(&v);
+            }
+            else
+                changed = TRUE;
+        }
+    g_free(cookies);
+    return changed;
+}
+
+/*! Reads a property for the obt_prop_get_* functions.  The value comes from
+  the cache if the window has one, or from a request made by
+  obt_prop_prefetch(), or else from the server.  It must be freed with
+  free_reply().
+  @return FALSE if the server returned an error
+*/
+static gboolean read_value(Window win, Atom prop, PropValue *v)
+{
+    GHashTable *props;
+    CachedProp *cp = NULL;
+    ObtPropCookie *c;
+
+    if ((props = window_cache(win)) &&
+        (cp = g_hash_table_lookup(props, XID_KEY(prop))) && !cp->stale)
+    {
+        *v = cp->value;
+        return TRUE;
+    }
+
+    if (!(c = take_prefetched(win, prop)))
+        c = obt_prop_request(win, prop, AnyPropertyType);
+    if (!get_reply(c, v))
+        return FALSE;
+    if (props)
+        cache_store(props, prop, v);
+    return TRUE;
+}
+
 gboolean obt_prop_get32(Window win, Atom prop, Atom type, guint32 *ret)
 {
-    return get_prealloc(win, prop, type, 32, (guchar*)ret, 1);
+    PropValue v;
+    gboolean ok = FALSE;
+
+    if (read_value(win, prop, &v)) {
+        ok = value32(&v, type, ret);
+        free_reply(&v);
+    }
+    return ok;
 }
 
 gboolean obt_prop_get_array32(Window win, Atom prop, Atom type, guint32 **ret,
                               guint *nret)
 {
-    return get_all(win, prop, type, 32, (guchar**)ret, nret);
+    PropValue v;
+    gboolean ok = FALSE;
+
+    if (read_value(win, prop, &v)) {
+        ok = value_array32(&v, type, ret, nret);
+        free_reply(&v);
+    }
+    return ok;
 }
 
 gboolean obt_prop_get_text(Window win, Atom prop, ObtPropTextType type,
                            gchar **ret_string)
 {
-    XTextProperty tprop;
-    gchar *str;
-    gboolean ret = FALSE;
-
-    if (get_text_property(win, prop, &tprop, type)) {
-        str = (gchar*)convert_text_property(&tprop, type, 1);
+    PropValue v;
+    gchar *str = NULL;
 
-        if (str) {
-            *ret_string = str;
-            ret = TRUE;
-        }
+    if (read_value(win, prop, &v)) {
+        str = (gchar*)value_text(&v, type, 1);
+        free_reply(&v);
     }
-    XFree(tprop.value);
-    return ret;
+    if (str) *ret_string = str;
+    return str != NULL;
 }
 
 gboolean obt_prop_get_array_text(Window win, Atom prop,
                                  ObtPropTextType type,
                                  gchar ***ret_strings)
 {
-    XTextProperty tprop;
-    gchar **strs;
-    gboolean ret = FALSE;
+    PropValue v;
+    gchar **strs = NULL;
 
-    if (get_text_property(win, prop, &tprop, type)) {
-        strs = (gchar**)convert_text_property(&tprop, type, -1);
-
-        if (strs) {
-            *ret_strings = strs;
-            ret = TRUE;
-        }
+    if (read_value(win, prop, &v)) {
+        strs = (gchar**)value_text(&v, type, -1);
+        free_reply(&v);
     }
-    XFree(tprop.value);
-    return ret;
+    if (strs) *ret_strings = strs;
+    return strs != NULL;
+}
+
+/*! A property that is changed has to be read from the server again */
+static void forget_value(Window win, Atom prop)
+{
+    ObtPropCookie *c;
+
+    if ((c = take_prefetched(win, prop)))
+        obt_prop_reply_discard(c);
+    obt_prop_cache_invalidate(win, prop);
 }
 
 void obt_prop_set32(Window win, Atom prop, Atom type, gulong val)
 {
+    forget_value(win, prop);
     XChangeProperty(obt_display, win, prop, type, 32, PropModeReplace,
                     (guchar*)&val, 1);
 }
@@ -529,12 +896,14 @@ void obt_prop_set32(Window win, Atom prop, Atom type, gulong val)
 void obt_prop_set_array32(Window win, Atom prop, Atom type, gulong *val,
                       guint num)
 {
+    forget_value(win, prop);
     XChangeProperty(obt_display, win, prop, type, 32, PropModeReplace,
                     (guchar*)val, num);
 }
 
 void obt_prop_set_text(Window win, Atom prop, const gchar *val)
 {
+    forget_value(win, prop);
     XChangeProperty(obt_display, win, prop, OBT_PROP_ATOM(UTF8_STRING), 8,
                     PropModeReplace, (const guchar*)val, strlen(val));
 }
@@ -544,6 +913,8 @@ void obt_prop_set_array_text(Window win, Atom prop, const gchar *const *strs)
     GString *str;
     gchar const *const *s;
 
+    forget_value(win, prop);
+
     str = g_string_sized_new(0);
     for (s = strs; *s; ++s) {
         str = g_string_append(str, *s);
@@ -556,6 +927,7 @@ void obt_prop_set_array_text(Window win, Atom prop, const gchar *const *strs)
 
 void obt_prop_erase(Window win, Atom prop)
 {
+    forget_value(win, prop);
     XDeleteProperty(obt_display, win, prop);
 }
 
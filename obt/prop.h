@@ -256,6 +256,56 @@ gboolean obt_prop_get_array_text(Window win, Atom prop,
                                  ObtPropTextType type,
                                  gchar ***ret);
 
+/*! A request for a property which has been sent to the X server, and whose
+  reply has not been read yet.  Each cookie must be given to exactly one of
+  the obt_prop_reply_* functions, which read the reply and free the cookie.
+*/
+typedef struct _ObtPropCookie ObtPropCookie;
+
+/*! Asks the X server for a property without waiting for its reply.  Any
+  number of requests can be made before reading the first reply, so they
+  all cost a single round trip to the server.
+  @param type The type the property must have, or AnyPropertyType.
+*/
+ObtPropCookie* obt_prop_request(Window win, Atom prop, Atom type);
+
+gboolean obt_prop_reply32(ObtPropCookie *cookie, guint32 *ret);
+gboolean obt_prop_reply_array32(ObtPropCookie *cookie, guint32 **ret,
+                                guint *nret);
+gboolean obt_prop_reply_text(ObtPropCookie *cookie, ObtPropTextType type,
+                             gchar **ret);
+gboolean obt_prop_reply_array_text(ObtPropCookie *cookie,
+                                   ObtPropTextType type, gchar ***ret);
+/*! Frees a cookie whose reply is not wanted */
+void obt_prop_reply_discard(ObtPropCookie *cookie);
+
+/*! Requests a set of properties from a window ahead of time.  Until
+  obt_prop_prefetch_done() is called for the window, the obt_prop_get_*
+  functions answer from these requests instead of going to the X server, for
+  each property the first time it is read.  Setting or erasing a property
+  drops its request.
+*/
+void obt_prop_prefetch(Window win, const Atom *props, guint nprops);
+/*! Discards any properties prefetched for the window that were not read */
+void obt_prop_prefetch_done(Window win);
+
+/*! Keeps the values of a window's properties as they are read, so reading
+  them again does not go to the X server.  The window must select
+  PropertyChangeMask, and obt_prop_cache_invalidate() must be called for
+  each PropertyNotify event on it.  Large values, like icons, are not kept.
+*/
+void obt_prop_cache_window(Window win);
+/*! Stops keeping the values of a window's properties */
+void obt_prop_cache_forget(Window win);
+/*! Marks a property's kept value as out of date, when it has changed */
+void obt_prop_cache_invalidate(Window win, Atom prop);
+/*! Reads the properties whose kept values are out of date, all in one round
+  trip.
+  @return TRUE if any of the properties has a different value than it had
+    before, or if the window's properties aren't being kept.
+*/
+gboolean obt_prop_cache_refresh(Window win, const Atom *props, guint nprops);
+
 void obt_prop_set32(Window win, Atom prop, Atom type, gulong val);
 void obt_prop_set_array32(Window win, Atom prop, Atom type, gulong *val,
                           guint num);
@@ -19,71 +19,167 @@
 #include "obt/xqueue.h"
 #include "obt/display.h"
 
-#define MINSZ 16
+#ifdef HAVE_STRING_H
+#  include <string.h>
+#endif
 
-static XEvent *q = NULL;
+#define MINSZ 16
+/* event types are all below this, including the ones from extensions */
+#define NTYPES 128
+
+typedef struct _ObtXQueueEntry {
+    XEvent event;
+    /* events are numbered in the order they are read, so the queue is
+       always sorted by these */
+    gulong id;
+    /* where the event is in the indexes.  these are NULL once the event has
+       been removed from the queue, and it is left behind until there is a
+       reason to squeeze it out. */
+    GList *window_link;
+    GList *type_link;
+} ObtXQueueEntry;
+
+#define LIVE(en) ((en)->type_link != NULL)
+
+static ObtXQueueEntry *q = NULL;
 static gulong qsz = 0;
 static gulong qstart; /* the first event in the queue */
-static gulong qend; /* the last event in the queue */
-static gulong qnum = 0;
+static gulong qend; /* one past the last event in the queue */
+static gulong qnum = 0; /* the events in the queue that haven't been removed */
+static gulong qnext_id = 0; /* the id for the next event read */
+
+/* the ids of the events in the queue for each window, in the order they are
+   in the queue.  this maps a Window to a GQueue. */
+static GHashTable *by_window = NULL;
+/* the ids of the events in the queue of each type, in order */
+static GQueue by_type[NTYPES];
+
+/* how far to look ahead for an event that makes an earlier one redundant */
+#define COALESCE_LOOKAHEAD 64
+/* the types of events to coalesce */
+static gboolean coalescing[NTYPES];
+/* how many events of each type were dropped by coalescing them */
+static gulong coalesced[NTYPES];
+
+#define WINDOW_KEY(w) GSIZE_TO_POINTER(w)
+#define ID_TO_POINTER(i) GSIZE_TO_POINTER(i)
+#define POINTER_TO_ID(p) ((gulong)GPOINTER_TO_SIZE(p))
+/* the ids wrap around, but there are never near that many in the queue */
+#define ID_BEFORE(a, b) ((glong)((a) - (b)) < 0)
+
+/* Squeezes out the removed events and moves the rest to the front */
+static void compact(void)
+{
+    gulong i, n;
+
+    n = 0;
+    i = qstart;
+    while (i < qend) {
+        gulong run;
+
+        while (i < qend && !LIVE(&q[i])) ++i;
+        for (run = i; run < qend && LIVE(&q[run]); ++run);
+        if (run > i && i != n)
+            memmove(&q[n], &q[i], (run - i) * sizeof(ObtXQueueEntry));
+        n += run - i;
+        i = run;
+    }
+    g_assert(n == qnum);
+    qstart = 0;
+    qend = n;
+}
 
 static inline void shrink(void) {
     if (qsz > MINSZ && qnum < qsz / 4) {
-        const gulong newsz = qsz/2;
-        gulong i;
-
-        if (qnum == 0) {
-            qstart = 0;
-            qend = -1;
-        }
+        compact();
+        qsz /= 2;
+        q = g_renew(ObtXQueueEntry, q, qsz);
+    }
+}
 
-        /* all in the shinking part, move it to pos 0 */
-        else if (qstart >= newsz && qend >= newsz) {
-            for (i = 0; i < qnum; ++i)
-                q[i] = q[qstart+i];
-            qstart = 0;
-            qend = qnum - 1;
+static inline void grow(void) {
+    if (qend == qsz) {
+        /* if at least half of it is removed events, squeezing them out
+           makes enough room.  otherwise make it bigger, and the events
+           are all copied over at once. */
+        if (qnum <= qsz / 2)
+            compact();
+        else {
+            qsz *= 2;
+            q = g_renew(ObtXQueueEntry, q, qsz);
         }
+    }
+}
 
-        /* it wraps around to 0 right now, move the part between newsz and qsz
-           to be before newsz */
-        else if (qstart >= newsz) {
-            const gulong n = qsz - qstart;
-            for (i = 0; i < n; ++i)
-                q[newsz-n+i] = q[qstart+i];
-            qstart = newsz-n;
-        }
+static inline GQueue* type_index(gint type)
+{
+    return &by_type[type & (NTYPES-1)];
+}
 
-        /* it needs to wrap around to 0, move the stuff after newsz to pos 0 */
-        else if (qend >= newsz) {
-            const gulong n = qend + 1 - newsz;
-            for (i = 0; i < n; ++i)
-                q[i] = q[newsz+i];
-            qend = n - 1;
-        }
+static void index_add(ObtXQueueEntry *en)
+{
+    GQueue *wq;
 
-        q = g_renew(XEvent, q, newsz);
-        qsz = newsz;
+    wq = g_hash_table_lookup(by_window, WINDOW_KEY(en->event.xany.window));
+    if (!wq) {
+        wq = g_queue_new();
+        g_hash_table_insert(by_window, WINDOW_KEY(en->event.xany.window), wq);
     }
+    g_queue_push_tail(wq, ID_TO_POINTER(en->id));
+    en->window_link = wq->tail;
+    g_queue_push_tail(type_index(en->event.type), ID_TO_POINTER(en->id));
+    en->type_link = type_index(en->event.type)->tail;
 }
 
-static inline void grow(void) {
-    if (qnum == qsz) {
-        const gulong newsz = qsz*2;
-        gulong i;
- 
-        q = g_renew(XEvent, q, newsz);
-
-        g_assert(qnum > 0);
-
-        if (qend < qstart) { /* it wraps around to 0 right now */
-            for (i = 0; i <= qend; ++i)
-                q[qsz+i] = q[i];
-            qend = qsz + qend;
-        }
+static void index_remove(ObtXQueueEntry *en)
+{
+    GQueue *wq;
+
+    wq = g_hash_table_lookup(by_window, WINDOW_KEY(en->event.xany.window));
+    g_assert(wq != NULL);
+    g_queue_delete_link(wq, en->window_link);
+    if (g_queue_is_empty(wq))
+        g_hash_table_remove(by_window, WINDOW_KEY(en->event.xany.window));
+    g_queue_delete_link(type_index(en->event.type), en->type_link);
 
-        qsz = newsz;
+    en->window_link = en->type_link = NULL;
+}
+
+/* Finds the first place in the queue holding an event with the id or a
+   later one, which is qend if there isn't one */
+static gulong find_from(gulong id)
+{
+    gulong lo, hi;
+
+    lo = qstart;
+    hi = qend;
+    while (lo < hi) {
+        const gulong mid = lo + (hi - lo) / 2;
+        if (ID_BEFORE(q[mid].id, id))
+            lo = mid + 1;
+        else
+            hi = mid;
     }
+    return lo;
+}
+
+/* Finds where an event is in the queue */
+static inline gulong find_id(gulong id)
+{
+    const gulong p = find_from(id);
+    g_assert(p < qend && q[p].id == id && LIVE(&q[p]));
+    return p;
+}
+
+static void push(const XEvent *e)
+{
+    grow(); /* make sure there is room */
+
+    q[qend].event = *e; /* stick the event at the end */
+    q[qend].id = qnext_id++;
+    index_add(&q[qend]);
+    ++qend;
+    ++qnum;
 }
 
 /* Grab all pending X events */
@@ -91,6 +187,10 @@ static gboolean read_events(gboolean block)
 {
     gint sth, n;
 
+    /* without a display, the queue only has the events pushed onto it, as
+       in the unit tests */
+    if (!obt_display) return FALSE;
+
     n = XEventsQueued(obt_display, QueuedAfterFlush) > 0;
     sth = FALSE;
 
@@ -100,11 +200,7 @@ static gboolean read_events(gboolean block)
         if (XNextEvent(obt_display, &e) != Success)
             return FALSE;
 
-        grow(); /* make sure there is room */
-
-        ++qnum;
-        qend = (qend + 1) % qsz; /* move the end */
-        q[qend] = e; /* stick the event at the end */
+        push(&e);
 
         --n;
         sth = TRUE;
@@ -115,42 +211,18 @@ static gboolean read_events(gboolean block)
 
 static void pop(const gulong p)
 {
-    /* remove the event */
+    /* remove the event, and leave it in place */
+    index_remove(&q[p]);
     --qnum;
-    if (qnum == 0) {
-        qstart = 0;
-        qend = -1;
-    }
-    else if (p == qstart)
-        qstart = (qstart + 1) % qsz;
-    else {
-        gulong pi;
-
-        /* is it cheaper to move the start or the end ? */
-        if ((p >= qstart && p < qstart + qnum/2) ||
-            (p < qstart && p < (qstart + qnum/2) % qsz))
-        {
-            /* move the start */
-            pi = p;
-            while (pi != qstart) {
-                const gulong pi_next = (pi == 0 ? qsz-1 : pi-1);
-
-                q[pi] = q[pi_next];
-                pi = pi_next;
-            }
-            qstart = (qstart + 1) % qsz;
-        }
-        else {
-            /* move the end */
-            pi = p;
-            while (pi != qend) {
-                const gulong pi_next = (pi + 1) % qsz;
 
-                q[pi] = q[pi_next];
-                pi = pi_next;
-            }
-            qend = (qend == 0 ? qsz-1 : qend-1);
-        }
+    if (qnum == 0)
+        qstart = qend = 0;
+    else if (p == qstart) {
+        /* skip any others that were removed already */
+        do ++qstart; while (!LIVE(&q[qstart]));
+    }
+    else if (p == qend - 1) {
+        do --qend; while (!LIVE(&q[qend - 1]));
     }
 
     shrink(); /* shrink the q if too little in it */
@@ -160,17 +232,35 @@ void xqueue_init(void)
 {
     if (q != NULL) return;
     qsz = MINSZ;
-    q = g_new(XEvent, qsz);
-    qstart = 0;
-    qend = -1;
+    q = g_new(ObtXQueueEntry, qsz);
+    qstart = qend = 0;
+    by_window = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                      (GDestroyNotify)g_queue_free);
 }
 
 void xqueue_destroy(void)
 {
+    gint i;
+
     if (q == NULL) return;
     g_free(q);
     q = NULL;
     qsz = 0;
+    qnum = 0;
+    g_hash_table_destroy(by_window);
+    by_window = NULL;
+    for (i = 0; i < NTYPES; ++i)
+        g_queue_clear(&by_type[i]);
+}
+
+/* Adds an event to the end of the queue, as though it was read from the
+   server */
+void xqueue_push_local(const XEvent *e)
+{
+    g_return_if_fail(q != NULL);
+    g_return_if_fail(e != NULL);
+
+    push(e);
 }
 
 gboolean xqueue_match_window(XEvent *e, gpointer data)
@@ -197,6 +287,71 @@ gboolean xqueue_match_window_message(XEvent *e, gpointer data)
         e->xclient.message_type == x.message;
 }
 
+/* Makes a later Expose cover the area of an earlier one too */
+static void merge_expose(XExposeEvent *later, const XExposeEvent *e)
+{
+    const gint x2 = MAX(later->x + later->width, e->x + e->width);
+    const gint y2 = MAX(later->y + later->height, e->y + e->height);
+
+    later->x = MIN(later->x, e->x);
+    later->y = MIN(later->y, e->y);
+    later->width = x2 - later->x;
+    later->height = y2 - later->y;
+}
+
+/* Drops the event at the front of the queue if a later one in the queue
+   makes it redundant, after giving the later one anything from it that is
+   still needed */
+static gboolean coalesce_head(void)
+{
+    const XEvent *e = &q[qstart].event;
+    const gint type = e->type;
+    XEvent *later;
+    GList *it;
+    gint i;
+
+    if (!coalescing[type & (NTYPES-1)]) return FALSE;
+
+    switch (type) {
+    case PropertyNotify:
+    case Expose:
+        /* look past more of the same for the window, but not past anything
+           else that happens to it */
+        later = NULL;
+        it = q[qstart].window_link->next;
+        for (i = 0; it && i < COALESCE_LOOKAHEAD; it = it->next, ++i) {
+            later = &q[find_id(POINTER_TO_ID(it->data))].event;
+            if (later->type != type)
+                return FALSE;
+            if (type == Expose ||
+                later->xproperty.atom == e->xproperty.atom)
+                break;
+        }
+        if (!it || i == COALESCE_LOOKAHEAD) return FALSE;
+        if (type == Expose)
+            merge_expose(&later->xexpose, &e->xexpose);
+        break;
+    default:
+        return FALSE;
+    }
+
+    ++coalesced[type & (NTYPES-1)];
+    pop(qstart);
+    return TRUE;
+}
+
+void xqueue_coalesce(gint type, gboolean coalesce)
+{
+    g_return_if_fail(type == PropertyNotify || type == Expose);
+
+    coalescing[type & (NTYPES-1)] = coalesce;
+}
+
+gulong xqueue_coalesced(gint type)
+{
+    return coalesced[type & (NTYPES-1)];
+}
+
 gboolean xqueue_peek(XEvent *event_return)
 {
     g_return_val_if_fail(q != NULL, FALSE);
@@ -204,7 +359,7 @@ gboolean xqueue_peek(XEvent *event_return)
 
     if (!qnum) read_events(TRUE);
     if (!qnum) return FALSE;
-    *event_return = q[qstart]; /* get the head */
+    *event_return = q[qstart].event; /* get the head */
     return TRUE;
 }
 
@@ -215,7 +370,7 @@ gboolean xqueue_peek_local(XEvent *event_return)
 
     if (!qnum) read_events(FALSE);
     if (!qnum) return FALSE;
-    *event_return = q[qstart]; /* get the head */
+    *event_return = q[qstart].event; /* get the head */
     return TRUE;
 }
 
@@ -225,8 +380,10 @@ gboolean xqueue_next(XEvent *event_return)
     g_return_val_if_fail(event_return != NULL, FALSE);
 
     if (!qnum) read_events(TRUE);
+    /* this never empties the queue */
+    while (qnum && coalesce_head());
     if (qnum) {
-        *event_return = q[qstart]; /* get the head */
+        *event_return = q[qstart].event; /* get the head */
         pop(qstart);
         return TRUE;
     }
@@ -240,8 +397,10 @@ gboolean xqueue_next_local(XEvent *event_return)
     g_return_val_if_fail(event_return != NULL, FALSE);
 
     if (!qnum) read_events(FALSE);
+    /* this never empties the queue */
+    while (qnum && coalesce_head());
     if (qnum) {
-        *event_return = q[qstart]; /* get the head */
+        *event_return = q[qstart].event; /* get the head */
         pop(qstart);
         return TRUE;
     }
@@ -249,64 +408,173 @@ gboolean xqueue_next_local(XEvent *event_return)
     return FALSE;
 }
 
-gboolean xqueue_exists(xqueue_match_func match, gpointer data)
+/* Looks at every event in the queue until match returns TRUE for one,
+   reading more events while there are none left to look at */
+static gboolean scan(gboolean block, xqueue_match_func match, gpointer data,
+                     gulong *pos)
 {
-    gulong i, checked;
+    gulong p, next_id;
 
-    g_return_val_if_fail(q != NULL, FALSE);
-    g_return_val_if_fail(match != NULL, FALSE);
-
-    checked = 0;
+    p = qstart;
     while (TRUE) {
-        for (i = checked; i < qnum; ++i, ++checked) {
-            const gulong p = (qstart + i) % qsz;
-            if (match(&q[p], data))
+        for (; p < qend; ++p)
+            if (LIVE(&q[p]) && match(&q[p].event, data)) {
+                *pos = p;
                 return TRUE;
-        }
-        if (!read_events(TRUE)) break; /* error */
+            }
+
+        /* reading can squeeze the queue and move the events, so find the
+           new ones by their ids */
+        next_id = qnext_id;
+        if (!read_events(block)) break;
+        p = find_from(next_id);
     }
     return FALSE;
 }
 
-gboolean xqueue_exists_local(xqueue_match_func match, gpointer data)
+gboolean xqueue_exists(xqueue_match_func match, gpointer data)
 {
-    gulong i, checked;
+    gulong p;
 
     g_return_val_if_fail(q != NULL, FALSE);
     g_return_val_if_fail(match != NULL, FALSE);
 
-    checked = 0;
+    return scan(TRUE, match, data, &p);
+}
+
+/* Finds the window and type that the built-in match functions look for, so
+   that they can use the indexes */
+static void match_key(xqueue_match_func match, gpointer data,
+                      Window *window, gint *type)
+{
+    *window = None;
+    *type = 0;
+    if (match == xqueue_match_window)
+        *window = *(Window*)data;
+    else if (match == xqueue_match_type)
+        *type = GPOINTER_TO_INT(data);
+    else if (match == xqueue_match_window_type) {
+        *window = ((ObtXQueueWindowType*)data)->window;
+        *type = ((ObtXQueueWindowType*)data)->type;
+    }
+    else if (match == xqueue_match_window_message) {
+        *window = ((ObtXQueueWindowMessage*)data)->window;
+        *type = ClientMessage;
+    }
+}
+
+static guint window_count(Window window)
+{
+    GQueue *wq = g_hash_table_lookup(by_window, WINDOW_KEY(window));
+    return wq ? wq->length : 0;
+}
+
+/* Finds the first event in the local queue for the window and of the type
+   that match returns TRUE for, reading any events that are waiting if it
+   isn't there yet.  Only the events for the window, or of the type, are
+   looked at. */
+static gboolean find_local(Window window, gint type,
+                           xqueue_match_func match, gpointer data,
+                           gulong *pos)
+{
+    GQueue *iq;
+    GList *it, *last;
+    gboolean use_window;
+
+    /* there's no index to use, so look at everything */
+    if (window == None && type == 0)
+        return scan(FALSE, match, data, pos);
+
+    /* look through whichever index has fewer events in it */
+    use_window = window != None &&
+        (type == 0 || window_count(window) <= type_index(type)->length);
+
+    last = NULL;
     while (TRUE) {
-        for (i = checked; i < qnum; ++i, ++checked) {
-            const gulong p = (qstart + i) % qsz;
-            if (match(&q[p], data))
+        /* the events read since last time are added at the end of the
+           index, so carry on from where it left off */
+        iq = use_window ?
+            g_hash_table_lookup(by_window, WINDOW_KEY(window)) :
+            type_index(type);
+        it = last ? last->next : (iq ? iq->head : NULL);
+
+        for (; it; last = it, it = g_list_next(it)) {
+            const gulong p = find_id(POINTER_TO_ID(it->data));
+            XEvent *e = &q[p].event;
+
+            if ((window == None || e->xany.window == window) &&
+                (type == 0 || e->type == type) &&
+                (match == NULL || match(e, data)))
+            {
+                *pos = p;
                 return TRUE;
+            }
         }
         if (!read_events(FALSE)) break;
     }
     return FALSE;
 }
 
+gboolean xqueue_exists_local(xqueue_match_func match, gpointer data)
+{
+    Window window;
+    gint type;
+    gulong p;
+
+    g_return_val_if_fail(q != NULL, FALSE);
+    g_return_val_if_fail(match != NULL, FALSE);
+
+    match_key(match, data, &window, &type);
+    return find_local(window, type, match, data, &p);
+}
+
+gboolean xqueue_exists_local_for(Window window, gint type,
+                                 xqueue_match_func match, gpointer data)
+{
+    gulong p;
+
+    g_return_val_if_fail(q != NULL, FALSE);
+    g_return_val_if_fail(match != NULL || window != None || type != 0,
+                         FALSE);
+
+    return find_local(window, type, match, data, &p);
+}
+
 gboolean xqueue_remove_local(XEvent *event_return,
                              xqueue_match_func match, gpointer data)
 {
-    gulong i, checked;
+    Window window;
+    gint type;
+    gulong p;
 
     g_return_val_if_fail(q != NULL, FALSE);
     g_return_val_if_fail(event_return != NULL, FALSE);
     g_return_val_if_fail(match != NULL, FALSE);
 
-    checked = 0;
-    while (TRUE) {
-        for (i = checked; i < qnum; ++i, ++checked) {
-            const gulong p = (qstart + i) % qsz;
-            if (match(&q[p], data)) {
-                *event_return = q[p];
-                pop(p);
-                return TRUE;
-            }
-        }
-        if (!read_events(FALSE)) break;
+    match_key(match, data, &window, &type);
+    if (find_local(window, type, match, data, &p)) {
+        *event_return = q[p].event;
+        pop(p);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+gboolean xqueue_remove_local_for(XEvent *event_return,
+                                 Window window, gint type,
+                                 xqueue_match_func match, gpointer data)
+{
+    gulong p;
+
+    g_return_val_if_fail(q != NULL, FALSE);
+    g_return_val_if_fail(event_return != NULL, FALSE);
+    g_return_val_if_fail(match != NULL || window != None || type != 0,
+                         FALSE);
+
+    if (find_local(window, type, match, data, &p)) {
+        *event_return = q[p].event;
+        pop(p);
+        return TRUE;
     }
     return FALSE;
 }
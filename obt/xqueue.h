@@ -87,6 +87,35 @@ gboolean xqueue_exists_local(xqueue_match_func match, gpointer data);
 gboolean xqueue_remove_local(XEvent *event_return,
                              xqueue_match_func match, gpointer data);
 
+/*! Like xqueue_exists_local(), but only looks at the events for @window and
+  of @type.  Either of those can be None or 0 to look at events for any
+  window or of any type, and @match can be NULL to take any of the events.
+  The queue keeps the events indexed by their window and type, so this only
+  looks at as many events as there are for the window, or of the type. */
+gboolean xqueue_exists_local_for(Window window, gint type,
+                                 xqueue_match_func match, gpointer data);
+
+/*! Like xqueue_remove_local(), but only looks at the events for @window and
+  of @type, in the same way as xqueue_exists_local_for(). */
+gboolean xqueue_remove_local_for(XEvent *event_return,
+                                 Window window, gint type,
+                                 xqueue_match_func match, gpointer data);
+
+/*! Sets if events of @type are coalesced when they reach the front of the
+  queue, before xqueue_next() or xqueue_next_local() returns them.  An event
+  is dropped when a later one already in the local queue makes it redundant:
+  - A PropertyNotify, when the same property of the window changes again
+    before anything else happens to the window.
+  - An Expose, when another exposure of the window follows before anything
+    else happens to it.  The later one then covers the area of both.
+  No other types of events can be coalesced.  ConfigureRequests can't be,
+  as property changes in between them change what they do, and neither can
+  stacking requests.  Motion is compressed by whoever handles it. */
+void xqueue_coalesce(gint type, gboolean coalesce);
+
+/*! Returns how many events of @type have been dropped by coalescing them */
+gulong xqueue_coalesced(gint type);
+
 typedef void (*ObtXQueueFunc)(const XEvent *ev, gpointer data);
 
 /*! Begin listening for X events in the default GMainContext, and feed them
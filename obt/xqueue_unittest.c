@@ -0,0 +1,286 @@
+#include "obt/unittest_base.h"
+
+#include "obt/xqueue.h"
+
+#include <glib.h>
+#include <X11/Xlib.h>
+#include <string.h>
+
+/* from xqueue.c */
+extern void xqueue_init(void);
+extern void xqueue_destroy(void);
+extern void xqueue_push_local(const XEvent *e);
+
+/* Pushes an event for the window, which remembers the order it was pushed
+   in */
+static void push(gint type, Window window, glong order) {
+    XEvent e;
+
+    memset(&e, 0, sizeof(e));
+    e.type = type;
+    e.xany.window = window;
+    e.xclient.data.l[0] = order;
+    xqueue_push_local(&e);
+}
+
+static gint order(const XEvent *e) {
+    return (gint)e->xclient.data.l[0];
+}
+
+static gboolean match_order(XEvent *e, gpointer data) {
+    return order(e) == GPOINTER_TO_INT(data);
+}
+
+static void in_order() {
+    TEST_START();
+    xqueue_init();
+
+    XEvent e;
+    gint i;
+
+    for (i = 0; i < 100; ++i)
+        push(ClientMessage, 1, i);
+    for (i = 0; i < 100; ++i) {
+        EXPECT_BOOL_EQ(TRUE, xqueue_next_local(&e));
+        EXPECT_INT_EQ(i, order(&e));
+    }
+    EXPECT_BOOL_EQ(FALSE, xqueue_pending_local());
+
+    xqueue_destroy();
+    TEST_END();
+}
+
+static void remove_middle() {
+    TEST_START();
+    xqueue_init();
+
+    ObtXQueueWindowType wt;
+    XEvent e;
+    gint i;
+
+    for (i = 0; i < 10; ++i)
+        push(i == 5 ? PropertyNotify : ClientMessage, 10 + i, i);
+
+    /* take out the one in the middle by its window and type */
+    wt.window = 15;
+    wt.type = PropertyNotify;
+    EXPECT_BOOL_EQ(TRUE, xqueue_remove_local(&e, xqueue_match_window_type,
+                                             &wt));
+    EXPECT_INT_EQ(5, order(&e));
+    EXPECT_BOOL_EQ(FALSE, xqueue_exists_local(xqueue_match_window_type,
+                                              &wt));
+    EXPECT_BOOL_EQ(FALSE, xqueue_exists_local_for(None, PropertyNotify,
+                                                  NULL, NULL));
+
+    /* and one by a match function */
+    EXPECT_BOOL_EQ(TRUE, xqueue_remove_local(&e, match_order,
+                                             GINT_TO_POINTER(2)));
+    EXPECT_INT_EQ(2, order(&e));
+
+    /* the rest are still in order */
+    for (i = 0; i < 10; ++i) {
+        if (i == 2 || i == 5) continue;
+        EXPECT_BOOL_EQ(TRUE, xqueue_next_local(&e));
+        EXPECT_INT_EQ(i, order(&e));
+    }
+    EXPECT_BOOL_EQ(FALSE, xqueue_pending_local());
+
+    xqueue_destroy();
+    TEST_END();
+}
+
+static void remove_ends() {
+    TEST_START();
+    xqueue_init();
+
+    XEvent e;
+    gint i;
+
+    for (i = 0; i < 5; ++i)
+        push(ClientMessage, 1, i);
+
+    /* remove the last ones, and then the first, from behind the ones that
+       were already removed */
+    EXPECT_BOOL_EQ(TRUE, xqueue_remove_local(&e, match_order,
+                                             GINT_TO_POINTER(3)));
+    EXPECT_BOOL_EQ(TRUE, xqueue_remove_local(&e, match_order,
+                                             GINT_TO_POINTER(4)));
+    EXPECT_BOOL_EQ(TRUE, xqueue_remove_local(&e, match_order,
+                                             GINT_TO_POINTER(1)));
+    EXPECT_BOOL_EQ(TRUE, xqueue_remove_local(&e, match_order,
+                                             GINT_TO_POINTER(0)));
+
+    EXPECT_BOOL_EQ(TRUE, xqueue_peek_local(&e));
+    EXPECT_INT_EQ(2, order(&e));
+    push(ClientMessage, 1, 5);
+    EXPECT_BOOL_EQ(TRUE, xqueue_next_local(&e));
+    EXPECT_INT_EQ(2, order(&e));
+    EXPECT_BOOL_EQ(TRUE, xqueue_next_local(&e));
+    EXPECT_INT_EQ(5, order(&e));
+    EXPECT_BOOL_EQ(FALSE, xqueue_pending_local());
+
+    xqueue_destroy();
+    TEST_END();
+}
+
+static void grow_and_shrink() {
+    TEST_START();
+    xqueue_init();
+
+    XEvent e;
+    gint i, n, removed;
+
+    /* leave lots of removed events behind while it grows, so that they have
+       to be squeezed out */
+    removed = n = 0;
+    for (i = 0; i < 5000; ++i) {
+        push(ClientMessage, 1 + i % 7, i);
+        if (i % 3 == 1) {
+            EXPECT_BOOL_EQ(TRUE, xqueue_remove_local(&e, match_order,
+                                                     GINT_TO_POINTER(i - 1)));
+            ++removed;
+        }
+    }
+    /* and while it shrinks */
+    for (i = 0; i < 5000; ++i) {
+        if (i % 3 == 0) continue; /* removed already */
+        if (i % 2 == 0) {
+            EXPECT_BOOL_EQ(TRUE, xqueue_remove_local_for(
+                               &e, 1 + i % 7, ClientMessage,
+                               match_order, GINT_TO_POINTER(i)));
+            EXPECT_INT_EQ(i, order(&e));
+            ++n;
+        }
+    }
+    for (i = 0; i < 5000; ++i) {
+        if (i % 3 == 0 || i % 2 == 0) continue;
+        EXPECT_BOOL_EQ(TRUE, xqueue_next_local(&e));
+        EXPECT_INT_EQ(i, order(&e));
+        ++n;
+    }
+    EXPECT_BOOL_EQ(FALSE, xqueue_pending_local());
+    EXPECT_INT_EQ(5000 - removed, n);
+
+    xqueue_destroy();
+    TEST_END();
+}
+
+static void coalesce_property() {
+    TEST_START();
+    xqueue_init();
+    xqueue_coalesce(PropertyNotify, TRUE);
+
+    XEvent e;
+    gint i;
+
+    /* changes to one property around another, and then again after the
+       window is unmapped */
+    for (i = 0; i < 5; ++i) {
+        memset(&e, 0, sizeof(e));
+        e.type = i == 3 ? UnmapNotify : PropertyNotify;
+        e.xany.window = 1;
+        e.xproperty.atom = i == 1 ? 2 : 1;
+        e.xproperty.time = i;
+        xqueue_push_local(&e);
+    }
+
+    EXPECT_BOOL_EQ(TRUE, xqueue_next_local(&e));
+    EXPECT_UINT_EQ(1, (guint)e.xproperty.time);
+    EXPECT_BOOL_EQ(TRUE, xqueue_next_local(&e));
+    EXPECT_UINT_EQ(2, (guint)e.xproperty.time);
+    EXPECT_BOOL_EQ(TRUE, xqueue_next_local(&e));
+    EXPECT_INT_EQ(UnmapNotify, e.type);
+    EXPECT_BOOL_EQ(TRUE, xqueue_next_local(&e));
+    EXPECT_UINT_EQ(4, (guint)e.xproperty.time);
+    EXPECT_BOOL_EQ(FALSE, xqueue_pending_local());
+
+    xqueue_coalesce(PropertyNotify, FALSE);
+    xqueue_destroy();
+    TEST_END();
+}
+
+static void coalesce_expose() {
+    TEST_START();
+    xqueue_init();
+    xqueue_coalesce(Expose, TRUE);
+
+    XEvent e;
+
+    memset(&e, 0, sizeof(e));
+    e.type = Expose;
+    e.xexpose.window = 1;
+    e.xexpose.x = 10;
+    e.xexpose.y = 10;
+    e.xexpose.width = 10;
+    e.xexpose.height = 10;
+    e.xexpose.count = 1;
+    xqueue_push_local(&e);
+    e.xexpose.x = 30;
+    e.xexpose.y = 0;
+    e.xexpose.width = 5;
+    e.xexpose.height = 5;
+    e.xexpose.count = 0;
+    xqueue_push_local(&e);
+
+    EXPECT_BOOL_EQ(TRUE, xqueue_next_local(&e));
+    EXPECT_BOOL_EQ(FALSE, xqueue_pending_local());
+    EXPECT_INT_EQ(10, e.xexpose.x);
+    EXPECT_INT_EQ(0, e.xexpose.y);
+    EXPECT_INT_EQ(25, e.xexpose.width);
+    EXPECT_INT_EQ(20, e.xexpose.height);
+    EXPECT_INT_EQ(0, e.xexpose.count);
+
+    xqueue_coalesce(Expose, FALSE);
+    xqueue_destroy();
+    TEST_END();
+}
+
+/* Not a test, but shows how long it takes to remove events from the middle
+   of a big queue.  It only runs when OBT_UNITTEST_BENCH is set in the
+   environment, so the timings stay out of the normal test output. */
+static void remove_middle_benchmark() {
+    TEST_START();
+    xqueue_init();
+
+    const gint n = 20000;
+    XEvent e;
+    gint64 start, took;
+    gint i;
+
+    for (i = 0; i < n; ++i)
+        push(PropertyNotify, 1 + i, i);
+
+    /* remove them from the middle outwards */
+    start = g_get_monotonic_time();
+    for (i = 0; i < n / 2; ++i) {
+        EXPECT_BOOL_EQ(TRUE, xqueue_remove_local_for(&e, 1 + n / 2 + i,
+                                                     PropertyNotify,
+                                                     NULL, NULL));
+        EXPECT_BOOL_EQ(TRUE, xqueue_remove_local_for(&e, n / 2 - i,
+                                                     PropertyNotify,
+                                                     NULL, NULL));
+    }
+    took = g_get_monotonic_time() - start;
+    EXPECT_BOOL_EQ(FALSE, xqueue_pending_local());
+
+    printf("[  BENCH ] removed %d events from the middle in %" G_GINT64_FORMAT
+           " us\n", n, took);
+
+    xqueue_destroy();
+    TEST_END();
+}
+
+void run_xqueue_unittest() {
+    unittest_start_suite("xqueue");
+
+    in_order();
+    remove_middle();
+    remove_ends();
+    grow_and_shrink();
+    coalesce_property();
+    coalesce_expose();
+    if (g_getenv("OBT_UNITTEST_BENCH"))
+        remove_middle_benchmark();
+
+    unittest_end_suite();
+}
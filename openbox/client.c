@@ -55,6 +55,9 @@
 
 #include <glib.h>
 #include <X11/Xutil.h>
+#ifdef HAVE_STRING_H
+#  include <string.h>
+#endif
 
 /*! The event mask to grab on client windows */
 #define CLIENT_EVENTMASK (PropertyChangeMask | StructureNotifyMask | \
@@ -74,6 +77,17 @@ GList          *client_list             = NULL;
 static GSList  *client_destroy_notifies = NULL;
 static RrImage *client_default_icon     = NULL;
 
+/*! The client list that was last written to the root window */
+static Window  *client_list_windows     = NULL;
+static guint    client_list_num         = 0;
+static gboolean client_list_written     = FALSE;
+/*! The idle source that will write the client list, if a change is
+  waiting */
+static guint    client_set_list_id      = 0;
+static gulong   client_list_writes      = 0;
+static gulong   client_list_merged      = 0;
+static gulong   client_list_unchanged   = 0;
+
 static void client_get_all(ObClient *self, gboolean real);
 static void client_get_startup_id(ObClient *self);
 static void client_get_session_ids(ObClient *self);
@@ -132,6 +146,9 @@ void client_shutdown(gboolean reconfig)
     client_default_icon = NULL;
 
     if (reconfig) return;
+
+    /* the windows were all just unmanaged */
+    client_flush_list();
 }
 
 static void client_call_notifies(ObClient *self, GSList *list)
@@ -182,7 +199,7 @@ void client_remove_destroy_notify_data(ObClientCallback func, gpointer data)
     }
 }
 
-void client_set_list(void)
+static void client_write_list(void)
 {
     Window *windows, *win_it;
     GList *it;
@@ -197,15 +214,63 @@ void client_set_list(void)
     } else
         windows = NULL;
 
+    if (client_list_written && size == client_list_num &&
+        (size == 0 ||
+         !memcmp(windows, client_list_windows, size * sizeof(Window))))
+    {
+        /* pagers would wake up for nothing */
+        ++client_list_unchanged;
+        g_free(windows);
+        return;
+    }
+
     OBT_PROP_SETA32(obt_root(ob_screen), NET_CLIENT_LIST, WINDOW,
                     (gulong*)windows, size);
+    ++client_list_writes;
 
-    if (windows)
-        g_free(windows);
+    g_free(client_list_windows);
+    client_list_windows = windows;
+    client_list_num = size;
+    client_list_written = TRUE;
+}
+
+static gboolean client_set_list_idle(gpointer data)
+{
+    client_set_list_id = 0;
+    client_write_list();
+    return FALSE; /* don't repeat */
+}
+
+void client_set_list(void)
+{
+    /* windows tend to come and go many at a time, so write the list once
+       they are all done */
+    if (client_set_list_id)
+        ++client_list_merged;
+    else
+        client_set_list_id = g_idle_add_full(G_PRIORITY_DEFAULT,
+                                             client_set_list_idle,
+                                             NULL, NULL);
 
     stacking_set_list();
 }
 
+void client_flush_list(void)
+{
+    if (client_set_list_id) {
+        g_source_remove(client_set_list_id);
+        client_set_list_id = 0;
+        client_write_list();
+    }
+}
+
+void client_list_stats(gulong *writes, gulong *merged, gulong *unchanged)
+{
+    *writes = client_list_writes;
+    *merged = client_list_merged;
+    *unchanged = client_list_unchanged;
+}
+
 void client_manage(Window window, ObPrompt *prompt)
 {
     ObClient *self;
@@ -230,6 +295,10 @@ void client_manage(Window window, ObPrompt *prompt)
     XChangeWindowAttributes(obt_display, window,
                             CWEventMask|CWDontPropagate, &attrib_set);
 
+    /* we hear about every change to its properties now, so they can be kept
+       instead of read again each time */
+    obt_prop_cache_window(window);
+
     /* create the ObClient struct, and populate it from the hints on the
        window */
     self = g_slice_new0(ObClient);
@@ -593,6 +662,7 @@ void client_unmanage(ObClient *self)
     /* we dont want events no more. do this before hiding the frame so we
        don't generate more events */
     XSelectInput(obt_display, self->window, NoEventMask);
+    obt_prop_cache_forget(self->window);
 
     /* ignore enter events from the unmap so it doesnt mess with the focus */
     if (!config_focus_under_mouse)
@@ -1208,8 +1278,54 @@ gboolean client_find_onscreen(ObClient *self, gint *x, gint *y, gint w, gint h,
     return ox != *x || oy != *y;
 }
 
+/*! Asks for all the properties that client_get_all() reads off the window at
+  once, so they don't each wait on a round trip to the server */
+static void client_prefetch_props(ObClient *self, gboolean real)
+{
+    static const ObtPropAtom early[] = {
+        OBT_PROP_MOTIF_WM_HINTS,
+        OBT_PROP_NET_WM_WINDOW_TYPE,
+        OBT_PROP_NET_WM_STATE,
+        OBT_PROP_WM_CLIENT_LEADER,
+        OBT_PROP_SM_CLIENT_ID,
+        OBT_PROP_WM_CLASS,
+        OBT_PROP_WM_WINDOW_ROLE,
+        OBT_PROP_WM_COMMAND,
+        OBT_PROP_WM_CLIENT_MACHINE,
+        OBT_PROP_NET_WM_PID,
+        OBT_PROP_NET_WM_NAME,
+        OBT_PROP_WM_NAME,
+        OBT_PROP_NET_WM_ICON_NAME,
+        OBT_PROP_WM_ICON_NAME
+    };
+    /* these are only read when the window is really being managed */
+    static const ObtPropAtom late[] = {
+        OBT_PROP_WM_PROTOCOLS,
+        OBT_PROP_NET_STARTUP_ID,
+        OBT_PROP_NET_WM_DESKTOP,
+#ifdef SYNC
+        OBT_PROP_NET_WM_SYNC_REQUEST_COUNTER,
+#endif
+        OBT_PROP_NET_WM_STRUT_PARTIAL,
+        OBT_PROP_NET_WM_STRUT,
+        OBT_PROP_NET_WM_ICON,
+        OBT_PROP_NET_WM_ICON_GEOMETRY
+    };
+    Atom props[G_N_ELEMENTS(early) + G_N_ELEMENTS(late)];
+    guint i, n = 0;
+
+    for (i = 0; i < G_N_ELEMENTS(early); ++i)
+        props[n++] = obt_prop_atom(early[i]);
+    if (real)
+        for (i = 0; i < G_N_ELEMENTS(late); ++i)
+            props[n++] = obt_prop_atom(late[i]);
+    obt_prop_prefetch(self->window, props, n);
+}
+
 static void client_get_all(ObClient *self, gboolean real)
 {
+    client_prefetch_props(self, real);
+
     /* this is needed for the frame to set itself up */
     client_get_area(self);
 
@@ -1235,8 +1351,10 @@ static void client_get_all(ObClient *self, gboolean real)
 
     /* now we got everything that can affect the decorations or app rule
        matching */
-    if (!real)
+    if (!real) {
+        obt_prop_prefetch_done(self->window);
         return;
+    }
 
     /* save the values of the variables used for app rule matching */
     client_save_app_rule_values(self);
@@ -1269,6 +1387,8 @@ static void client_get_all(ObClient *self, gboolean real)
     client_update_strut(self);
     client_update_icons(self);
     client_update_icon_geometry(self);
+
+    obt_prop_prefetch_done(self->window);
 }
 
 static void client_get_startup_id(ObClient *self)
@@ -3917,7 +4037,9 @@ gboolean client_validate(ObClient *self)
 
     find.window = self->window;
     find.ignore_unmaps = self->ignore_unmaps;
-    if (xqueue_exists_local(find_destroy_unmap, &find))
+    if (xqueue_exists_local_for(None, DestroyNotify, find_destroy_unmap,
+                                &find) ||
+        xqueue_exists_local_for(None, UnmapNotify, find_destroy_unmap, &find))
         return FALSE;
 
     return TRUE;
@@ -4162,8 +4284,8 @@ gboolean client_focus(ObClient *self)
     obt_display_ignore_errors(FALSE);
 
     ob_debug_type(OB_DEBUG_FOCUS, "Error focusing? %d",
-                  obt_display_error_occured);
-    return !obt_display_error_occured;
+                  obt_display_error_occured());
+    return !obt_display_error_occured();
 }
 
 static void client_present(ObClient *self, gboolean here, gboolean raise,
@@ -360,8 +360,15 @@ ObClient *client_fake_manage(Window win);
 /*! Free the stuff created by client_fake_manage() */
 void client_fake_unmanage(ObClient *self);
 
-/*! Sets the client list on the root window from the client_list */
+/*! Sets the client list on the root window from the client_list.  The list
+  is written when the main loop is next idle, and only if it changed. */
 void client_set_list(void);
+/*! Writes the client list now, if a change is waiting */
+void client_flush_list(void);
+/*! Returns how many times the client list was written to the root window,
+  how many changes were written together with another one, and how many
+  times it was not written because it was the same */
+void client_list_stats(gulong *writes, gulong *merged, gulong *unchanged);
 
 /*! Determines if the client should be shown or hidden currently.
   @return TRUE if it should be visible; otherwise, FALSE.
@@ -48,6 +48,7 @@ StrutPartial config_margins;
 gchar   *config_theme;
 gboolean config_theme_keepborder;
 guint    config_theme_window_list_icon_size;
+guint    config_theme_icon_cache_size;
 
 gchar   *config_title_layout;
 
@@ -733,6 +734,10 @@ static void parse_theme(xmlNodePtr node, gpointer d)
         else if (config_theme_window_list_icon_size > 96)
             config_theme_window_list_icon_size = 96;
     }
+    if ((n = obt_xml_find_node(node, "iconCacheSize"))) {
+        gint s = obt_xml_node_int(n);
+        config_theme_icon_cache_size = MAX(s, 0);
+    }
 
     for (n = obt_xml_find_node(node, "font");
          n;
@@ -1112,6 +1117,8 @@ void config_startup(ObtXmlInst *i)
     config_title_layout = g_strdup("NLIMC");
     config_theme_keepborder = TRUE;
     config_theme_window_list_icon_size = 36;
+    /* 4MB holds the titlebar, menu and alt-tab sizes of a few hundred icons */
+    config_theme_icon_cache_size = 4096;
 
     config_font_activewindow = NULL;
     config_font_inactivewindow = NULL;
@@ -153,6 +153,8 @@ extern gchar *config_title_layout;
 extern gboolean config_animate_iconify;
 /*! Size of icons in focus switching dialogs */
 extern guint config_theme_window_list_icon_size;
+/*! The most memory that resized copies of icons may use, in kilobytes */
+extern guint config_theme_icon_cache_size;
 
 /*! The font for the active window's title */
 extern RrFont *config_font_activewindow;
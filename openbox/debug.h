@@ -37,6 +37,7 @@ typedef enum {
 void ob_debug_type(ObDebugType type, const gchar *a, ...);
 
 void ob_debug_enable(ObDebugType type, gboolean enable);
+gboolean ob_debug_enabled(ObDebugType type);
 
 void ob_debug_show_prompts(void);
 
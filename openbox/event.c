@@ -150,6 +150,10 @@ void event_startup(gboolean reconfig)
 
     xqueue_add_callback(event_process, NULL);
 
+    /* skip the events that later ones make redundant, so that clients
+       flooding us with them don't get everything done over and over */
+    xqueue_coalesce(PropertyNotify, TRUE);
+
 #ifdef USE_SM
     IceAddConnectionWatch(ice_watch, NULL);
 #endif
@@ -464,6 +468,11 @@ static void event_process(const XEvent *ec, gpointer data)
     ee = *ec;
     e = &ee;
 
+    /* the cached value of a property is out of date once it changes, even if
+       nothing else is done with the event */
+    if (e->type == PropertyNotify)
+        obt_prop_cache_invalidate(e->xproperty.window, e->xproperty.atom);
+
     window = event_get_window(e);
     if (window == obt_root(ob_screen))
         /* don't do any lookups, waste of cpu */;
@@ -549,7 +558,9 @@ static void event_process(const XEvent *ec, gpointer data)
                But if the other focus in is something like PointerRoot then we
                still want to fall back.
             */
-            if (xqueue_exists_local(event_look_for_focusin_client, NULL)) {
+            if (xqueue_exists_local_for(None, FocusIn,
+                                        event_look_for_focusin_client, NULL))
+            {
                 ob_debug_type(OB_DEBUG_FOCUS,
                               "  but another FocusIn is coming");
             } else {
@@ -589,7 +600,9 @@ static void event_process(const XEvent *ec, gpointer data)
         if (!wanted_focusevent(e, FALSE))
             ; /* skip this one */
         /* Look for the followup FocusIn */
-        else if (!xqueue_exists_local(event_look_for_focusin, NULL)) {
+        else if (!xqueue_exists_local_for(None, FocusIn,
+                                          event_look_for_focusin, NULL))
+        {
             /* There is no FocusIn, this means focus went to a window that
                is not being managed, or a window on another screen. */
             Window win, root;
@@ -1621,11 +1634,26 @@ static void event_handle_client(ObClient *client, XEvent *e)
             struct ObSkipPropertyChange s;
             s.window = client->window;
             s.prop = msgtype;
-            if (xqueue_exists_local(skip_property_change, &s))
+            if (xqueue_exists_local_for(client->window, PropertyNotify,
+                                        skip_property_change, &s))
                 break;
         }
 
         msgtype = e->xproperty.atom;
+
+        /* these are often set again to the same value, which doesn't need
+           to be handled */
+        if ((msgtype == XA_WM_NORMAL_HINTS ||
+             msgtype == XA_WM_HINTS ||
+             msgtype == OBT_PROP_ATOM(NET_WM_NAME) ||
+             msgtype == OBT_PROP_ATOM(WM_NAME) ||
+             msgtype == OBT_PROP_ATOM(NET_WM_ICON_NAME) ||
+             msgtype == OBT_PROP_ATOM(WM_ICON_NAME) ||
+             msgtype == OBT_PROP_ATOM(NET_WM_STRUT) ||
+             msgtype == OBT_PROP_ATOM(NET_WM_STRUT_PARTIAL)) &&
+            !obt_prop_cache_refresh(client->window, &msgtype, 1))
+            break;
+
         if (msgtype == XA_WM_NORMAL_HINTS) {
             int x, y, w, h, lw, lh;
 
@@ -2058,7 +2086,8 @@ static void event_handle_menu(ObMenuFrame *frame, XEvent *ev)
         if ((e = g_hash_table_lookup(menu_frame_map, &ev->xcrossing.window))) {
             /* check if an EnterNotify event is coming, and if not, then select
                nothing in the menu */
-            if (!xqueue_exists_local(event_look_for_menu_enter, e->frame))
+            if (!xqueue_exists_local_for(None, EnterNotify,
+                                         event_look_for_menu_enter, e->frame))
                 menu_frame_select(e->frame, NULL, FALSE);
         }
         break;
@@ -1077,7 +1077,7 @@ void frame_release_client(ObFrame *self)
         g_source_remove(self->iconify_animation_timer);
 
     /* check if the app has already reparented its window away */
-    if (!xqueue_exists_local(find_reparent, self)) {
+    if (!xqueue_exists_local_for(None, ReparentNotify, find_reparent, self)) {
         /* according to the ICCCM - if the client doesn't reparent itself,
            then we will reparent the window to root for them */
         XReparentWindow(obt_display, self->client->window, obt_root(ob_screen),
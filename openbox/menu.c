@@ -304,7 +304,8 @@ static void parse_menu_item(xmlNodePtr node, gpointer data)
             if (config_menu_show_icons &&
                 obt_xml_attr_string(node, "icon", &icon))
             {
-                e->data.normal.icon = RrImageNewFromName(ob_rr_icons, icon);
+                e->data.normal.icon =
+                    RrImageNewFromNameAsync(ob_rr_icons, icon);
 
                 if (e->data.normal.icon)
                     e->data.normal.icon_alpha = 0xff;
@@ -367,7 +368,8 @@ static void parse_menu(xmlNodePtr node, gpointer data)
         if (config_menu_show_icons &&
             obt_xml_attr_string(node, "icon", &icon))
         {
-            e->data.submenu.icon = RrImageNewFromName(ob_rr_icons, icon);
+            e->data.submenu.icon =
+                RrImageNewFromNameAsync(ob_rr_icons, icon);
 
             if (e->data.submenu.icon)
                 e->data.submenu.icon_alpha = 0xff;
@@ -713,6 +715,35 @@ ObMenuEntry* menu_find_entry_id(ObMenu *self, gint id)
     return ret;
 }
 
+static void drop_icon(gpointer key, gpointer val, gpointer data)
+{
+    ObMenu *menu = val;
+    RrImage *icon = data;
+    GList *it;
+
+    for (it = menu->entries; it; it = g_list_next(it)) {
+        ObMenuEntry *e = it->data;
+
+        if (e->type == OB_MENU_ENTRY_TYPE_NORMAL &&
+            e->data.normal.icon == icon)
+        {
+            RrImageUnref(e->data.normal.icon);
+            e->data.normal.icon = NULL;
+        }
+        else if (e->type == OB_MENU_ENTRY_TYPE_SUBMENU &&
+                 e->data.submenu.icon == icon)
+        {
+            RrImageUnref(e->data.submenu.icon);
+            e->data.submenu.icon = NULL;
+        }
+    }
+}
+
+void menu_drop_icon(RrImage *icon)
+{
+    g_hash_table_foreach(menu_hash, drop_icon, icon);
+}
+
 void menu_find_submenus(ObMenu *self)
 {
     GList *it;
@@ -226,6 +226,9 @@ void menu_entry_set_label(ObMenuEntry *self, const gchar *label,
 
 ObMenuEntry* menu_find_entry_id(ObMenu *self, gint id);
 
+/* removes the icon from every menu entry that shows it */
+void menu_drop_icon(RrImage *icon);
+
 /* fills in the submenus, for use when a menu is being shown */
 void menu_find_submenus(ObMenu *self);
 
@@ -54,6 +54,7 @@ static void menu_entry_frame_free(ObMenuEntryFrame *self);
 static void menu_frame_update(ObMenuFrame *self);
 static gboolean submenu_show_timeout(gpointer data);
 static void menu_frame_hide(ObMenuFrame *self);
+static void menu_entry_frame_render(ObMenuEntryFrame *self);
 
 static gboolean submenu_hide_timeout(gpointer data);
 
@@ -78,6 +79,46 @@ static void client_dest(ObClient *client, gpointer data)
     }
 }
 
+static gboolean entry_shows_icon(ObMenuEntry *e, RrImage *image)
+{
+    return ((e->type == OB_MENU_ENTRY_TYPE_NORMAL &&
+             e->data.normal.icon == image) ||
+            (e->type == OB_MENU_ENTRY_TYPE_SUBMENU &&
+             e->data.submenu.icon == image));
+}
+
+static void icon_loaded(RrImage *image, gboolean loaded, gpointer data)
+{
+    GList *it, *eit;
+    GSList *relayout = NULL, *sit;
+
+    /* draw the icon in any menu entries that are showing it */
+    for (it = menu_frame_visible; it; it = g_list_next(it)) {
+        ObMenuFrame *f = it->data;
+
+        for (eit = f->entries; eit; eit = g_list_next(eit)) {
+            ObMenuEntryFrame *e = eit->data;
+
+            if (entry_shows_icon(e->entry, image)) {
+                if (loaded)
+                    menu_entry_frame_render(e);
+                else {
+                    relayout = g_slist_prepend(relayout, f);
+                    break;
+                }
+            }
+        }
+    }
+
+    if (!loaded) {
+        /* the icon will never draw, so don't leave room for it */
+        menu_drop_icon(image);
+        for (sit = relayout; sit; sit = g_slist_next(sit))
+            menu_frame_render(sit->data);
+        g_slist_free(relayout);
+    }
+}
+
 void menu_frame_startup(gboolean reconfig)
 {
     gint i;
@@ -93,6 +134,7 @@ void menu_frame_startup(gboolean reconfig)
     if (reconfig) return;
 
     client_add_destroy_notify(client_dest, NULL);
+    RrImageCacheSetLoadedFunc(ob_rr_icons, icon_loaded, NULL);
     menu_frame_map = g_hash_table_new(g_int_hash, g_int_equal);
 }
 
@@ -103,6 +145,7 @@ void menu_frame_shutdown(gboolean reconfig)
     if (reconfig) return;
 
     client_remove_destroy_notify(client_dest);
+    RrImageCacheSetLoadedFunc(ob_rr_icons, NULL, NULL);
     g_hash_table_destroy(menu_frame_map);
 }
 
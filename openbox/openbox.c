@@ -24,6 +24,7 @@
 #include "event.h"
 #include "menu.h"
 #include "client.h"
+#include "stacking.h"
 #include "screen.h"
 #include "actions.h"
 #include "startupnotify.h"
@@ -75,6 +76,9 @@
 #ifdef HAVE_UNISTD_H
 #  include <unistd.h>
 #endif
+#ifdef HAVE_STRING_H
+#  include <string.h>
+#endif
 #include <errno.h>
 
 #include <X11/cursorfont.h>
@@ -85,6 +89,7 @@
 RrInstance   *ob_rr_inst;
 RrImageCache *ob_rr_icons;
 RrTheme      *ob_rr_theme;
+RrThemeChanges ob_rr_theme_changes;
 GMainLoop    *ob_main_loop;
 gint          ob_screen;
 gboolean      ob_replace_wm = FALSE;
@@ -182,7 +187,7 @@ gint main(gint argc, gchar **argv)
         ob_exit_with_error(_("Failed to initialize the obrender library."));
     /* Saving 3 resizes of an RrImage makes a lot of sense for icons, as there
        are generally 3 icon sizes needed: the titlebar icon, the menu icon,
-       and the alt-tab icon
+       and the alt-tab icon.
     */
     ob_rr_icons = RrImageCacheNew(3);
 
@@ -218,6 +223,8 @@ gint main(gint argc, gchar **argv)
                                                XC_top_left_corner);
 
     if (screen_annex()) { /* it will be ours! */
+        /* the title layout that the frames were laid out with */
+        gchar *title_layout = NULL;
 
         /* get a timestamp from after taking over as the WM.  if we use the
            old timestamp to set focus it can fail when replacing another WM. */
@@ -226,6 +233,7 @@ gint main(gint argc, gchar **argv)
         do {
             gchar *xml_error_string = NULL;
             ObPrompt *xmlprompt = NULL;
+            RrTheme *old_theme = NULL;
 
             if (reconfigure) obt_keyboard_reload();
 
@@ -277,6 +285,9 @@ gint main(gint argc, gchar **argv)
                 obt_xml_instance_unref(i);
             }
 
+            RrImageCacheSetMaxResizedBytes(
+                ob_rr_icons, (gsize)config_theme_icon_cache_size * 1024);
+
             /* load the theme specified in the rc file */
             {
                 RrTheme *theme;
@@ -288,9 +299,15 @@ gint main(gint argc, gchar **argv)
                                         config_font_activeosd,
                                         config_font_inactiveosd)))
                 {
-                    RrThemeFree(ob_rr_theme);
+                    ob_rr_theme_changes = ob_rr_theme ?
+                        RrThemeDiff(ob_rr_theme, theme) : RR_THEME_SAME;
+                    /* the frames are showing the old theme's pixmaps, so
+                       keep it until they have been redrawn */
+                    old_theme = ob_rr_theme;
                     ob_rr_theme = theme;
                 }
+                else
+                    ob_rr_theme_changes = RR_THEME_SAME;
                 if (ob_rr_theme == NULL)
                     ob_exit_with_error(_("Unable to load a theme."));
 
@@ -298,7 +315,7 @@ gint main(gint argc, gchar **argv)
                               ob_rr_theme->name);
             }
 
-            if (reconfigure) {
+            if (reconfigure && (ob_rr_theme_changes & RR_THEME_FRAME_SIZE)) {
                 GList *it;
 
                 /* update all existing windows for the new theme */
@@ -349,20 +366,42 @@ gint main(gint argc, gchar **argv)
                 }
             } else {
                 GList *it;
+                gboolean relayout;
+
+                relayout = (ob_rr_theme_changes & RR_THEME_FRAME_SIZE) ||
+                    strcmp(title_layout, config_title_layout);
 
                 /* redecorate all existing windows */
                 for (it = client_list; it; it = g_list_next(it)) {
                     ObClient *c = it->data;
+                    guint decorations = c->decorations;
+                    gboolean undecorated = c->undecorated;
 
                     /* the new config can change the window's decorations */
                     client_setup_decor_and_functions(c, FALSE);
-                    /* redraw the frames */
-                    frame_adjust_area(c->frame, TRUE, TRUE, FALSE);
-                    /* the decor sizes may have changed, so the windows may
-                       end up in new positions */
-                    client_reconfigure(c, FALSE);
+
+                    if (relayout || c->decorations != decorations ||
+                        c->undecorated != undecorated)
+                    {
+                        /* redraw the frames */
+                        frame_adjust_area(c->frame, TRUE, TRUE, FALSE);
+                        /* the decor sizes may have changed, so the windows
+                           may end up in new positions */
+                        client_reconfigure(c, FALSE);
+                    }
+                    else if (ob_rr_theme_changes & RR_THEME_FRAME_LOOK)
+                        /* only the colors and such changed, so just paint
+                           the frame again where it is */
+                        frame_adjust_state(c->frame);
+                    /* otherwise the frame already looks the same as it
+                       would with the new theme */
                 }
             }
+            /* frames which were not redrawn keep the old pixmaps as their
+               backgrounds, which the server holds on to for them */
+            RrThemeFree(old_theme);
+            g_free(title_layout);
+            title_layout = g_strdup(config_title_layout);
 
             ob_set_state(OB_STATE_RUNNING);
 
@@ -380,9 +419,54 @@ gint main(gint argc, gchar **argv)
             }
 
             g_main_loop_run(ob_main_loop);
+            /* write out the lists that were waiting for the loop to idle */
+            client_flush_list();
+            stacking_flush_list();
             ob_set_state(reconfigure ?
                          OB_STATE_RECONFIGURING : OB_STATE_EXITING);
 
+            {
+                gulong hits, misses;
+                guint shared;
+
+                RrPixmapCacheStats(ob_rr_inst, &hits, &misses, &shared);
+                ob_debug("Pixmap cache: %lu hits, %lu misses, "
+                         "%u shared pixmaps", hits, misses, shared);
+            }
+            {
+                gulong hits, misses, evictions;
+                gsize bytes;
+
+                RrImageCacheStats(ob_rr_icons, &hits, &misses, &evictions,
+                                  &bytes);
+                ob_debug("Image cache: %lu hits, %lu misses, "
+                         "%lu evictions, %lu bytes", hits, misses, evictions,
+                         (gulong)bytes);
+            }
+            {
+                gulong hits, misses;
+
+                RrFontMeasureStats(ob_rr_theme->win_font_focused,
+                                   &hits, &misses);
+                ob_debug("Title font measurements: %lu hits, %lu misses",
+                         hits, misses);
+                RrFontMeasureStats(ob_rr_theme->menu_font, &hits, &misses);
+                ob_debug("Menu font measurements: %lu hits, %lu misses",
+                         hits, misses);
+            }
+            ob_debug("Coalesced events: %lu PropertyNotify",
+                     xqueue_coalesced(PropertyNotify));
+            {
+                gulong writes, merged, unchanged;
+
+                client_list_stats(&writes, &merged, &unchanged);
+                ob_debug("Client list: %lu writes, %lu merged, "
+                         "%lu unchanged", writes, merged, unchanged);
+                stacking_list_stats(&writes, &merged, &unchanged);
+                ob_debug("Stacking list: %lu writes, %lu merged, "
+                         "%lu unchanged", writes, merged, unchanged);
+            }
+
             if (xmlprompt) {
                 prompt_unref(xmlprompt);
                 xmlprompt = NULL;
@@ -413,11 +497,14 @@ gint main(gint argc, gchar **argv)
             config_shutdown();
             actions_shutdown(reconfigure);
         } while (reconfigure);
+
+        g_free(title_layout);
     }
 
     XSync(obt_display, FALSE);
 
     RrThemeFree(ob_rr_theme);
+    RrImageCancelLoads();
     RrImageCacheUnref(ob_rr_icons);
     RrInstanceFree(ob_rr_inst);
 
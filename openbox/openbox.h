@@ -30,6 +30,8 @@
 extern RrInstance *ob_rr_inst;
 extern RrImageCache *ob_rr_icons;
 extern RrTheme    *ob_rr_theme;
+/*! What looks different in ob_rr_theme since the last reconfigure */
+extern RrThemeChanges ob_rr_theme_changes;
 
 extern GMainLoop *ob_main_loop;
 
@@ -63,7 +63,8 @@ void prompt_startup(gboolean reconfig)
     prompt_a_msg = RrAppearanceCopy(ob_rr_theme->osd_hilite_label);
     prompt_a_msg->texture[0].data.text.flow = TRUE;
 
-    if (reconfig) {
+    /* prompts that are already open only change if the theme's osd did */
+    if (reconfig && (ob_rr_theme_changes & RR_THEME_OSD)) {
         GList *it;
         for (it = prompt_list; it; it = g_list_next(it)) {
             ObPrompt *p = it->data;
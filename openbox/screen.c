@@ -114,7 +114,7 @@ static gboolean replace_wm(void)
         XSync(obt_display, FALSE);
 
         obt_display_ignore_errors(FALSE);
-        if (obt_display_error_occured)
+        if (obt_display_error_occured())
             current_wm_sn_owner = None;
     }
 
@@ -187,7 +187,7 @@ gboolean screen_annex(void)
     obt_display_ignore_errors(TRUE);
     XSelectInput(obt_display, obt_root(ob_screen), ROOT_EVENTMASK);
     obt_display_ignore_errors(FALSE);
-    if (obt_display_error_occured) {
+    if (obt_display_error_occured()) {
         g_message(_("A window manager is already running on screen %d"),
                   ob_screen);
 
@@ -30,6 +30,10 @@
 #include "config.h"
 #include "obt/prop.h"
 
+#ifdef HAVE_STRING_H
+#  include <string.h>
+#endif
+
 GList  *stacking_list = NULL;
 GList  *stacking_list_tail = NULL;
 /*! When true, stacking changes will not be reflected on the screen.  This is
@@ -37,17 +41,22 @@ GList  *stacking_list_tail = NULL;
   raised during focus cycling */
 static gboolean pause_changes = FALSE;
 
-void stacking_set_list(void)
+/*! The list that was last written to the root window */
+static Window  *set_list_windows = NULL;
+static guint    set_list_num = 0;
+static gboolean set_list_written = FALSE;
+/*! The idle source that will write the list, if a change is waiting */
+static guint    set_list_id = 0;
+static gulong   set_list_writes = 0;
+static gulong   set_list_merged = 0;
+static gulong   set_list_unchanged = 0;
+
+static void write_list(void)
 {
     Window *windows = NULL;
     GList *it;
     guint i = 0;
 
-    /* on shutdown, don't update the properties, so that we can read it back
-       in on startup and re-stack the windows as they were before we shut down
-    */
-    if (ob_state() == OB_STATE_EXITING) return;
-
     /* create an array of the window ids (from bottom to top,
        reverse order!) */
     if (stacking_list) {
@@ -58,10 +67,62 @@ void stacking_set_list(void)
         }
     }
 
+    if (set_list_written && i == set_list_num &&
+        (i == 0 || !memcmp(windows, set_list_windows, i * sizeof(Window))))
+    {
+        /* pagers would wake up for nothing */
+        ++set_list_unchanged;
+        g_free(windows);
+        return;
+    }
+
     OBT_PROP_SETA32(obt_root(ob_screen), NET_CLIENT_LIST_STACKING, WINDOW,
                     (gulong*)windows, i);
+    ++set_list_writes;
+
+    g_free(set_list_windows);
+    set_list_windows = windows;
+    set_list_num = i;
+    set_list_written = TRUE;
+}
+
+static gboolean set_list_idle(gpointer data)
+{
+    set_list_id = 0;
+    write_list();
+    return FALSE; /* don't repeat */
+}
+
+void stacking_set_list(void)
+{
+    /* on shutdown, don't update the properties, so that we can read it back
+       in on startup and re-stack the windows as they were before we shut down
+    */
+    if (ob_state() == OB_STATE_EXITING) return;
 
-    g_free(windows);
+    /* a restack can come with many more, so write the list once they are
+       all done */
+    if (set_list_id)
+        ++set_list_merged;
+    else
+        set_list_id = g_idle_add_full(G_PRIORITY_DEFAULT, set_list_idle,
+                                      NULL, NULL);
+}
+
+void stacking_flush_list(void)
+{
+    if (set_list_id) {
+        g_source_remove(set_list_id);
+        set_list_id = 0;
+        write_list();
+    }
+}
+
+void stacking_list_stats(gulong *writes, gulong *merged, gulong *unchanged)
+{
+    *writes = set_list_writes;
+    *merged = set_list_merged;
+    *unchanged = set_list_unchanged;
 }
 
 static void do_restack(GList *wins, GList *before)
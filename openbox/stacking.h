@@ -44,8 +44,15 @@ extern GList *stacking_list;
 extern GList *stacking_list_tail;
 
 /*! Sets the window stacking list on the root window from the
-  stacking_list */
+  stacking_list.  The list is written when the main loop is next idle, and
+  only if it changed. */
 void stacking_set_list(void);
+/*! Writes the window stacking list now, if a change is waiting */
+void stacking_flush_list(void);
+/*! Returns how many times the stacking list was written to the root window,
+  how many changes were written together with another one, and how many
+  times it was not written because it was the same */
+void stacking_list_stats(gulong *writes, gulong *merged, gulong *unchanged);
 
 void stacking_add(struct _ObWindow *win);
 void stacking_add_nonintrusive(struct _ObWindow *win);